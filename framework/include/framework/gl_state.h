@@ -0,0 +1,97 @@
+#pragma once
+#include "disable_all_warnings.h"
+#include "opengl_includes.h"
+// Suppress warnings in third-party code.
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+enum class GLStateKind {
+	Program,
+	VertexArray,
+	Framebuffer,
+	Texture,
+	Viewport,
+	Blend,
+	Depth,
+	ColorMask,
+	Scissor,
+	Uniform,
+	Count
+};
+
+struct GLStateCounters {
+	uint64_t issued { 0 }; // Calls that reached the driver.
+	uint64_t skipped { 0 }; // Redundant calls that did not.
+};
+
+// Remembers the GL state that was set through it and skips calls that would not change anything.
+// Everything starts out unknown, so the first call of every kind reaches the driver. Code that changes
+// the tracked state behind its back has to call invalidate() afterwards, and owners of GL objects have
+// to report their deletion (GL unbinds deleted objects, after which their names can be reused).
+class GLState {
+public:
+	GLState() = default;
+	GLState(const GLState&) = delete;
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vertexArray);
+	// Binds to GL_FRAMEBUFFER (both draw and read).
+	void bindFramebuffer(GLuint framebuffer);
+	void bindTextureUnit(GLuint unit, GLuint texture);
+	void viewport(const glm::ivec2& size);
+	// Disables blending when called without factors.
+	void blend(std::optional<std::pair<GLenum, GLenum>> factors);
+	void depth(bool test, GLenum func, bool write);
+	void colorMask(bool write);
+	// Disables the scissor test when called without a rectangle (x, y, width, height).
+	void scissor(const std::optional<glm::ivec4>& rect);
+	// Sets a matrix uniform of the current program (which has to be bound through useProgram()).
+	void uniformMatrix4(GLint location, const glm::mat4& value);
+
+	void programDeleted(GLuint program);
+	void vertexArrayDeleted(GLuint vertexArray);
+	void framebufferDeleted(GLuint framebuffer);
+	void textureDeleted(GLuint texture);
+	// Forgets everything, e.g. after code that changed the state without going through the cache.
+	void invalidate();
+
+	[[nodiscard]] GLStateCounters counters(GLStateKind kind) const;
+	[[nodiscard]] static std::string_view name(GLStateKind kind);
+	void resetCounters();
+
+private:
+	// Returns true if the call has to reach the driver.
+	bool update(GLStateKind kind, bool changed);
+
+private:
+	static constexpr size_t numTextureUnits = 32;
+
+	std::optional<GLuint> m_program;
+	std::optional<GLuint> m_vertexArray;
+	std::optional<GLuint> m_framebuffer;
+	std::array<std::optional<GLuint>, numTextureUnits> m_textures;
+	std::optional<glm::ivec2> m_viewport;
+	std::optional<bool> m_blendEnabled;
+	std::optional<std::pair<GLenum, GLenum>> m_blendFactors;
+	std::optional<bool> m_depthTest;
+	std::optional<GLenum> m_depthFunc;
+	std::optional<bool> m_depthWrite;
+	std::optional<bool> m_colorWrite;
+	std::optional<bool> m_scissorEnabled;
+	std::optional<glm::ivec4> m_scissorRect;
+	std::unordered_map<GLuint, std::unordered_map<GLint, glm::mat4>> m_matrixUniforms;
+
+	std::array<GLStateCounters, static_cast<size_t>(GLStateKind::Count)> m_counters;
+};
+
+// State cache of the (single) OpenGL context of the application.
+[[nodiscard]] GLState& glState();
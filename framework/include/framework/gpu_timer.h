@@ -0,0 +1,26 @@
+#pragma once
+#include "opengl_includes.h"
+#include <array>
+#include <cstdint>
+#include <optional>
+
+// Measures the GPU time between begin() and end() with timestamp queries. Results only become
+// available a few frames later, so several frames are kept in flight and poll() never stalls.
+class GpuTimer {
+public:
+	static constexpr size_t numFramesInFlight = 4;
+
+	GpuTimer();
+	GpuTimer(const GpuTimer&) = delete;
+	~GpuTimer();
+
+	void begin();
+	void end();
+	// Most recent measurement (in milliseconds) that completed since the last call, if any.
+	[[nodiscard]] std::optional<float> poll();
+
+private:
+	std::array<GLuint, 2 * numFramesInFlight> m_queries {};
+	uint64_t m_issued { 0 }; // Number of begin()/end() pairs.
+	uint64_t m_completed { 0 }; // Number of pairs that were read back (or dropped).
+};
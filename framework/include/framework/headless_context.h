@@ -0,0 +1,37 @@
+#pragma once
+#include "disable_all_warnings.h"
+#include "opengl_includes.h"
+// Suppress warnings in third-party code.
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+
+// Surfaceless OpenGL core context created through EGL (e.g. Mesa llvmpipe), for machines without a
+// display or window system. There is no default framebuffer, so it renders into a framebuffer object of
+// the given size instead. Throws if no such context can be created (or the framework was built without EGL).
+class HeadlessContext {
+public:
+	HeadlessContext(const glm::ivec2& size, int glMajorVersion, int glMinorVersion);
+	HeadlessContext(const HeadlessContext&) = delete;
+	~HeadlessContext();
+
+	// Colour (RGBA8) and depth target that stands in for the default framebuffer.
+	[[nodiscard]] GLuint framebuffer() const;
+	// Reallocates the framebuffer, which may get another name.
+	void resize(const glm::ivec2& size);
+	// Binds the context to the calling thread, or unbinds it so that another thread can bind it.
+	void makeCurrent();
+	void release();
+
+private:
+	void allocateFramebuffer(const glm::ivec2& size);
+	void freeFramebuffer();
+
+private:
+	// EGLDisplay and EGLContext, which are kept out of this header.
+	void* m_display { nullptr };
+	void* m_context { nullptr };
+	GLuint m_framebuffer { 0 };
+	GLuint m_colorRenderbuffer { 0 };
+	GLuint m_depthRenderbuffer { 0 };
+};
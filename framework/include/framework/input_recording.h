@@ -0,0 +1,36 @@
+#pragma once
+#include "disable_all_warnings.h"
+// Suppress warnings in third-party code.
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+enum class InputEventType {
+	Key,
+	Char,
+	MouseButton,
+	MouseMove,
+	Scroll,
+	WindowResize
+};
+
+// Event as it was passed to the callbacks registered with the Window (so after ImGui took the events
+// that it wanted). Only the fields of the type are used.
+struct InputEvent {
+	uint64_t frame { 0 }; // Number of Window::updateInput() calls since the recording started.
+	float time { 0.0f }; // Seconds since the recording started, for reference only: replays are frame-locked.
+	InputEventType type { InputEventType::Key };
+	int key { 0 }, scancode { 0 }, action { 0 }, mods { 0 }; // Key, and action and mods of MouseButton.
+	int button { 0 };
+	unsigned codePoint { 0 };
+	glm::vec2 position { 0.0f }; // Cursor position (origin at the bottom left), scroll offset or window size.
+};
+
+// Text file with one event per line: the frame, the time, the type and the fields of that type.
+void saveInputRecording(const std::filesystem::path& filePath, std::span<const InputEvent> events);
+// Throws if the file cannot be read or is malformed.
+[[nodiscard]] std::vector<InputEvent> loadInputRecording(const std::filesystem::path& filePath);
@@ -0,0 +1,220 @@
+#pragma once
+#include "disable_all_warnings.h"
+// Suppress warnings in third-party code.
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Jobs with this affinity only run on the main thread (the one that created the JobSystem, or the last one
+// that called setMainThread()), e.g. because they talk to OpenGL. They run when the main thread waits for
+// a job or calls runMainThreadJobs().
+enum class JobAffinity {
+	Any,
+	MainThread
+};
+
+// Ready jobs of a higher priority run before those of a lower one on every thread, e.g. the tiles that the
+// user looks at before a background bake. Jobs that already started are never interrupted. Jobs that are
+// submitted without a priority get the one of the job that submits them (Normal outside of jobs), so the
+// chunks of a parallelFor() inside a job compete at the priority of that job.
+enum class JobPriority {
+	Low,
+	Normal,
+	High
+};
+
+class JobSystem;
+struct Job;
+
+// Flag with which the submitter of a long running job asks it to stop early; the job has to check it.
+// Copies share the flag. A default constructed token can never be cancelled.
+class CancellationToken {
+public:
+	CancellationToken() = default;
+	[[nodiscard]] static CancellationToken create();
+
+	void cancel();
+	[[nodiscard]] bool isCancelled() const;
+
+private:
+	std::shared_ptr<std::atomic_bool> m_pCancelled;
+};
+
+class JobHandle {
+public:
+	JobHandle() = default;
+
+	[[nodiscard]] bool valid() const;
+	[[nodiscard]] bool isDone() const;
+	// Runs other jobs until this one finished and rethrows the exception that it threw (if any).
+	void wait() const;
+
+private:
+	friend class JobSystem;
+	JobHandle(std::shared_ptr<Job> pJob, JobSystem* pSystem);
+
+private:
+	std::shared_ptr<Job> m_pJob;
+	JobSystem* m_pSystem { nullptr };
+};
+
+// Result of a job (see JobSystem::async()).
+template <typename T>
+class JobFuture {
+public:
+	JobFuture() = default;
+
+	[[nodiscard]] bool valid() const { return m_handle.valid(); }
+	[[nodiscard]] bool isDone() const { return m_handle.isDone(); }
+	[[nodiscard]] const JobHandle& handle() const { return m_handle; }
+	// Waits for the job like JobHandle::wait() and moves its result out, after which the future is invalid.
+	T get()
+	{
+		m_handle.wait();
+		T out = std::move(**m_pResult);
+		m_handle = {};
+		m_pResult.reset();
+		return out;
+	}
+
+private:
+	friend class JobSystem;
+	JobHandle m_handle;
+	std::shared_ptr<std::optional<T>> m_pResult;
+};
+
+// Pool with one worker per core (except the main thread) that every part of the program shares, so
+// nested parallel loops and background work do not oversubscribe the machine with their own threads.
+// Every worker owns a deque per priority: new jobs go to the back of the deque of the worker that submits
+// them (and are taken from there by that worker), idle workers steal the oldest job from the front of the
+// others. A thread only looks at the deques of a priority once those of all higher priorities are empty.
+// Threads that wait for a job run other jobs meanwhile, so jobs may wait for jobs that they submitted. The
+// main thread only helps with jobs of at least the priority of the job that it waits for, so a frame does
+// not stall on a long background job (the workers still run the others).
+class JobSystem {
+public:
+	// numWorkers defaults to one less than the number of cores. There is always at least one worker.
+	explicit JobSystem(std::optional<int> numWorkers = {});
+	JobSystem(const JobSystem&) = delete;
+	// Finishes the jobs that are still queued.
+	~JobSystem();
+
+	// Runs the function once all dependencies finished (even if they threw).
+	JobHandle submit(std::function<void()> function, std::span<const JobHandle> dependencies = {}, JobAffinity affinity = JobAffinity::Any, std::optional<JobPriority> priority = {});
+	// Continuation that runs once the job finished.
+	JobHandle then(const JobHandle& job, std::function<void()> function, JobAffinity affinity = JobAffinity::Any, std::optional<JobPriority> priority = {});
+	template <typename F>
+	[[nodiscard]] JobFuture<std::invoke_result_t<F>> async(F&& function, std::span<const JobHandle> dependencies = {}, JobAffinity affinity = JobAffinity::Any);
+
+	// Calls body(chunkBegin, chunkEnd) for chunks of at least grainSize items that cover [begin, end) and
+	// returns once all of them are done. There are a few chunks per thread to balance uneven work.
+	template <typename F>
+	void parallelFor(int begin, int end, F&& body, int grainSize = 1);
+	// Calls body(tileBegin, tileEnd) for the tiles of tileSize (cropped at the border) that cover [0, size).
+	template <typename F>
+	void parallelFor2D(const glm::ivec2& size, const glm::ivec2& tileSize, F&& body);
+
+	// Waits for all jobs and then rethrows the first exception that one of them threw.
+	void waitAll(std::span<const JobHandle> jobs);
+	// Runs the main thread jobs that are ready. Only call it from the main thread.
+	void runMainThreadJobs();
+	// Makes the calling thread the main thread, e.g. when the OpenGL context moved to a render thread.
+	void setMainThread();
+
+	// Workers and the main thread.
+	[[nodiscard]] int numThreads() const;
+	// Priority of the job that runs on the calling thread (Normal outside of jobs).
+	[[nodiscard]] static JobPriority currentPriority();
+
+private:
+	friend class JobHandle;
+	struct WorkerQueue;
+
+	void wait(const Job& job);
+	void schedule(std::shared_ptr<Job> pJob);
+	// Runs a main thread job (when called on the main thread) or a job of at least minPriority from the deques.
+	bool tryRunJob(JobPriority minPriority = JobPriority::Low);
+	void run(const std::shared_ptr<Job>& pJob);
+	void workerLoop(int workerIndex);
+
+private:
+	static constexpr int chunksPerThread = 4;
+	static constexpr size_t numPriorities = 3;
+
+	std::atomic<std::thread::id> m_mainThread;
+	std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+	std::vector<std::thread> m_workers;
+	std::atomic<int> m_numQueued { 0 }; // Jobs in the deques.
+	std::atomic<unsigned> m_nextQueue { 0 }; // Deque that receives the next job submitted by another thread.
+
+	std::mutex m_mutex; // Guards the members below.
+	std::condition_variable m_jobQueued; // Wakes the workers.
+	std::condition_variable m_jobFinished; // Wakes the threads in wait().
+	std::vector<std::shared_ptr<Job>> m_mainThreadJobs;
+	bool m_stop { false };
+};
+
+// Pool of the application, created by the first call (which makes the calling thread its main thread).
+JobSystem& jobSystem();
+
+template <typename F>
+JobFuture<std::invoke_result_t<F>> JobSystem::async(F&& function, std::span<const JobHandle> dependencies, JobAffinity affinity)
+{
+	using T = std::invoke_result_t<F>;
+	JobFuture<T> out;
+	out.m_pResult = std::make_shared<std::optional<T>>();
+	out.m_handle = submit(
+		[pResult = out.m_pResult, function = std::forward<F>(function)]() mutable { pResult->emplace(function()); },
+		dependencies, affinity);
+	return out;
+}
+
+template <typename F>
+void JobSystem::parallelFor(int begin, int end, F&& body, int grainSize)
+{
+	const int count = end - begin;
+	if (count <= 0)
+		return;
+
+	const int numChunks = std::clamp(numThreads() * chunksPerThread, 1, (count + grainSize - 1) / std::max(grainSize, 1));
+	const int chunkSize = (count + numChunks - 1) / numChunks;
+	if (chunkSize >= count) {
+		body(begin, end);
+		return;
+	}
+
+	std::vector<JobHandle> chunks;
+	chunks.reserve(static_cast<size_t>(numChunks));
+	for (int chunkBegin = begin; chunkBegin < end; chunkBegin += chunkSize)
+		chunks.push_back(submit([=, &body]() { body(chunkBegin, std::min(chunkBegin + chunkSize, end)); }));
+	waitAll(chunks);
+}
+
+template <typename F>
+void JobSystem::parallelFor2D(const glm::ivec2& size, const glm::ivec2& tileSize, F&& body)
+{
+	const glm::ivec2 numTiles = (size + tileSize - 1) / tileSize;
+	std::vector<JobHandle> tiles;
+	tiles.reserve(static_cast<size_t>(std::max(numTiles.x * numTiles.y, 0)));
+	for (int y = 0; y < numTiles.y; y++) {
+		for (int x = 0; x < numTiles.x; x++) {
+			const glm::ivec2 tileBegin = glm::ivec2(x, y) * tileSize;
+			tiles.push_back(submit([=, &body]() { body(tileBegin, glm::min(tileBegin + tileSize, size)); }));
+		}
+	}
+	waitAll(tiles);
+}
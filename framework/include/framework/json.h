@@ -0,0 +1,7 @@
+#pragma once
+#include <ostream>
+#include <string_view>
+
+// Writes the string as a quoted JSON string. Quotes and backslashes are escaped, as are all control
+// characters (below 0x20), so names from anywhere (e.g. GPU renderer strings) give valid JSON.
+void writeJsonString(std::ostream& stream, std::string_view string);
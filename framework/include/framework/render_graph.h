@@ -0,0 +1,213 @@
+#pragma once
+#include "disable_all_warnings.h"
+#include "gpu_timer.h"
+#include "opengl_includes.h"
+// Suppress warnings in third-party code.
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct TextureDesc {
+	glm::ivec2 size { 0 };
+	GLenum format { GL_RGBA8 };
+
+	[[nodiscard]] bool operator==(const TextureDesc&) const = default;
+};
+
+// Handles are only valid for the frame in which they were declared.
+struct RenderGraphTexture {
+	uint32_t index { 0xFFFFFFFF };
+};
+struct RenderGraphPass {
+	uint32_t index { 0xFFFFFFFF };
+};
+
+enum class LoadOp {
+	Load, // Keep the current contents.
+	Clear,
+	// Keep the current contents, which the pass brings up to date by only redrawing the pixels that changed
+	// (in the scissor rectangle). The result counts as the same pass drawn in full (without the scissor) onto
+	// a clear to clearValue, so a later frame that draws that pass in full can skip it.
+	Update
+};
+
+struct Attachment {
+	RenderGraphTexture texture {};
+	LoadOp load { LoadOp::Load };
+	glm::vec4 clearValue { 0.0f }; // Depth attachments are cleared to clearValue.x.
+};
+
+struct BlendState {
+	GLenum sourceFactor { GL_ONE };
+	GLenum destinationFactor { GL_ONE };
+};
+
+// Fixed function state that the graph sets before a pass executes.
+struct PassState {
+	bool depthTest { true };
+	GLenum depthFunc { GL_LEQUAL };
+	bool depthWrite { true };
+	bool colorWrite { true };
+	std::optional<BlendState> blend {};
+	// Limits the pass (including the clears of its attachments) to these pixels (x, y, width, height).
+	std::optional<glm::ivec4> scissor {};
+};
+
+struct PassDesc {
+	std::string name {};
+	std::vector<Attachment> colorAttachments {};
+	std::optional<Attachment> depthAttachment {};
+	// Textures that the pass samples. The pass binds them itself (see RenderGraph::texture()).
+	std::vector<RenderGraphTexture> reads {};
+	// Defaults to the size of the attachments.
+	std::optional<glm::ivec2> viewportSize {};
+	PassState state {};
+	// Hash of everything besides the textures it reads that determines the output of the pass (uniforms,
+	// matrices, ...). Passes without a signature are never skipped.
+	std::optional<uint64_t> signature {};
+};
+
+enum class PassEvent {
+	Begin,
+	End,
+	Skipped, // The outputs already contain what the pass would render.
+	Culled // Nothing uses the outputs.
+};
+using PassHook = std::function<void(std::string_view passName, PassEvent event)>;
+
+struct PassStatistics {
+	std::string name;
+	float gpuTime { 0.0f }; // Milliseconds, smoothed over the recent executions.
+	uint64_t executed { 0 }, skipped { 0 }, culled { 0 };
+};
+
+// Frame graph of render passes. The passes of a frame are declared with the textures that they read
+// and render to, after which the graph:
+//  - culls passes whose outputs are never used,
+//  - skips passes whose outputs would not change: the contents of every texture are identified by a
+//    hash of the signatures and inputs of the passes that wrote it, which is remembered across frames
+//    for imported textures,
+//  - allocates transient textures from a pool for the passes between their first and last use, so
+//    textures with disjoint lifetimes share memory,
+//  - creates (and caches) the framebuffers, clears the attachments and sets the viewport and state,
+//  - measures the GPU time of every pass, which is also recorded in the trace (see trace.h) next to a
+//    CPU zone per pass.
+class RenderGraph {
+public:
+	RenderGraph() = default;
+	RenderGraph(const RenderGraph&) = delete;
+	~RenderGraph();
+
+	// Starts declaring the passes of a new frame.
+	void beginFrame();
+
+	// Texture owned by the application. contentHash identifies the current contents of textures that
+	// are written outside of the graph; it is tracked by the graph for textures that passes render to.
+	[[nodiscard]] RenderGraphTexture importTexture(std::string_view name, GLuint texture, const TextureDesc& desc, std::optional<uint64_t> contentHash = {});
+	// The default framebuffer (or the framebuffer object that replaces it, see Window::defaultFramebuffer()),
+	// whose contents are lost every frame. Passes that render to it always execute.
+	[[nodiscard]] RenderGraphTexture importBackbuffer(const glm::ivec2& size, GLuint framebuffer = 0);
+	// Pooled texture that only exists while the passes that use it execute.
+	[[nodiscard]] RenderGraphTexture createTexture(std::string_view name, const TextureDesc& desc);
+	RenderGraphPass addPass(PassDesc&& desc, std::function<void()>&& execute);
+	// Pass that draws a single triangle covering the viewport after setup() bound the program and its
+	// inputs. There is no vertex buffer: the vertex shader has to generate the corners from gl_VertexID
+	// (e.g. corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2 - 1). Depth testing is disabled.
+	RenderGraphPass addFullscreenPass(PassDesc&& desc, std::function<void()>&& setup);
+
+	// Decides which passes are culled or skipped. Called by execute() when necessary.
+	void compile();
+	[[nodiscard]] bool willExecute(RenderGraphPass pass);
+	void execute();
+
+	// GL name of a texture. Transient textures only exist while the passes that use them execute.
+	[[nodiscard]] GLuint texture(RenderGraphTexture texture) const;
+	// Forgets the contents of an imported texture, e.g. after it was modified outside of the graph.
+	void invalidate(GLuint texture);
+
+	void setPassHook(PassHook&& hook);
+	// Most recent GPU time of the pass (in milliseconds) that was not taken before, if any.
+	[[nodiscard]] std::optional<float> takeGpuTime(std::string_view passName);
+	[[nodiscard]] std::vector<PassStatistics> statistics() const;
+
+private:
+	enum class TextureKind {
+		Imported,
+		Backbuffer,
+		Transient
+	};
+	struct TextureNode {
+		std::string name;
+		TextureDesc desc;
+		TextureKind kind;
+		GLuint texture;
+		std::optional<uint64_t> contentHash;
+
+		// Filled in by compile().
+		uint64_t hash { 0 };
+		int numWrites { 0 };
+		bool reusable { false };
+		int firstUse { -1 }, lastUse { -1 };
+	};
+	struct PassNode {
+		PassDesc desc;
+		std::function<void()> execute;
+
+		// Filled in by compile(). Inputs are the read and loaded textures with the write they observe.
+		std::vector<std::pair<uint32_t, int>> inputs;
+		std::vector<uint32_t> outputs;
+		bool culled { false }, skipped { false };
+	};
+	struct PassHistory {
+		GpuTimer timer;
+		PassStatistics statistics;
+		std::optional<float> untakenGpuTime;
+		// CPU zone and GPU time counter of the pass in the trace (see trace.h).
+		const char* zoneName { nullptr };
+		const char* gpuTimeCounterName { nullptr };
+	};
+	struct PooledTexture {
+		TextureDesc desc;
+		GLuint texture;
+		bool inUse;
+		uint64_t lastUsedFrame;
+	};
+	struct CachedFramebuffer {
+		GLuint framebuffer;
+		uint64_t lastUsedFrame;
+	};
+	// Attachments (GL name, size and format) of a framebuffer.
+	using FramebufferKey = std::vector<uint64_t>;
+
+	[[nodiscard]] uint64_t uniqueHash();
+	void cull(bool afterSkipping);
+	[[nodiscard]] GLuint framebufferOf(const PassNode& pass);
+	[[nodiscard]] GLuint acquireTexture(const TextureDesc& desc);
+	void releaseTexture(GLuint texture);
+	void forgetFramebuffersOf(GLuint texture);
+	void collectGarbage();
+
+private:
+	std::vector<TextureNode> m_textures;
+	std::vector<PassNode> m_passes;
+	bool m_compiled { false };
+
+	// Persistent across frames.
+	uint64_t m_frame { 0 };
+	uint64_t m_uniqueCounter { 0 };
+	std::unordered_map<GLuint, std::pair<TextureDesc, uint64_t>> m_importedContents;
+	std::vector<PooledTexture> m_texturePool;
+	std::map<FramebufferKey, CachedFramebuffer> m_framebuffers;
+	std::map<std::string, PassHistory, std::less<>> m_history;
+	PassHook m_passHook;
+	GLuint m_fullscreenVertexArray { 0 }; // Without any attributes.
+};
@@ -12,6 +12,10 @@ DISABLE_WARNINGS_POP()
 #include <filesystem>
 #include <vector>
 
+// Lets the driver compile and link shaders on its own threads if it supports GL_KHR_parallel_shader_compile
+// (or the ARB version). Called by the Window with the function loader of its context.
+void initParallelShaderCompile(GLADloadproc loader);
+
 struct ShaderLoadingException : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
@@ -30,13 +34,37 @@ public:
     void bind() const;
 
 private:
-    friend class ShaderBuilder;
+    friend class PendingShader;
     Shader(GLuint program);
 
 private:
     GLuint m_program;
 };
 
+// Program whose compilation and linking may still be running on the threads of the driver, so the
+// application can do other work (or start more shaders) before it needs the result.
+class PendingShader {
+public:
+    PendingShader(const PendingShader&) = delete;
+    PendingShader(PendingShader&&);
+    ~PendingShader();
+
+    // Whether get() would return without waiting for the driver.
+    [[nodiscard]] bool isReady() const;
+    // Waits for the program; throws ShaderLoadingException if a stage failed to compile or link.
+    Shader get();
+
+private:
+    friend class ShaderBuilder;
+    PendingShader(GLuint program, std::vector<GLuint> shaders, std::vector<std::filesystem::path> shaderFiles);
+    void freeResources();
+
+private:
+    GLuint m_program;
+    std::vector<GLuint> m_shaders;
+    std::vector<std::filesystem::path> m_shaderFiles;
+};
+
 class ShaderBuilder {
 public:
     ShaderBuilder() = default;
@@ -44,7 +72,10 @@ public:
     ShaderBuilder(ShaderBuilder&&) = default;
     ~ShaderBuilder();
 
+    // Starts compiling the stage; compile errors are reported by build() (or PendingShader::get()).
     ShaderBuilder& addStage(GLuint shaderStage, std::filesystem::path shaderFile);
+    // Starts linking the program without waiting for the compiler.
+    PendingShader buildAsync();
     Shader build();
 
 private:
@@ -52,4 +83,5 @@ private:
 
 private:
     std::vector<GLuint> m_shaders;
+    std::vector<std::filesystem::path> m_shaderFiles;
 };
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+// Low overhead tracing of CPU zones and counters, exported in the Chrome trace event format (open the
+// file in ui.perfetto.dev or chrome://tracing). Every thread records into a fixed size ring buffer that
+// only it writes to, so recording never takes a lock; when the buffer is full the oldest events of that
+// thread are overwritten. Nothing is recorded until startTracing() is called.
+//
+// Names are not copied: they have to be string literals or come from traceName().
+
+void startTracing();
+void stopTracing();
+[[nodiscard]] bool isTracing();
+
+// Copy of the name that lives until the program exits (the same pointer for equal names). Takes a lock,
+// so dynamic names (e.g. of render passes) should be looked up once and remembered.
+[[nodiscard]] const char* traceName(std::string_view name);
+// Name of the calling thread in the trace.
+void setTraceThreadName(std::string_view name);
+
+// Zone that started at beginTime (see traceTime()) and ends now.
+void traceZone(const char* name, int64_t beginTime);
+void traceCounter(const char* name, double value);
+// Nanoseconds since tracing started.
+[[nodiscard]] int64_t traceTime();
+
+// Stops tracing and writes the events that are still in the ring buffers. Threads may still be running
+// (e.g. a background bake): events that they overwrite while the file is written are left out.
+void writeChromeTrace(const std::filesystem::path& filePath);
+
+// Records the lifetime of the object as a zone (if tracing was enabled when it was created).
+class TraceScope {
+public:
+	explicit TraceScope(const char* name)
+		: m_name(isTracing() ? name : nullptr)
+		, m_beginTime(m_name ? traceTime() : 0)
+	{
+	}
+	TraceScope(const TraceScope&) = delete;
+	~TraceScope()
+	{
+		if (m_name)
+			traceZone(m_name, m_beginTime);
+	}
+
+private:
+	const char* m_name;
+	int64_t m_beginTime;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+// Zone from here to the end of the enclosing scope.
+#define TRACE_ZONE(name) const TraceScope TRACE_CONCAT(traceScope, __LINE__) { name }
+#define TRACE_COUNTER(name, value)                            \
+	do {                                                      \
+		if (isTracing())                                      \
+			traceCounter(name, static_cast<double>(value)); \
+	} while (false)
@@ -21,6 +21,8 @@ public:
 	static void printHelp();
 
 	void disableTranslation();
+	// The left button can be used for something else (e.g. painting) while rotation is disabled.
+	void setRotationEnabled(bool enabled);
 
 	[[nodiscard]] glm::vec3 left() const;
 	[[nodiscard]] glm::vec3 up() const;
@@ -46,6 +48,7 @@ private:
 	const Window* m_pWindow;
 	float m_fovy;
 	bool m_canTranslate { true };
+	bool m_canRotate { true };
 
 	glm::vec3 m_lookAt{ 0.0f }; // Point that the camera is looking at / rotating around.
 	float m_distanceFromLookAt;
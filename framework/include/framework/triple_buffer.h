@@ -0,0 +1,51 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Hands the latest value from one writer thread to one reader thread without locks. The writer fills its
+// own slot and publishes it by swapping it with the shared middle slot; the reader swaps the middle slot
+// with its own when a newer value was published. Neither side ever waits for the other, and values that
+// the reader did not get to before the next publish() are dropped.
+template <typename T>
+class TripleBuffer {
+public:
+	explicit TripleBuffer(const T& initial)
+		: m_slots { initial, initial, initial }
+	{
+	}
+	TripleBuffer(const TripleBuffer&) = delete;
+
+	// Writer side.
+	void publish(const T& value)
+	{
+		m_slots[m_back] = value;
+		m_back = static_cast<uint8_t>(m_middle.exchange(static_cast<uint8_t>(m_back | freshBit), std::memory_order_acq_rel) & indexMask);
+		m_middle.notify_one();
+	}
+
+	// Reader side. Makes the latest published value the front; returns false if there was none since the last call.
+	bool update()
+	{
+		if (!(m_middle.load(std::memory_order_relaxed) & freshBit))
+			return false;
+		m_front = static_cast<uint8_t>(m_middle.exchange(m_front, std::memory_order_acq_rel) & indexMask);
+		return true;
+	}
+	// Blocks until a value was published that update() did not take yet.
+	void waitForUpdate() const
+	{
+		for (uint8_t middle = m_middle.load(std::memory_order_relaxed); !(middle & freshBit); middle = m_middle.load(std::memory_order_relaxed))
+			m_middle.wait(middle, std::memory_order_relaxed);
+	}
+	[[nodiscard]] const T& front() const { return m_slots[m_front]; }
+
+private:
+	static constexpr uint8_t indexMask = 0x3;
+	static constexpr uint8_t freshBit = 0x4; // Set while the middle slot holds a value that the reader did not take.
+
+	std::array<T, 3> m_slots;
+	uint8_t m_back { 0 }; // Only used by the writer.
+	std::atomic<uint8_t> m_middle { 1 };
+	uint8_t m_front { 2 }; // Only used by the reader.
+};
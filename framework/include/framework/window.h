@@ -1,14 +1,20 @@
 #pragma once
 #include "disable_all_warnings.h"
+#include "input_recording.h"
 #include "opengl_includes.h"
 // Suppress warnings in third-party code.
 DISABLE_WARNINGS_PUSH()
 #include <GLFW/glfw3.h>
 #include <glm/vec2.hpp>
 DISABLE_WARNINGS_POP()
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <optional>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 enum class OpenGLVersion {
@@ -17,16 +23,48 @@ enum class OpenGLVersion {
 	GL45
 };
 
+enum class WindowMode {
+	Windowed,
+	// Surfaceless context without a window, input or ImGui (see HeadlessContext). Rendering goes to
+	// defaultFramebuffer() and the constructor throws if no such context is available.
+	Headless
+};
+
+enum class RedrawMode {
+	Continuous, // updateInput() polls for events, the application redraws every frame.
+	OnDemand // updateInput() sleeps until an event arrives or requestRedraw() is called.
+};
+
+class HeadlessContext;
+
 class Window {
 public:
-	Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersion glVersion);
+	Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersion glVersion, WindowMode mode = WindowMode::Windowed);
 	~Window();
 
 	void close(); // Set shouldClose() to true.
 	[[nodiscard]] bool shouldClose(); // Whether window should close (close() was called or user clicked the close button).
 
 	void updateInput();
+	// Same as updateInput() in on demand mode, whatever the redraw mode: sleeps until an event arrives or
+	// requestRedraw() is called. For an input thread that leaves the drawing to another thread.
+	void waitForInput();
 	void swapBuffers(); // Swap the front/back buffer
+	// Whether swapBuffers() waits for the vertical blank (the default). Disable it to measure frame times.
+	void setVSync(bool enabled);
+	// Moves the OpenGL context to a render thread: releaseContext() on the thread that has it, then
+	// makeContextCurrent() on the other one. updateInput() stays on the thread that created the window.
+	// Dear ImGui is only drawn while that thread has the context.
+	void makeContextCurrent();
+	void releaseContext();
+
+	// In on demand mode a frame is only drawn after input (keys, mouse, resize, window damage) or after
+	// requestRedraw(), so an idle viewer does not use any CPU or GPU time.
+	void setRedrawMode(RedrawMode mode);
+	[[nodiscard]] RedrawMode getRedrawMode() const;
+	// Schedules another frame, e.g. after changing a parameter or when a render needs more frames to
+	// converge. May be called from any thread.
+	void requestRedraw();
 
 	using KeyCallback = std::function<void(int key, int scancode, int action, int mods)>;
 	void registerKeyCallback(KeyCallback&&);
@@ -41,6 +79,16 @@ public:
 	using WindowResizeCallback = std::function<void(const glm::ivec2& size)>;
 	void registerWindowResizeCallback(WindowResizeCallback&&);
 
+	// Records the events that reach the registered callbacks until stopRecording().
+	void startRecording();
+	[[nodiscard]] std::vector<InputEvent> stopRecording();
+	// Feeds recorded events to the registered callbacks instead of the real input: every updateInput()
+	// dispatches the events of the next recorded frame (without waiting in on demand mode), which also
+	// works for headless windows. isKeyPressed(), isMouseButtonPressed() and getCursorPos() follow the
+	// replayed events until all of them were dispatched.
+	void replay(std::vector<InputEvent>&& events);
+	[[nodiscard]] bool isReplaying() const;
+
 	bool isKeyPressed(int key) const;
 	bool isMouseButtonPressed(int button) const;
 
@@ -58,6 +106,10 @@ public:
 	[[nodiscard]] float getAspectRatio() const;
 	[[nodiscard]] float getDpiScalingFactor() const;
 
+	[[nodiscard]] bool isHeadless() const;
+	// Framebuffer that ends up on the screen: 0, or the offscreen target of a headless window.
+	[[nodiscard]] GLuint defaultFramebuffer() const;
+
 private:
 	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 	static void charCallback(GLFWwindow* window, unsigned unicodeCodePoint);
@@ -65,12 +117,40 @@ private:
 	static void mouseMoveCallback(GLFWwindow* window, double xpos, double ypos);
 	static void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 	static void windowSizeCallback(GLFWwindow* window, int width, int height);
+	static void windowRefreshCallback(GLFWwindow* window);
+	static void markDirty(GLFWwindow* window);
+
+	void processInput(bool waitForEvents);
+	void dispatchLiveEvent(InputEvent event);
+	void dispatchReplayedEvent(const InputEvent& event);
+	void invokeCallbacks(const InputEvent& event);
 
 private:
-	GLFWwindow* m_pWindow;
+	GLFWwindow* m_pWindow { nullptr };
+	std::unique_ptr<HeadlessContext> m_pHeadlessContext; // Only in headless mode.
+	bool m_shouldClose { false }; // Of a headless window.
 	glm::ivec2 m_windowSize;
 	float m_dpiScalingFactor = 1.0f;
 	const OpenGLVersion m_glVersion;
+	RedrawMode m_redrawMode { RedrawMode::Continuous };
+	std::atomic_bool m_dirty { true };
+	const std::thread::id m_mainThread { std::this_thread::get_id() };
+	std::atomic_bool m_imGuiEnabled { true }; // False while the context is on another thread.
+	uint64_t m_frame { 0 }; // Number of updateInput() and waitForInput() calls.
+
+	bool m_recording { false };
+	uint64_t m_recordingStartFrame { 0 };
+	std::chrono::steady_clock::time_point m_recordingStartTime;
+	std::vector<InputEvent> m_recordedEvents;
+
+	bool m_replaying { false };
+	std::vector<InputEvent> m_replayEvents;
+	size_t m_nextReplayEvent { 0 };
+	uint64_t m_replayFrame { 0 };
+	// Input state while replaying (and of a headless window, which has no other input).
+	std::array<bool, GLFW_KEY_LAST + 1> m_replayedKeys {};
+	std::array<bool, GLFW_MOUSE_BUTTON_LAST + 1> m_replayedMouseButtons {};
+	glm::vec2 m_replayedCursorPos { 0.0f };
 
 	std::vector<KeyCallback> m_keyCallbacks;
 	std::vector<CharCallback> m_charCallbacks;
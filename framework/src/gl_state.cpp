@@ -0,0 +1,219 @@
+#include "gl_state.h"
+#include <cassert>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/type_ptr.hpp>
+DISABLE_WARNINGS_POP()
+
+void GLState::useProgram(GLuint program)
+{
+    if (update(GLStateKind::Program, m_program != program)) {
+        glUseProgram(program);
+        m_program = program;
+    }
+}
+
+void GLState::bindVertexArray(GLuint vertexArray)
+{
+    if (update(GLStateKind::VertexArray, m_vertexArray != vertexArray)) {
+        glBindVertexArray(vertexArray);
+        m_vertexArray = vertexArray;
+    }
+}
+
+void GLState::bindFramebuffer(GLuint framebuffer)
+{
+    if (update(GLStateKind::Framebuffer, m_framebuffer != framebuffer)) {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        m_framebuffer = framebuffer;
+    }
+}
+
+void GLState::bindTextureUnit(GLuint unit, GLuint texture)
+{
+    // Units beyond the tracked ones are always bound.
+    if (unit >= numTextureUnits) {
+        update(GLStateKind::Texture, true);
+        glBindTextureUnit(unit, texture);
+        return;
+    }
+    if (update(GLStateKind::Texture, m_textures[unit] != texture)) {
+        glBindTextureUnit(unit, texture);
+        m_textures[unit] = texture;
+    }
+}
+
+void GLState::viewport(const glm::ivec2& size)
+{
+    if (update(GLStateKind::Viewport, m_viewport != size)) {
+        glViewport(0, 0, size.x, size.y);
+        m_viewport = size;
+    }
+}
+
+void GLState::blend(std::optional<std::pair<GLenum, GLenum>> factors)
+{
+    const bool enabled = factors.has_value();
+    if (update(GLStateKind::Blend, m_blendEnabled != enabled)) {
+        if (enabled)
+            glEnable(GL_BLEND);
+        else
+            glDisable(GL_BLEND);
+        m_blendEnabled = enabled;
+    }
+    // The factors of disabled blending do not matter, so they are left alone.
+    if (enabled && update(GLStateKind::Blend, m_blendFactors != factors)) {
+        glBlendFunc(factors->first, factors->second);
+        m_blendFactors = factors;
+    }
+}
+
+void GLState::depth(bool test, GLenum func, bool write)
+{
+    if (update(GLStateKind::Depth, m_depthTest != test)) {
+        if (test)
+            glEnable(GL_DEPTH_TEST);
+        else
+            glDisable(GL_DEPTH_TEST);
+        m_depthTest = test;
+    }
+    if (update(GLStateKind::Depth, m_depthFunc != func)) {
+        glDepthFunc(func);
+        m_depthFunc = func;
+    }
+    if (update(GLStateKind::Depth, m_depthWrite != write)) {
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        m_depthWrite = write;
+    }
+}
+
+void GLState::colorMask(bool write)
+{
+    if (update(GLStateKind::ColorMask, m_colorWrite != write)) {
+        const GLboolean mask = write ? GL_TRUE : GL_FALSE;
+        glColorMask(mask, mask, mask, mask);
+        m_colorWrite = write;
+    }
+}
+
+void GLState::scissor(const std::optional<glm::ivec4>& rect)
+{
+    const bool enabled = rect.has_value();
+    if (update(GLStateKind::Scissor, m_scissorEnabled != enabled)) {
+        if (enabled)
+            glEnable(GL_SCISSOR_TEST);
+        else
+            glDisable(GL_SCISSOR_TEST);
+        m_scissorEnabled = enabled;
+    }
+    if (enabled && update(GLStateKind::Scissor, m_scissorRect != rect)) {
+        glScissor(rect->x, rect->y, rect->z, rect->w);
+        m_scissorRect = rect;
+    }
+}
+
+void GLState::uniformMatrix4(GLint location, const glm::mat4& value)
+{
+    assert(m_program);
+    auto& uniforms = m_matrixUniforms[*m_program];
+    const auto iter = uniforms.find(location);
+    if (update(GLStateKind::Uniform, iter == std::end(uniforms) || iter->second != value)) {
+        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+        uniforms[location] = value;
+    }
+}
+
+void GLState::programDeleted(GLuint program)
+{
+    if (m_program == program)
+        m_program.reset();
+    m_matrixUniforms.erase(program);
+}
+
+void GLState::vertexArrayDeleted(GLuint vertexArray)
+{
+    if (m_vertexArray == vertexArray)
+        m_vertexArray = 0;
+}
+
+void GLState::framebufferDeleted(GLuint framebuffer)
+{
+    if (m_framebuffer == framebuffer)
+        m_framebuffer = 0;
+}
+
+void GLState::textureDeleted(GLuint texture)
+{
+    for (std::optional<GLuint>& unit : m_textures) {
+        if (unit == texture)
+            unit = 0;
+    }
+}
+
+void GLState::invalidate()
+{
+    m_program.reset();
+    m_vertexArray.reset();
+    m_framebuffer.reset();
+    m_textures.fill(std::nullopt);
+    m_viewport.reset();
+    m_blendEnabled.reset();
+    m_blendFactors.reset();
+    m_depthTest.reset();
+    m_depthFunc.reset();
+    m_depthWrite.reset();
+    m_colorWrite.reset();
+    m_scissorEnabled.reset();
+    m_scissorRect.reset();
+    m_matrixUniforms.clear();
+}
+
+GLStateCounters GLState::counters(GLStateKind kind) const
+{
+    return m_counters[static_cast<size_t>(kind)];
+}
+
+std::string_view GLState::name(GLStateKind kind)
+{
+    switch (kind) {
+    case GLStateKind::Program:
+        return "program";
+    case GLStateKind::VertexArray:
+        return "vertex array";
+    case GLStateKind::Framebuffer:
+        return "framebuffer";
+    case GLStateKind::Texture:
+        return "texture";
+    case GLStateKind::Viewport:
+        return "viewport";
+    case GLStateKind::Blend:
+        return "blend";
+    case GLStateKind::Depth:
+        return "depth";
+    case GLStateKind::ColorMask:
+        return "color mask";
+    case GLStateKind::Scissor:
+        return "scissor";
+    case GLStateKind::Uniform:
+        return "uniform";
+    default:
+        return "";
+    };
+}
+
+void GLState::resetCounters()
+{
+    m_counters.fill({});
+}
+
+bool GLState::update(GLStateKind kind, bool changed)
+{
+    GLStateCounters& counters = m_counters[static_cast<size_t>(kind)];
+    (changed ? counters.issued : counters.skipped)++;
+    return changed;
+}
+
+GLState& glState()
+{
+    static GLState state;
+    return state;
+}
@@ -0,0 +1,44 @@
+#include "gpu_timer.h"
+
+GpuTimer::GpuTimer()
+{
+    glCreateQueries(GL_TIMESTAMP, static_cast<GLsizei>(m_queries.size()), m_queries.data());
+}
+
+GpuTimer::~GpuTimer()
+{
+    glDeleteQueries(static_cast<GLsizei>(m_queries.size()), m_queries.data());
+}
+
+void GpuTimer::begin()
+{
+    // All slots are still in flight (the GPU is far behind): drop the oldest measurement rather than waiting for it.
+    if (m_issued - m_completed == numFramesInFlight)
+        m_completed++;
+    glQueryCounter(m_queries[2 * (m_issued % numFramesInFlight)], GL_TIMESTAMP);
+}
+
+void GpuTimer::end()
+{
+    glQueryCounter(m_queries[2 * (m_issued % numFramesInFlight) + 1], GL_TIMESTAMP);
+    m_issued++;
+}
+
+std::optional<float> GpuTimer::poll()
+{
+    std::optional<float> latest;
+    while (m_completed < m_issued) {
+        const size_t slot = 2 * (m_completed % numFramesInFlight);
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(m_queries[slot + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 beginTime, endTime;
+        glGetQueryObjectui64v(m_queries[slot], GL_QUERY_RESULT, &beginTime);
+        glGetQueryObjectui64v(m_queries[slot + 1], GL_QUERY_RESULT, &endTime);
+        latest = static_cast<float>(endTime - beginTime) * 1e-6f;
+        m_completed++;
+    }
+    return latest;
+}
@@ -0,0 +1,138 @@
+#include "headless_context.h"
+#include "gl_state.h"
+#include "shader.h"
+#ifdef FRAMEWORK_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#include <cassert>
+#include <exception>
+#include <iostream>
+
+#ifdef FRAMEWORK_EGL
+HeadlessContext::HeadlessContext(const glm::ivec2& size, int glMajorVersion, int glMinorVersion)
+{
+    // The surfaceless platform of Mesa does not need a display server or GPU device. Other EGL
+    // implementations may still provide a surfaceless context on the default display.
+    EGLDisplay display = EGL_NO_DISPLAY;
+    if (const auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT")))
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint eglMajorVersion, eglMinorVersion;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &eglMajorVersion, &eglMinorVersion)) {
+        std::cerr << "Could not initialize EGL" << std::endl;
+        throw std::exception();
+    }
+    m_display = display;
+
+    // Without a surface there is no need for a config (EGL_KHR_no_config_context).
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, glMajorVersion,
+        EGL_CONTEXT_MINOR_VERSION, glMinorVersion,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = EGL_NO_CONTEXT;
+    if (eglBindAPI(EGL_OPENGL_API))
+        context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT) {
+        eglTerminate(display);
+        std::cerr << "Could not create an OpenGL " << glMajorVersion << "." << glMinorVersion << " context through EGL" << std::endl;
+        throw std::exception();
+    }
+    m_context = context;
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+        std::cerr << "Could not make the surfaceless EGL context current (EGL_KHR_surfaceless_context)" << std::endl;
+        throw std::exception();
+    }
+
+    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress))) {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+        std::cerr << "Could not load the OpenGL functions" << std::endl;
+        throw std::exception();
+    }
+    initParallelShaderCompile(reinterpret_cast<GLADloadproc>(eglGetProcAddress));
+    std::cout << "Initialized headless OpenGL " << glGetString(GL_VERSION) << " (" << glGetString(GL_RENDERER) << ")" << std::endl;
+
+    allocateFramebuffer(size);
+}
+
+HeadlessContext::~HeadlessContext()
+{
+    freeFramebuffer();
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(m_display, m_context);
+    eglTerminate(m_display);
+}
+
+void HeadlessContext::makeCurrent()
+{
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context);
+}
+
+void HeadlessContext::release()
+{
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+#else
+HeadlessContext::HeadlessContext(const glm::ivec2&, int, int)
+{
+    std::cerr << "Headless rendering requires EGL, which was not found when the framework was built" << std::endl;
+    throw std::exception();
+}
+
+HeadlessContext::~HeadlessContext()
+{
+}
+
+void HeadlessContext::makeCurrent()
+{
+}
+
+void HeadlessContext::release()
+{
+}
+#endif
+
+GLuint HeadlessContext::framebuffer() const
+{
+    return m_framebuffer;
+}
+
+void HeadlessContext::resize(const glm::ivec2& size)
+{
+    freeFramebuffer();
+    allocateFramebuffer(size);
+}
+
+void HeadlessContext::allocateFramebuffer(const glm::ivec2& size)
+{
+    glCreateRenderbuffers(1, &m_colorRenderbuffer);
+    glNamedRenderbufferStorage(m_colorRenderbuffer, GL_RGBA8, size.x, size.y);
+    glCreateRenderbuffers(1, &m_depthRenderbuffer);
+    glNamedRenderbufferStorage(m_depthRenderbuffer, GL_DEPTH_COMPONENT24, size.x, size.y);
+    glCreateFramebuffers(1, &m_framebuffer);
+    glNamedFramebufferRenderbuffer(m_framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorRenderbuffer);
+    glNamedFramebufferRenderbuffer(m_framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthRenderbuffer);
+    assert(glCheckNamedFramebufferStatus(m_framebuffer, GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+}
+
+void HeadlessContext::freeFramebuffer()
+{
+    if (m_framebuffer != 0) {
+        glState().framebufferDeleted(m_framebuffer);
+        glDeleteFramebuffers(1, &m_framebuffer);
+    }
+    if (m_colorRenderbuffer != 0)
+        glDeleteRenderbuffers(1, &m_colorRenderbuffer);
+    if (m_depthRenderbuffer != 0)
+        glDeleteRenderbuffers(1, &m_depthRenderbuffer);
+    m_framebuffer = 0;
+    m_colorRenderbuffer = 0;
+    m_depthRenderbuffer = 0;
+}
@@ -1,4 +1,5 @@
 #include "image.h"
+#include "trace.h"
 // Suppress warnings in third-party code.
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
@@ -12,6 +13,7 @@ DISABLE_WARNINGS_POP()
 
 Image::Image(const std::filesystem::path& filePath)
 {
+	TRACE_ZONE("Image::Image");
 	if (!std::filesystem::exists(filePath)) {
 		std::cerr << "Texture file " << filePath << " does not exists!" << std::endl;
 		throw std::exception();
@@ -27,6 +29,7 @@ Image::Image(const std::filesystem::path& filePath)
 	}
 
 	constexpr size_t numChannels = 3; // STBI_rgb == 3 channels
+	pixels.reserve(static_cast<size_t>(width) * static_cast<size_t>(height));
 	for (size_t i = 0; i < width * height * numChannels; i += numChannels) {
             pixels.emplace_back(stbPixels[i + 0] / 255.0f, stbPixels[i + 1] / 255.0f, stbPixels[i + 2] / 255.0f);
 	}
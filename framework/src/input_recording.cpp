@@ -0,0 +1,89 @@
+#include "input_recording.h"
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+static constexpr std::array<std::string_view, 6> eventTypeNames { "key", "char", "button", "move", "scroll", "resize" };
+
+void saveInputRecording(const std::filesystem::path& filePath, std::span<const InputEvent> events)
+{
+    std::ofstream file { filePath };
+    if (!file) {
+        std::cerr << "Could not open " << filePath << " for writing" << std::endl;
+        throw std::exception();
+    }
+
+    for (const InputEvent& event : events) {
+        file << event.frame << ' ' << event.time << ' ' << eventTypeNames[static_cast<size_t>(event.type)];
+        switch (event.type) {
+        case InputEventType::Key: {
+            file << ' ' << event.key << ' ' << event.scancode << ' ' << event.action << ' ' << event.mods;
+        } break;
+        case InputEventType::Char: {
+            file << ' ' << event.codePoint;
+        } break;
+        case InputEventType::MouseButton: {
+            file << ' ' << event.button << ' ' << event.action << ' ' << event.mods;
+        } break;
+        case InputEventType::MouseMove:
+        case InputEventType::Scroll:
+        case InputEventType::WindowResize: {
+            file << ' ' << event.position.x << ' ' << event.position.y;
+        } break;
+        };
+        file << '\n';
+    }
+}
+
+std::vector<InputEvent> loadInputRecording(const std::filesystem::path& filePath)
+{
+    std::ifstream file { filePath };
+    if (!file) {
+        std::cerr << "Input recording " << filePath << " does not exist" << std::endl;
+        throw std::exception();
+    }
+
+    std::vector<InputEvent> out;
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        if (line.empty())
+            continue;
+
+        std::istringstream stream { line };
+        InputEvent event;
+        std::string typeName;
+        stream >> event.frame >> event.time >> typeName;
+        const auto typeIter = std::find(std::begin(eventTypeNames), std::end(eventTypeNames), typeName);
+        if (typeIter != std::end(eventTypeNames)) {
+            event.type = static_cast<InputEventType>(typeIter - std::begin(eventTypeNames));
+            switch (event.type) {
+            case InputEventType::Key: {
+                stream >> event.key >> event.scancode >> event.action >> event.mods;
+            } break;
+            case InputEventType::Char: {
+                stream >> event.codePoint;
+            } break;
+            case InputEventType::MouseButton: {
+                stream >> event.button >> event.action >> event.mods;
+            } break;
+            case InputEventType::MouseMove:
+            case InputEventType::Scroll:
+            case InputEventType::WindowResize: {
+                stream >> event.position.x >> event.position.y;
+            } break;
+            };
+        }
+        // Events have to be in the order of their frames, otherwise they would never be replayed.
+        if (!stream || typeIter == std::end(eventTypeNames) || (!out.empty() && event.frame < out.back().frame)) {
+            std::cerr << "Malformed input event on line " << lineNumber << " of " << filePath << std::endl;
+            throw std::exception();
+        }
+        out.push_back(event);
+    }
+    return out;
+}
@@ -0,0 +1,305 @@
+#include "job_system.h"
+#include "trace.h"
+#include <cassert>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <string>
+#include <utility>
+
+struct Job {
+    std::function<void()> function;
+    JobAffinity affinity { JobAffinity::Any };
+    JobPriority priority { JobPriority::Normal };
+    // Unfinished dependencies, plus one while the job is being submitted.
+    std::atomic<int> numBlockers { 1 };
+
+    std::mutex mutex; // Guards continuations and the writes of done.
+    std::vector<std::shared_ptr<Job>> continuations;
+    std::atomic_bool done { false };
+    std::exception_ptr exception; // Written before done.
+};
+
+struct JobSystem::WorkerQueue {
+    std::mutex mutex;
+    std::array<std::deque<std::shared_ptr<Job>>, numPriorities> jobs; // Indexed by JobPriority.
+};
+
+// Index of the worker that runs on this thread (in the JobSystem that pWorkerSystem points to).
+static thread_local JobSystem* pWorkerSystem = nullptr;
+static thread_local int workerIndex = -1;
+// Priority of the innermost job that runs on this thread.
+static thread_local JobPriority runningPriority = JobPriority::Normal;
+
+CancellationToken CancellationToken::create()
+{
+    CancellationToken out;
+    out.m_pCancelled = std::make_shared<std::atomic_bool>(false);
+    return out;
+}
+
+void CancellationToken::cancel()
+{
+    assert(m_pCancelled);
+    m_pCancelled->store(true, std::memory_order_relaxed);
+}
+
+bool CancellationToken::isCancelled() const
+{
+    return m_pCancelled && m_pCancelled->load(std::memory_order_relaxed);
+}
+
+JobHandle::JobHandle(std::shared_ptr<Job> pJob, JobSystem* pSystem)
+    : m_pJob(std::move(pJob))
+    , m_pSystem(pSystem)
+{
+}
+
+bool JobHandle::valid() const
+{
+    return m_pJob != nullptr;
+}
+
+bool JobHandle::isDone() const
+{
+    return m_pJob && m_pJob->done.load(std::memory_order_acquire);
+}
+
+void JobHandle::wait() const
+{
+    assert(valid());
+    m_pSystem->wait(*m_pJob);
+    if (m_pJob->exception)
+        std::rethrow_exception(m_pJob->exception);
+}
+
+JobSystem::JobSystem(std::optional<int> numWorkers)
+    : m_mainThread(std::this_thread::get_id())
+{
+    // The tracer has to outlive the workers, which release their trace buffers when they exit.
+    (void)isTracing();
+
+    // Jobs submitted by other threads go to the deque of a worker, so there has to be one.
+    const int count = std::max(numWorkers.value_or(static_cast<int>(std::thread::hardware_concurrency()) - 1), 1);
+    for (int i = 0; i < count; i++)
+        m_queues.push_back(std::make_unique<WorkerQueue>());
+    for (int i = 0; i < count; i++)
+        m_workers.emplace_back([this, i]() { workerLoop(i); });
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::scoped_lock lock { m_mutex };
+        m_stop = true;
+    }
+    m_jobQueued.notify_all();
+    for (std::thread& worker : m_workers)
+        worker.join();
+}
+
+JobHandle JobSystem::submit(std::function<void()> function, std::span<const JobHandle> dependencies, JobAffinity affinity, std::optional<JobPriority> priority)
+{
+    auto pJob = std::make_shared<Job>();
+    pJob->function = std::move(function);
+    pJob->affinity = affinity;
+    pJob->priority = priority.value_or(runningPriority);
+    for (const JobHandle& dependency : dependencies) {
+        if (!dependency.valid())
+            continue;
+        Job& dependencyJob = *dependency.m_pJob;
+        std::scoped_lock lock { dependencyJob.mutex };
+        if (!dependencyJob.done.load(std::memory_order_relaxed)) {
+            pJob->numBlockers++;
+            dependencyJob.continuations.push_back(pJob);
+        }
+    }
+    if (pJob->numBlockers.fetch_sub(1) == 1)
+        schedule(pJob);
+    return JobHandle { std::move(pJob), this };
+}
+
+JobHandle JobSystem::then(const JobHandle& job, std::function<void()> function, JobAffinity affinity, std::optional<JobPriority> priority)
+{
+    return submit(std::move(function), std::span(&job, 1), affinity, priority);
+}
+
+void JobSystem::waitAll(std::span<const JobHandle> jobs)
+{
+    std::exception_ptr exception;
+    for (const JobHandle& job : jobs) {
+        try {
+            job.wait();
+        } catch (...) {
+            if (!exception)
+                exception = std::current_exception();
+        }
+    }
+    if (exception)
+        std::rethrow_exception(exception);
+}
+
+void JobSystem::runMainThreadJobs()
+{
+    assert(std::this_thread::get_id() == m_mainThread);
+    std::vector<std::shared_ptr<Job>> jobs;
+    {
+        std::scoped_lock lock { m_mutex };
+        jobs.swap(m_mainThreadJobs);
+    }
+    for (const auto& pJob : jobs)
+        run(pJob);
+}
+
+void JobSystem::setMainThread()
+{
+    m_mainThread = std::this_thread::get_id();
+}
+
+int JobSystem::numThreads() const
+{
+    return static_cast<int>(m_workers.size()) + 1;
+}
+
+JobPriority JobSystem::currentPriority()
+{
+    return runningPriority;
+}
+
+void JobSystem::wait(const Job& job)
+{
+    const bool onMainThread = std::this_thread::get_id() == m_mainThread;
+    // The main thread leaves queued jobs of a lower priority to the workers, but runs all main thread jobs
+    // (nobody else can).
+    const JobPriority minPriority = onMainThread ? job.priority : JobPriority::Low;
+    while (!job.done.load(std::memory_order_acquire)) {
+        if (tryRunJob(minPriority))
+            continue;
+        // The job runs on another thread (or waits for its dependencies). The timeout catches the jobs
+        // that were queued after tryRunJob() looked at the deques.
+        std::unique_lock lock { m_mutex };
+        m_jobFinished.wait_for(lock, std::chrono::milliseconds(1), [&]() {
+            return job.done.load(std::memory_order_acquire) || (onMainThread && !m_mainThreadJobs.empty());
+        });
+    }
+}
+
+void JobSystem::schedule(std::shared_ptr<Job> pJob)
+{
+    if (pJob->affinity == JobAffinity::MainThread) {
+        {
+            std::scoped_lock lock { m_mutex };
+            m_mainThreadJobs.push_back(std::move(pJob));
+        }
+        m_jobFinished.notify_all();
+        return;
+    }
+
+    const size_t queue = pWorkerSystem == this ? static_cast<size_t>(workerIndex) : m_nextQueue++ % m_queues.size();
+    const size_t priority = static_cast<size_t>(pJob->priority);
+    {
+        std::scoped_lock lock { m_queues[queue]->mutex };
+        m_queues[queue]->jobs[priority].push_back(std::move(pJob));
+    }
+    m_numQueued++;
+    // Workers check m_numQueued while holding the mutex, so they cannot miss the notification.
+    {
+        std::scoped_lock lock { m_mutex };
+    }
+    m_jobQueued.notify_one();
+}
+
+bool JobSystem::tryRunJob(JobPriority minPriority)
+{
+    std::shared_ptr<Job> pJob;
+    if (std::this_thread::get_id() == m_mainThread) {
+        std::scoped_lock lock { m_mutex };
+        if (!m_mainThreadJobs.empty()) {
+            pJob = std::move(m_mainThreadJobs.front());
+            m_mainThreadJobs.erase(std::begin(m_mainThreadJobs));
+        }
+    }
+
+    if (!pJob && m_numQueued.load() > 0) {
+        // The newest job of the own deque (whose data is still in the cache), otherwise the oldest job of another.
+        const size_t numQueues = m_queues.size();
+        const size_t own = pWorkerSystem == this ? static_cast<size_t>(workerIndex) : numQueues;
+        for (size_t priority = numPriorities; priority-- > static_cast<size_t>(minPriority) && !pJob;) {
+            if (own < numQueues) {
+                WorkerQueue& queue = *m_queues[own];
+                std::scoped_lock lock { queue.mutex };
+                if (!queue.jobs[priority].empty()) {
+                    pJob = std::move(queue.jobs[priority].back());
+                    queue.jobs[priority].pop_back();
+                }
+            }
+            for (size_t i = 1; i <= numQueues && !pJob; i++) {
+                WorkerQueue& queue = *m_queues[(own + i) % numQueues];
+                std::scoped_lock lock { queue.mutex };
+                if (!queue.jobs[priority].empty()) {
+                    pJob = std::move(queue.jobs[priority].front());
+                    queue.jobs[priority].pop_front();
+                }
+            }
+        }
+        if (pJob)
+            m_numQueued--;
+    }
+
+    if (!pJob)
+        return false;
+    run(pJob);
+    return true;
+}
+
+void JobSystem::run(const std::shared_ptr<Job>& pJob)
+{
+    // A thread that waits runs other jobs, so the priority of the job that waits is restored afterwards.
+    const JobPriority outerPriority = std::exchange(runningPriority, pJob->priority);
+    try {
+        pJob->function();
+    } catch (...) {
+        pJob->exception = std::current_exception();
+    }
+    runningPriority = outerPriority;
+    // Releases whatever the function captured.
+    pJob->function = nullptr;
+
+    std::vector<std::shared_ptr<Job>> continuations;
+    {
+        std::scoped_lock lock { pJob->mutex };
+        pJob->done.store(true, std::memory_order_release);
+        continuations.swap(pJob->continuations);
+    }
+    for (auto& pContinuation : continuations) {
+        if (pContinuation->numBlockers.fetch_sub(1) == 1)
+            schedule(std::move(pContinuation));
+    }
+
+    {
+        std::scoped_lock lock { m_mutex };
+    }
+    m_jobFinished.notify_all();
+}
+
+void JobSystem::workerLoop(int index)
+{
+    pWorkerSystem = this;
+    workerIndex = index;
+    setTraceThreadName("worker " + std::to_string(index));
+
+    while (true) {
+        if (tryRunJob())
+            continue;
+        std::unique_lock lock { m_mutex };
+        m_jobQueued.wait(lock, [&]() { return m_stop || m_numQueued.load() > 0; });
+        if (m_stop && m_numQueued.load() == 0)
+            return;
+    }
+}
+
+JobSystem& jobSystem()
+{
+    static JobSystem system;
+    return system;
+}
@@ -0,0 +1,30 @@
+#include "json.h"
+#include <array>
+
+void writeJsonString(std::ostream& stream, std::string_view string)
+{
+    static constexpr std::array<char, 16> hexDigits { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    stream << '"';
+    for (const char c : string) {
+        switch (c) {
+        case '"':
+            stream << "\\\"";
+            break;
+        case '\\':
+            stream << "\\\\";
+            break;
+        case '\n':
+            stream << "\\n";
+            break;
+        case '\t':
+            stream << "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+                stream << "\\u00" << hexDigits[static_cast<unsigned char>(c) >> 4] << hexDigits[static_cast<unsigned char>(c) & 0xF];
+            else
+                stream << c;
+        }
+    }
+    stream << '"';
+}
@@ -0,0 +1,535 @@
+#include "render_graph.h"
+#include "gl_state.h"
+#include "trace.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/type_ptr.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <utility>
+
+// Pooled textures and framebuffers that were not used for this many frames are deleted.
+static constexpr uint64_t texturePoolFrames = 3;
+static constexpr uint64_t framebufferCacheFrames = 60;
+// Marks depth attachments in framebuffer keys.
+static constexpr uint64_t depthAttachmentBit = uint64_t(1) << 32;
+
+static void deleteFramebuffer(GLuint framebuffer)
+{
+    glState().framebufferDeleted(framebuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+}
+
+static void deleteTexture(GLuint texture)
+{
+    glState().textureDeleted(texture);
+    glDeleteTextures(1, &texture);
+}
+
+static uint64_t combine(uint64_t seed, uint64_t value)
+{
+    // Mixing step of splitmix64, so that similar inputs (e.g. attachment slots) give unrelated hashes.
+    uint64_t z = seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static uint64_t hashString(std::string_view string)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char c : string)
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+    return hash;
+}
+
+static uint64_t hashState(const PassState& state)
+{
+    uint64_t hash = combine(state.depthTest, state.depthFunc);
+    hash = combine(hash, state.depthWrite);
+    hash = combine(hash, state.colorWrite);
+    if (state.blend) {
+        hash = combine(hash, state.blend->sourceFactor);
+        hash = combine(hash, state.blend->destinationFactor);
+    }
+    if (state.scissor) {
+        for (int c = 0; c < 4; c++)
+            hash = combine(hash, static_cast<uint64_t>((*state.scissor)[c]));
+    }
+    return hash;
+}
+
+// Colour attachments followed by the depth attachment.
+static std::vector<const Attachment*> attachmentsOf(const PassDesc& desc)
+{
+    std::vector<const Attachment*> attachments;
+    for (const Attachment& attachment : desc.colorAttachments)
+        attachments.push_back(&attachment);
+    if (desc.depthAttachment)
+        attachments.push_back(&desc.depthAttachment.value());
+    return attachments;
+}
+
+RenderGraph::~RenderGraph()
+{
+    for (const auto& [key, cached] : m_framebuffers)
+        deleteFramebuffer(cached.framebuffer);
+    for (const PooledTexture& pooled : m_texturePool)
+        deleteTexture(pooled.texture);
+    if (m_fullscreenVertexArray != 0) {
+        glState().vertexArrayDeleted(m_fullscreenVertexArray);
+        glDeleteVertexArrays(1, &m_fullscreenVertexArray);
+    }
+}
+
+void RenderGraph::beginFrame()
+{
+    assert(std::none_of(std::begin(m_texturePool), std::end(m_texturePool), [](const PooledTexture& pooled) { return pooled.inUse; }));
+    m_textures.clear();
+    m_passes.clear();
+    m_compiled = false;
+    m_frame++;
+}
+
+RenderGraphTexture RenderGraph::importTexture(std::string_view name, GLuint texture, const TextureDesc& desc, std::optional<uint64_t> contentHash)
+{
+    // Importing the same texture twice (e.g. under two names) has to give the same node.
+    for (uint32_t i = 0; i < m_textures.size(); i++) {
+        if (m_textures[i].kind == TextureKind::Imported && m_textures[i].texture == texture)
+            return { i };
+    }
+    m_textures.push_back({ std::string(name), desc, TextureKind::Imported, texture, contentHash });
+    m_compiled = false;
+    return { static_cast<uint32_t>(m_textures.size() - 1) };
+}
+
+RenderGraphTexture RenderGraph::importBackbuffer(const glm::ivec2& size, GLuint framebuffer)
+{
+    // Stores the framebuffer instead of a texture.
+    m_textures.push_back({ "backbuffer", TextureDesc { size, GL_RGBA8 }, TextureKind::Backbuffer, framebuffer, {} });
+    m_compiled = false;
+    return { static_cast<uint32_t>(m_textures.size() - 1) };
+}
+
+RenderGraphTexture RenderGraph::createTexture(std::string_view name, const TextureDesc& desc)
+{
+    m_textures.push_back({ std::string(name), desc, TextureKind::Transient, 0, {} });
+    m_compiled = false;
+    return { static_cast<uint32_t>(m_textures.size() - 1) };
+}
+
+RenderGraphPass RenderGraph::addPass(PassDesc&& desc, std::function<void()>&& execute)
+{
+    assert(!desc.colorAttachments.empty() || desc.depthAttachment);
+    m_passes.push_back({ std::move(desc), std::move(execute), {}, {} });
+    m_compiled = false;
+    return { static_cast<uint32_t>(m_passes.size() - 1) };
+}
+
+RenderGraphPass RenderGraph::addFullscreenPass(PassDesc&& desc, std::function<void()>&& setup)
+{
+    assert(!desc.depthAttachment);
+    desc.state.depthTest = false;
+    desc.state.depthWrite = false;
+    if (m_fullscreenVertexArray == 0)
+        glCreateVertexArrays(1, &m_fullscreenVertexArray);
+    return addPass(std::move(desc), [this, setup = std::move(setup)]() {
+        setup();
+        glState().bindVertexArray(m_fullscreenVertexArray);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    });
+}
+
+uint64_t RenderGraph::uniqueHash()
+{
+    return combine(0x5eed, ++m_uniqueCounter);
+}
+
+// Marks passes as culled when none of their outputs is imported or used by a later pass. After
+// skipping, skipped passes are treated as not using their inputs.
+void RenderGraph::cull(bool afterSkipping)
+{
+    std::vector<bool> needed(m_textures.size(), false);
+    for (auto it = std::rbegin(m_passes); it != std::rend(m_passes); it++) {
+        PassNode& pass = *it;
+        if (pass.culled || (afterSkipping && pass.skipped))
+            continue;
+
+        const std::vector<const Attachment*> attachments = attachmentsOf(pass.desc);
+
+        const bool used = std::any_of(std::begin(attachments), std::end(attachments), [&](const Attachment* pAttachment) {
+            return m_textures[pAttachment->texture.index].kind != TextureKind::Transient || needed[pAttachment->texture.index];
+        });
+        if (!used) {
+            pass.culled = true;
+            continue;
+        }
+
+        // Writers before a clear are not needed (unless this pass also reads the texture).
+        for (const Attachment* pAttachment : attachments) {
+            if (pAttachment->load == LoadOp::Clear)
+                needed[pAttachment->texture.index] = false;
+        }
+        for (const Attachment* pAttachment : attachments) {
+            if (pAttachment->load != LoadOp::Clear)
+                needed[pAttachment->texture.index] = true;
+        }
+        for (const RenderGraphTexture& read : pass.desc.reads)
+            needed[read.index] = true;
+    }
+}
+
+void RenderGraph::compile()
+{
+    if (m_compiled)
+        return;
+    m_compiled = true;
+    TRACE_ZONE("RenderGraph::compile");
+
+    // Contents at the start of the frame.
+    for (TextureNode& texture : m_textures) {
+        texture.numWrites = 0;
+        texture.reusable = false;
+        texture.firstUse = texture.lastUse = -1;
+        if (texture.contentHash) {
+            texture.hash = *texture.contentHash;
+        } else if (auto it = m_importedContents.find(texture.texture); texture.kind == TextureKind::Imported && it != std::end(m_importedContents) && it->second.first == texture.desc) {
+            texture.hash = it->second.second;
+        } else {
+            texture.hash = uniqueHash();
+        }
+    }
+    for (PassNode& pass : m_passes) {
+        pass.inputs.clear();
+        pass.outputs.clear();
+        pass.culled = pass.skipped = false;
+    }
+    cull(false);
+
+    // Simulate the frame: the contents of every output are a hash of the pass and everything it read.
+    for (PassNode& pass : m_passes) {
+        if (pass.culled)
+            continue;
+        const std::vector<const Attachment*> attachments = attachmentsOf(pass.desc);
+        // An update has the contents of the full pass, so it is hashed like one.
+        const bool update = std::any_of(std::begin(attachments), std::end(attachments), [](const Attachment* pAttachment) { return pAttachment->load == LoadOp::Update; });
+        PassState state = pass.desc.state;
+        if (update)
+            state.scissor.reset();
+
+        uint64_t hash = combine(hashString(pass.desc.name), pass.desc.signature ? *pass.desc.signature : uniqueHash());
+        hash = combine(hash, hashState(state));
+        if (pass.desc.viewportSize) {
+            hash = combine(hash, static_cast<uint64_t>(pass.desc.viewportSize->x));
+            hash = combine(hash, static_cast<uint64_t>(pass.desc.viewportSize->y));
+        }
+
+        for (const RenderGraphTexture& read : pass.desc.reads) {
+            hash = combine(hash, m_textures[read.index].hash);
+            pass.inputs.emplace_back(read.index, m_textures[read.index].numWrites);
+        }
+        for (const Attachment* pAttachment : attachments) {
+            TextureNode& texture = m_textures[pAttachment->texture.index];
+            if (pAttachment->load == LoadOp::Load) {
+                hash = combine(hash, texture.hash);
+            } else {
+                for (int c = 0; c < 4; c++)
+                    hash = combine(hash, std::bit_cast<uint32_t>(pAttachment->clearValue[c]));
+            }
+            if (pAttachment->load != LoadOp::Clear)
+                pass.inputs.emplace_back(pAttachment->texture.index, texture.numWrites);
+        }
+        for (uint64_t slot = 0; slot < attachments.size(); slot++) {
+            TextureNode& texture = m_textures[attachments[slot]->texture.index];
+            texture.hash = combine(hash, slot);
+            texture.numWrites++;
+            pass.outputs.push_back(attachments[slot]->texture.index);
+        }
+    }
+
+    // Imported textures that end up with the contents they already have do not need to be rendered.
+    for (TextureNode& texture : m_textures) {
+        const auto it = m_importedContents.find(texture.texture);
+        texture.reusable = texture.kind == TextureKind::Imported && texture.numWrites > 0 && it != std::end(m_importedContents)
+            && it->second.first == texture.desc && it->second.second == texture.hash;
+    }
+    // A pass is skipped when all of its outputs are reusable. A texture stops being reusable when a
+    // pass that executes writes it or reads one of its intermediate contents.
+    for (bool changed = true; changed;) {
+        for (PassNode& pass : m_passes) {
+            pass.skipped = !pass.culled && std::all_of(std::begin(pass.outputs), std::end(pass.outputs), [&](uint32_t output) { return m_textures[output].reusable; });
+        }
+        changed = false;
+        for (const PassNode& pass : m_passes) {
+            if (pass.culled || pass.skipped)
+                continue;
+            for (const auto& [input, numWrites] : pass.inputs) {
+                if (m_textures[input].reusable && numWrites != m_textures[input].numWrites) {
+                    m_textures[input].reusable = false;
+                    changed = true;
+                }
+            }
+            for (uint32_t output : pass.outputs) {
+                if (m_textures[output].reusable) {
+                    m_textures[output].reusable = false;
+                    changed = true;
+                }
+            }
+        }
+    }
+    cull(true);
+
+    // Lifetimes of the transient textures.
+    for (int i = 0; i < static_cast<int>(m_passes.size()); i++) {
+        const PassNode& pass = m_passes[static_cast<size_t>(i)];
+        if (pass.culled || pass.skipped)
+            continue;
+        auto use = [&](uint32_t index) {
+            TextureNode& texture = m_textures[index];
+            if (texture.firstUse == -1)
+                texture.firstUse = i;
+            texture.lastUse = i;
+        };
+        for (const auto& [input, numWrites] : pass.inputs)
+            use(input);
+        for (uint32_t output : pass.outputs)
+            use(output);
+    }
+}
+
+bool RenderGraph::willExecute(RenderGraphPass pass)
+{
+    compile();
+    return pass.index < m_passes.size() && !m_passes[pass.index].culled && !m_passes[pass.index].skipped;
+}
+
+void RenderGraph::execute()
+{
+    TRACE_ZONE("RenderGraph::execute");
+    compile();
+
+    for (auto& [name, history] : m_history) {
+        if (const std::optional<float> gpuTime = history.timer.poll()) {
+            TRACE_COUNTER(history.gpuTimeCounterName, *gpuTime);
+            float& smoothed = history.statistics.gpuTime;
+            smoothed = smoothed == 0.0f ? *gpuTime : smoothed + 0.1f * (*gpuTime - smoothed);
+            history.untakenGpuTime = gpuTime;
+        }
+    }
+
+    for (int i = 0; i < static_cast<int>(m_passes.size()); i++) {
+        PassNode& pass = m_passes[static_cast<size_t>(i)];
+        PassHistory& history = m_history.try_emplace(pass.desc.name).first->second;
+        history.statistics.name = pass.desc.name;
+        if (!history.zoneName) {
+            history.zoneName = traceName(pass.desc.name);
+            history.gpuTimeCounterName = traceName(pass.desc.name + " GPU (ms)");
+        }
+        if (pass.culled || pass.skipped) {
+            (pass.culled ? history.statistics.culled : history.statistics.skipped)++;
+            if (m_passHook)
+                m_passHook(pass.desc.name, pass.culled ? PassEvent::Culled : PassEvent::Skipped);
+            continue;
+        }
+
+        for (TextureNode& texture : m_textures) {
+            if (texture.kind == TextureKind::Transient && texture.firstUse == i)
+                texture.texture = acquireTexture(texture.desc);
+        }
+
+        const TraceScope passZone { history.zoneName };
+        const GLuint framebuffer = framebufferOf(pass);
+        glState().bindFramebuffer(framebuffer);
+        const RenderGraphTexture sizeSource = pass.desc.colorAttachments.empty() ? pass.desc.depthAttachment->texture : pass.desc.colorAttachments[0].texture;
+        const glm::ivec2 viewportSize = pass.desc.viewportSize.value_or(m_textures[sizeSource.index].desc.size);
+        glState().viewport(viewportSize);
+
+        // Clears obey the write masks and the scissor rectangle.
+        const PassState& state = pass.desc.state;
+        glState().scissor(state.scissor);
+        for (size_t slot = 0; slot < pass.desc.colorAttachments.size(); slot++) {
+            const Attachment& attachment = pass.desc.colorAttachments[slot];
+            if (attachment.load == LoadOp::Clear) {
+                glState().colorMask(true);
+                glClearNamedFramebufferfv(framebuffer, GL_COLOR, static_cast<GLint>(slot), glm::value_ptr(attachment.clearValue));
+            }
+        }
+        if (pass.desc.depthAttachment && pass.desc.depthAttachment->load == LoadOp::Clear) {
+            glState().depth(state.depthTest, state.depthFunc, true);
+            glClearNamedFramebufferfv(framebuffer, GL_DEPTH, 0, &pass.desc.depthAttachment->clearValue.x);
+        }
+
+        glState().depth(state.depthTest, state.depthFunc, state.depthWrite);
+        glState().colorMask(state.colorWrite);
+        if (state.blend)
+            glState().blend(std::pair { state.blend->sourceFactor, state.blend->destinationFactor });
+        else
+            glState().blend({});
+
+        if (m_passHook)
+            m_passHook(pass.desc.name, PassEvent::Begin);
+        history.timer.begin();
+        pass.execute();
+        history.timer.end();
+        if (m_passHook)
+            m_passHook(pass.desc.name, PassEvent::End);
+        history.statistics.executed++;
+
+        for (TextureNode& texture : m_textures) {
+            if (texture.kind == TextureKind::Transient && texture.lastUse == i) {
+                releaseTexture(texture.texture);
+                texture.texture = 0;
+            }
+        }
+    }
+
+    for (const TextureNode& texture : m_textures) {
+        if (texture.kind == TextureKind::Imported && texture.numWrites > 0)
+            m_importedContents[texture.texture] = { texture.desc, texture.hash };
+    }
+
+    // Leave the default state behind for code that renders outside of the graph.
+    glState().bindFramebuffer(0);
+    glState().depth(true, GL_LEQUAL, true);
+    glState().colorMask(true);
+    glState().blend({});
+    glState().scissor({});
+
+    collectGarbage();
+}
+
+GLuint RenderGraph::texture(RenderGraphTexture texture) const
+{
+    return m_textures[texture.index].texture;
+}
+
+void RenderGraph::invalidate(GLuint texture)
+{
+    m_importedContents.erase(texture);
+    forgetFramebuffersOf(texture);
+}
+
+void RenderGraph::setPassHook(PassHook&& hook)
+{
+    m_passHook = std::move(hook);
+}
+
+std::optional<float> RenderGraph::takeGpuTime(std::string_view passName)
+{
+    const auto it = m_history.find(passName);
+    if (it == std::end(m_history))
+        return {};
+    return std::exchange(it->second.untakenGpuTime, std::nullopt);
+}
+
+std::vector<PassStatistics> RenderGraph::statistics() const
+{
+    std::vector<PassStatistics> out;
+    for (const auto& [name, history] : m_history)
+        out.push_back(history.statistics);
+    return out;
+}
+
+GLuint RenderGraph::framebufferOf(const PassNode& pass)
+{
+    if (!pass.desc.colorAttachments.empty() && m_textures[pass.desc.colorAttachments[0].texture.index].kind == TextureKind::Backbuffer) {
+        assert(pass.desc.colorAttachments.size() == 1 && !pass.desc.depthAttachment);
+        return m_textures[pass.desc.colorAttachments[0].texture.index].texture;
+    }
+
+    FramebufferKey key;
+    auto addToKey = [&](const Attachment& attachment, uint64_t flags) {
+        const TextureNode& texture = m_textures[attachment.texture.index];
+        key.insert(std::end(key), { texture.texture, static_cast<uint64_t>(texture.desc.size.x), static_cast<uint64_t>(texture.desc.size.y), texture.desc.format | flags });
+    };
+    for (const Attachment& attachment : pass.desc.colorAttachments)
+        addToKey(attachment, 0);
+    if (pass.desc.depthAttachment)
+        addToKey(*pass.desc.depthAttachment, depthAttachmentBit);
+
+    if (auto it = m_framebuffers.find(key); it != std::end(m_framebuffers)) {
+        it->second.lastUsedFrame = m_frame;
+        return it->second.framebuffer;
+    }
+
+    GLuint framebuffer;
+    glCreateFramebuffers(1, &framebuffer);
+    std::vector<GLenum> drawBuffers;
+    for (const Attachment& attachment : pass.desc.colorAttachments) {
+        const GLenum attachmentPoint = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(drawBuffers.size());
+        glNamedFramebufferTexture(framebuffer, attachmentPoint, m_textures[attachment.texture.index].texture, 0);
+        drawBuffers.push_back(attachmentPoint);
+    }
+    if (pass.desc.depthAttachment)
+        glNamedFramebufferTexture(framebuffer, GL_DEPTH_ATTACHMENT, m_textures[pass.desc.depthAttachment->texture.index].texture, 0);
+    if (drawBuffers.empty())
+        glNamedFramebufferDrawBuffer(framebuffer, GL_NONE);
+    else
+        glNamedFramebufferDrawBuffers(framebuffer, static_cast<GLsizei>(drawBuffers.size()), drawBuffers.data());
+    assert(glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+
+    m_framebuffers[key] = { framebuffer, m_frame };
+    return framebuffer;
+}
+
+GLuint RenderGraph::acquireTexture(const TextureDesc& desc)
+{
+    for (PooledTexture& pooled : m_texturePool) {
+        if (!pooled.inUse && pooled.desc == desc) {
+            pooled.inUse = true;
+            pooled.lastUsedFrame = m_frame;
+            return pooled.texture;
+        }
+    }
+
+    GLuint texture;
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+    glTextureStorage2D(texture, 1, desc.format, desc.size.x, desc.size.y);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    m_texturePool.push_back({ desc, texture, true, m_frame });
+    return texture;
+}
+
+void RenderGraph::releaseTexture(GLuint texture)
+{
+    for (PooledTexture& pooled : m_texturePool) {
+        if (pooled.texture == texture)
+            pooled.inUse = false;
+    }
+}
+
+void RenderGraph::forgetFramebuffersOf(GLuint texture)
+{
+    // Keys consist of 4 entries per attachment, starting with the GL name of the texture.
+    std::erase_if(m_framebuffers, [&](const auto& entry) {
+        const FramebufferKey& key = entry.first;
+        for (size_t i = 0; i < key.size(); i += 4) {
+            if (key[i] == texture) {
+                deleteFramebuffer(entry.second.framebuffer);
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+void RenderGraph::collectGarbage()
+{
+    std::erase_if(m_texturePool, [&](const PooledTexture& pooled) {
+        if (pooled.inUse || m_frame - pooled.lastUsedFrame <= texturePoolFrames)
+            return false;
+        forgetFramebuffersOf(pooled.texture);
+        deleteTexture(pooled.texture);
+        return true;
+    });
+    std::erase_if(m_framebuffers, [&](const auto& entry) {
+        if (m_frame - entry.second.lastUsedFrame <= framebufferCacheFrames)
+            return false;
+        deleteFramebuffer(entry.second.framebuffer);
+        return true;
+    });
+}
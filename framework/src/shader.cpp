@@ -1,4 +1,6 @@
 #include "shader.h"
+#include "gl_state.h"
+#include "trace.h"
 #include <framework/disable_all_warnings.h>
 DISABLE_WARNINGS_PUSH()
 #include <fmt/format.h>
@@ -8,8 +10,13 @@ DISABLE_WARNINGS_POP()
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <utility>
 
 static constexpr GLuint invalid = 0xFFFFFFFF;
+// Shared by GL_KHR_parallel_shader_compile and GL_ARB_parallel_shader_compile, which glad was generated without.
+static constexpr GLenum completionStatus = 0x91B1;
+static bool parallelShaderCompile = false;
 
 static bool checkShaderErrors(GLuint shader);
 static bool checkProgramErrors(GLuint program);
@@ -33,14 +40,18 @@ Shader::Shader(Shader&& other)
 
 Shader::~Shader()
 {
-    if (m_program != invalid)
+    if (m_program != invalid) {
+        glState().programDeleted(m_program);
         glDeleteProgram(m_program);
+    }
 }
 
 Shader& Shader::operator=(Shader&& other)
 {
-    if (m_program != invalid)
+    if (m_program != invalid) {
+        glState().programDeleted(m_program);
         glDeleteProgram(m_program);
+    }
 
     m_program = other.m_program;
     other.m_program = invalid;
@@ -50,7 +61,95 @@ Shader& Shader::operator=(Shader&& other)
 void Shader::bind() const
 {
     assert(m_program != invalid);
-    glUseProgram(m_program);
+    glState().useProgram(m_program);
+}
+
+void initParallelShaderCompile(GLADloadproc loader)
+{
+    using MaxShaderCompilerThreadsFunc = void(APIENTRYP)(GLuint count);
+
+    GLint numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for (GLint i = 0; i < numExtensions; i++) {
+        const std::string_view extension { reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i))) };
+        const char* functionName = nullptr;
+        if (extension == "GL_KHR_parallel_shader_compile")
+            functionName = "glMaxShaderCompilerThreadsKHR";
+        else if (extension == "GL_ARB_parallel_shader_compile")
+            functionName = "glMaxShaderCompilerThreadsARB";
+        else
+            continue;
+
+        if (const auto maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsFunc>(loader(functionName))) {
+            // Leave the number of threads to the driver.
+            maxShaderCompilerThreads(0xFFFFFFFF);
+            parallelShaderCompile = true;
+            return;
+        }
+    }
+}
+
+PendingShader::PendingShader(GLuint program, std::vector<GLuint> shaders, std::vector<std::filesystem::path> shaderFiles)
+    : m_program(program)
+    , m_shaders(std::move(shaders))
+    , m_shaderFiles(std::move(shaderFiles))
+{
+}
+
+PendingShader::PendingShader(PendingShader&& other)
+    : m_program(std::exchange(other.m_program, invalid))
+    , m_shaders(std::move(other.m_shaders))
+    , m_shaderFiles(std::move(other.m_shaderFiles))
+{
+    other.m_shaders.clear();
+}
+
+PendingShader::~PendingShader()
+{
+    freeResources();
+}
+
+bool PendingShader::isReady() const
+{
+    if (!parallelShaderCompile || m_program == invalid)
+        return true;
+    GLint ready;
+    glGetProgramiv(m_program, completionStatus, &ready);
+    return ready == GL_TRUE;
+}
+
+Shader PendingShader::get()
+{
+    TRACE_ZONE("PendingShader::get");
+    assert(m_program != invalid);
+    // The compile status of the stages is only queried now, so the driver could compile them in parallel.
+    for (size_t i = 0; i < m_shaders.size(); i++) {
+        if (!checkShaderErrors(m_shaders[i])) {
+            const std::filesystem::path shaderFile = m_shaderFiles[i];
+            freeResources();
+            throw ShaderLoadingException(fmt::format("Failed to compile shader {}", shaderFile.string().c_str()));
+        }
+    }
+    if (!checkProgramErrors(m_program)) {
+        freeResources();
+        throw ShaderLoadingException("Shader program failed to link");
+    }
+
+    for (GLuint shader : m_shaders)
+        glDeleteShader(shader);
+    m_shaders.clear();
+    return Shader(std::exchange(m_program, invalid));
+}
+
+void PendingShader::freeResources()
+{
+    for (GLuint shader : m_shaders)
+        glDeleteShader(shader);
+    m_shaders.clear();
+    if (m_program != invalid) {
+        glDeleteProgram(m_program);
+        m_program = invalid;
+    }
 }
 
 ShaderBuilder::~ShaderBuilder()
@@ -60,6 +159,7 @@ ShaderBuilder::~ShaderBuilder()
 
 ShaderBuilder& ShaderBuilder::addStage(GLuint shaderStage, std::filesystem::path shaderFile)
 {
+    TRACE_ZONE("ShaderBuilder::addStage");
     if (!std::filesystem::exists(shaderFile)) {
         throw ShaderLoadingException(fmt::format("File {} does not exist", shaderFile.string().c_str()));
     }
@@ -69,35 +169,37 @@ ShaderBuilder& ShaderBuilder::addStage(GLuint shaderStage, std::filesystem::path
     const char* shaderSourcePtr = shaderSource.c_str();
     glShaderSource(shader, 1, &shaderSourcePtr, nullptr);
     glCompileShader(shader);
-    if (!checkShaderErrors(shader)) {
-        glDeleteShader(shader);
-        throw ShaderLoadingException(fmt::format("Failed to compile shader {}", shaderFile.string().c_str()));
-    }
 
     m_shaders.push_back(shader);
+    m_shaderFiles.push_back(std::move(shaderFile));
     return *this;
 }
 
-Shader ShaderBuilder::build()
+PendingShader ShaderBuilder::buildAsync()
 {
+    TRACE_ZONE("ShaderBuilder::buildAsync");
     // Combine vertex and fragment shaders into a single shader program.
     GLuint program = glCreateProgram();
     for (GLuint shader : m_shaders)
         glAttachShader(program, shader);
     glLinkProgram(program);
-    freeShaders();
 
-    if (!checkProgramErrors(program)) {
-        throw ShaderLoadingException("Shader program failed to link");
-    }
+    PendingShader out { program, std::move(m_shaders), std::move(m_shaderFiles) };
+    m_shaders.clear();
+    m_shaderFiles.clear();
+    return out;
+}
 
-    return Shader(program);
+Shader ShaderBuilder::build()
+{
+    return buildAsync().get();
 }
 
 void ShaderBuilder::freeShaders()
 {
     for (GLuint shader : m_shaders)
         glDeleteShader(shader);
+    m_shaders.clear();
 }
 
 static std::string readFile(std::filesystem::path filePath)
@@ -0,0 +1,236 @@
+#include "trace.h"
+#include "json.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Events per ring buffer (about 3 MB).
+static constexpr size_t ringBufferSize = size_t(1) << 16;
+
+enum class TraceEventType : uint32_t {
+    Zone,
+    Counter
+};
+
+struct TraceEvent {
+    const char* name;
+    int64_t time; // Begin of a zone.
+    int64_t duration;
+    double value; // Of a counter.
+    uint32_t threadId;
+    TraceEventType type;
+};
+
+// Event in a ring buffer, which writeChromeTrace() may read while its thread overwrites it. The event is
+// stored in atomic words and the sequence is odd while it is written (a sequence lock), so the reader can
+// drop events that changed under it instead of reading torn ones.
+struct TraceSlot {
+    static constexpr size_t numWords = sizeof(TraceEvent) / sizeof(uint64_t);
+    static_assert(std::is_trivially_copyable_v<TraceEvent> && sizeof(TraceEvent) == numWords * sizeof(uint64_t));
+
+    std::atomic<uint64_t> sequence { 0 }; // 2 * (index + 1) once event index of the buffer is complete.
+    std::array<std::atomic<uint64_t>, numWords> words;
+};
+
+// Written by one thread at a time. A buffer is handed to a new thread when its thread exits, which
+// keeps the events of short lived threads without a buffer per thread.
+struct RingBuffer {
+    std::array<TraceSlot, ringBufferSize> slots;
+    std::atomic<uint64_t> numWritten { 0 };
+    std::atomic_bool inUse { false };
+};
+
+struct Tracer {
+    std::atomic_bool enabled { false };
+    const std::chrono::steady_clock::time_point epoch { std::chrono::steady_clock::now() };
+    std::atomic<uint32_t> nextThreadId { 1 };
+
+    std::mutex mutex; // Guards the members below.
+    std::vector<std::unique_ptr<RingBuffer>> buffers;
+    std::unordered_set<std::string> names; // Node based, so the strings never move.
+    std::vector<std::pair<uint32_t, std::string>> threadNames;
+};
+
+static Tracer& tracer()
+{
+    static Tracer instance;
+    return instance;
+}
+
+struct ThreadState {
+    uint32_t id { tracer().nextThreadId++ };
+    RingBuffer* pBuffer { nullptr };
+
+    ~ThreadState()
+    {
+        if (pBuffer)
+            pBuffer->inUse.store(false, std::memory_order_release);
+    }
+};
+static thread_local ThreadState threadState;
+
+static RingBuffer& threadBuffer()
+{
+    if (!threadState.pBuffer) {
+        Tracer& state = tracer();
+        std::scoped_lock lock { state.mutex };
+        for (const auto& pBuffer : state.buffers) {
+            bool expected = false;
+            if (pBuffer->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                threadState.pBuffer = pBuffer.get();
+                break;
+            }
+        }
+        if (!threadState.pBuffer) {
+            state.buffers.push_back(std::make_unique<RingBuffer>());
+            state.buffers.back()->inUse = true;
+            threadState.pBuffer = state.buffers.back().get();
+        }
+    }
+    return *threadState.pBuffer;
+}
+
+static void record(const TraceEvent& event)
+{
+    // Zones that were open when tracing stopped end afterwards.
+    if (!isTracing())
+        return;
+    RingBuffer& buffer = threadBuffer();
+    const uint64_t index = buffer.numWritten.load(std::memory_order_relaxed);
+    TraceSlot& slot = buffer.slots[index % ringBufferSize];
+    std::array<uint64_t, TraceSlot::numWords> words;
+    std::memcpy(words.data(), &event, sizeof(TraceEvent));
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < words.size(); i++)
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+    buffer.numWritten.store(index + 1, std::memory_order_release);
+}
+
+// Event index of the buffer, unless its slot was (or is being) overwritten by a newer event.
+static std::optional<TraceEvent> readEvent(const RingBuffer& buffer, uint64_t index)
+{
+    const TraceSlot& slot = buffer.slots[index % ringBufferSize];
+    const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * index + 2)
+        return {};
+    std::array<uint64_t, TraceSlot::numWords> words;
+    for (size_t i = 0; i < words.size(); i++)
+        words[i] = slot.words[i].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+        return {};
+    TraceEvent event;
+    std::memcpy(&event, words.data(), sizeof(TraceEvent));
+    return event;
+}
+
+void startTracing()
+{
+    tracer().enabled = true;
+}
+
+void stopTracing()
+{
+    tracer().enabled = false;
+}
+
+bool isTracing()
+{
+    return tracer().enabled.load(std::memory_order_relaxed);
+}
+
+const char* traceName(std::string_view name)
+{
+    Tracer& state = tracer();
+    std::scoped_lock lock { state.mutex };
+    return state.names.emplace(name).first->c_str();
+}
+
+void setTraceThreadName(std::string_view name)
+{
+    Tracer& state = tracer();
+    std::scoped_lock lock { state.mutex };
+    state.threadNames.emplace_back(threadState.id, std::string(name));
+}
+
+void traceZone(const char* name, int64_t beginTime)
+{
+    record({ name, beginTime, traceTime() - beginTime, 0.0, threadState.id, TraceEventType::Zone });
+}
+
+void traceCounter(const char* name, double value)
+{
+    record({ name, traceTime(), 0, value, threadState.id, TraceEventType::Counter });
+}
+
+int64_t traceTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - tracer().epoch).count();
+}
+
+void writeChromeTrace(const std::filesystem::path& filePath)
+{
+    stopTracing();
+    std::ofstream file { filePath };
+    if (!file) {
+        std::cerr << "Could not open " << filePath << " for writing" << std::endl;
+        throw std::exception();
+    }
+
+    Tracer& state = tracer();
+    std::scoped_lock lock { state.mutex };
+    // Timestamps are in microseconds.
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool firstEvent = true;
+    auto beginEvent = [&]() {
+        file << (firstEvent ? "" : ",\n");
+        firstEvent = false;
+    };
+    for (const auto& [threadId, name] : state.threadNames) {
+        beginEvent();
+        file << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << threadId << ",\"args\":{\"name\":";
+        writeJsonString(file, name);
+        file << "}}";
+    }
+    for (const auto& pBuffer : state.buffers) {
+        // Threads that are still in a zone may keep writing. Events after the snapshot are left out and
+        // older ones that they overwrite are skipped.
+        const uint64_t numWritten = pBuffer->numWritten.load(std::memory_order_acquire);
+        for (uint64_t i = numWritten > ringBufferSize ? numWritten - ringBufferSize : 0; i < numWritten; i++) {
+            const std::optional<TraceEvent> recorded = readEvent(*pBuffer, i);
+            if (!recorded)
+                continue;
+            const TraceEvent& event = *recorded;
+            beginEvent();
+            file << "{\"name\":";
+            writeJsonString(file, event.name);
+            file << ",\"pid\":1,\"tid\":" << event.threadId << ",\"ts\":" << static_cast<double>(event.time) * 1e-3;
+            if (event.type == TraceEventType::Zone)
+                file << ",\"ph\":\"X\",\"dur\":" << static_cast<double>(event.duration) * 1e-3 << "}";
+            else
+                file << ",\"ph\":\"C\",\"args\":{\"value\":" << event.value << "}}";
+        }
+    }
+    file << "\n]}\n";
+
+    if (!file) {
+        std::cerr << "Failed to write " << filePath << std::endl;
+        throw std::exception();
+    }
+}
@@ -55,6 +55,11 @@ void Trackball::disableTranslation()
 	m_canTranslate = false;
 }
 
+void Trackball::setRotationEnabled(bool enabled)
+{
+	m_canRotate = enabled;
+}
+
 void Trackball::setCamera(const glm::vec3 lookAt, const glm::vec3 rotations, const float dist)
 {
 	m_lookAt = lookAt;
@@ -123,7 +128,7 @@ void Trackball::mouseButtonCallback(int button, int action, int /* mods */)
 
 void Trackball::mouseMoveCallback(const glm::vec2& pos)
 {
-	const bool rotateXY = m_pWindow->isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT);
+	const bool rotateXY = m_canRotate && m_pWindow->isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT);
 	const bool translateXY = m_canTranslate && m_pWindow->isMouseButtonPressed(GLFW_MOUSE_BUTTON_RIGHT);
 
 	if (rotateXY || translateXY) {
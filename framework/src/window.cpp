@@ -1,10 +1,17 @@
 #include "window.h"
+#include "headless_context.h"
+#include "shader.h"
+#include "trace.h"
 #include <imgui/imgui_impl_glfw.h>
 #include <imgui/imgui_impl_opengl2.h>
 #include <imgui/imgui.h>
 #undef IMGUI_IMPL_OPENGL_LOADER_GLEW
 #define IMGUI_IMPL_OPENGL_LOADER_GLAD 1
 #include <imgui/imgui_impl_opengl3.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+DISABLE_WARNINGS_POP()
+#include <cassert>
 #include <iostream>
 
 static void glfwErrorCallback(int error, const char* description)
@@ -24,9 +31,21 @@ void APIENTRY glDebugCallback(GLenum source, GLenum type, GLuint id, GLenum seve
 }
 #endif
 
-Window::Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersion glVersion)
+Window::Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersion glVersion, WindowMode mode)
     : m_glVersion(glVersion)
 {
+    TRACE_ZONE("Window::Window");
+    if (mode == WindowMode::Headless) {
+        // No GLFW (which needs a display) and no ImGui. Input callbacks only fire for replayed events.
+        assert(glVersion != OpenGLVersion::GL2);
+        m_windowSize = windowSize;
+        if (glVersion == OpenGLVersion::GL3)
+            m_pHeadlessContext = std::make_unique<HeadlessContext>(windowSize, 3, 3);
+        else
+            m_pHeadlessContext = std::make_unique<HeadlessContext>(windowSize, 4, 5);
+        return;
+    }
+
     glfwSetErrorCallback(glfwErrorCallback);
     if (!glfwInit()) {
         std::cerr << "Could not initialize GLFW" << std::endl;
@@ -73,7 +92,7 @@ Window::Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersi
         exit(1);
     }
     glfwMakeContextCurrent(m_pWindow);
-    glfwSwapInterval(1); // Enable vsync. To disable vsync set this to 0.
+    setVSync(true);
 
     float xScale, yScale;
     glfwGetWindowContentScale(m_pWindow, &xScale, &yScale);
@@ -86,6 +105,7 @@ Window::Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersi
         std::cerr << "Could not initialize GLEW" << std::endl;
         exit(1);
     }
+    initParallelShaderCompile(reinterpret_cast<GLADloadproc>(glfwGetProcAddress));
     int glVersionMajor, glVersionMinor;
     glGetIntegerv(GL_MAJOR_VERSION, &glVersionMajor);
     glGetIntegerv(GL_MINOR_VERSION, &glVersionMinor);
@@ -141,10 +161,14 @@ Window::Window(std::string_view title, const glm::ivec2& windowSize, OpenGLVersi
     glfwSetCursorPosCallback(m_pWindow, mouseMoveCallback);
     glfwSetScrollCallback(m_pWindow, scrollCallback);
     glfwSetWindowSizeCallback(m_pWindow, windowSizeCallback);
+    glfwSetWindowRefreshCallback(m_pWindow, windowRefreshCallback);
 }
 
 Window::~Window()
 {
+    if (m_pHeadlessContext)
+        return;
+
     switch (m_glVersion) {
     case OpenGLVersion::GL2: {
         ImGui_ImplOpenGL2_Shutdown();
@@ -163,17 +187,62 @@ Window::~Window()
 
 void Window::close()
 {
-    glfwSetWindowShouldClose(m_pWindow, 1);
+    if (m_pHeadlessContext)
+        m_shouldClose = true;
+    else
+        glfwSetWindowShouldClose(m_pWindow, 1);
 }
 
 bool Window::shouldClose()
 {
+    if (m_pHeadlessContext)
+        return m_shouldClose;
     return glfwWindowShouldClose(m_pWindow) != 0;
 }
 
 void Window::updateInput()
 {
+    processInput(m_redrawMode == RedrawMode::OnDemand);
+}
+
+void Window::waitForInput()
+{
+    processInput(true);
+}
+
+void Window::processInput(bool waitForEvents)
+{
+    // One recorded frame per call, in the same order as the events of the recording reached the callbacks.
+    auto dispatchReplayedFrame = [&]() {
+        if (!m_replaying)
+            return;
+        for (; m_nextReplayEvent < m_replayEvents.size() && m_replayEvents[m_nextReplayEvent].frame <= m_replayFrame; m_nextReplayEvent++)
+            dispatchReplayedEvent(m_replayEvents[m_nextReplayEvent]);
+        m_replayFrame++;
+        m_replaying = m_nextReplayEvent < m_replayEvents.size();
+    };
+
+    // Nothing can happen to a headless window, so it always draws the next frame.
+    if (m_pHeadlessContext) {
+        m_dirty = false;
+        dispatchReplayedFrame();
+        m_frame++;
+        return;
+    }
+
+    if (waitForEvents) {
+        // Every callback marks the window as dirty, events that do not cause a callback are ignored.
+        // A replay draws a frame for every recorded frame.
+        while (!m_dirty && !m_replaying && !shouldClose())
+            glfwWaitEvents();
+        // Anything that happens from here on (including during rendering) schedules the next frame.
+        m_dirty = false;
+    }
     glfwPollEvents();
+    dispatchReplayedFrame();
+    m_frame++;
+    if (!m_imGuiEnabled)
+        return;
 
     // Start the Dear ImGui frame.
     switch (m_glVersion) {
@@ -191,19 +260,181 @@ void Window::updateInput()
 
 void Window::swapBuffers()
 {
+    if (m_pHeadlessContext) {
+        glFlush();
+        return;
+    }
+
     // Rendering of Dear ImGui ui.
-    ImGui::Render();
-    switch (m_glVersion) {
-    case OpenGLVersion::GL2: {
-        ImGui_ImplOpenGL2_RenderDrawData(ImGui::GetDrawData());
+    if (m_imGuiEnabled) {
+        ImGui::Render();
+        switch (m_glVersion) {
+        case OpenGLVersion::GL2: {
+            ImGui_ImplOpenGL2_RenderDrawData(ImGui::GetDrawData());
+        } break;
+        case OpenGLVersion::GL3:
+        case OpenGLVersion::GL45: {
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        } break;
+        };
+    }
+
+    glfwSwapBuffers(m_pWindow);
+}
+
+void Window::makeContextCurrent()
+{
+    if (m_pHeadlessContext)
+        m_pHeadlessContext->makeCurrent();
+    else
+        glfwMakeContextCurrent(m_pWindow);
+    if (std::this_thread::get_id() == m_mainThread)
+        m_imGuiEnabled = true;
+}
+
+void Window::releaseContext()
+{
+    if (std::this_thread::get_id() == m_mainThread)
+        m_imGuiEnabled = false;
+    if (m_pHeadlessContext)
+        m_pHeadlessContext->release();
+    else
+        glfwMakeContextCurrent(nullptr);
+}
+
+void Window::setRedrawMode(RedrawMode mode)
+{
+    m_redrawMode = mode;
+    requestRedraw();
+}
+
+void Window::setVSync(bool enabled)
+{
+    // A headless context presents nothing, so it never waits for the display.
+    if (m_pWindow)
+        glfwSwapInterval(enabled ? 1 : 0);
+}
+
+RedrawMode Window::getRedrawMode() const
+{
+    return m_redrawMode;
+}
+
+void Window::requestRedraw()
+{
+    m_dirty = true;
+    // Wakes up glfwWaitEvents() (thread safe).
+    if (!m_pHeadlessContext)
+        glfwPostEmptyEvent();
+}
+
+void Window::markDirty(GLFWwindow* window)
+{
+    static_cast<Window*>(glfwGetWindowUserPointer(window))->m_dirty = true;
+}
+
+void Window::startRecording()
+{
+    m_recording = true;
+    m_recordingStartFrame = m_frame;
+    m_recordingStartTime = std::chrono::steady_clock::now();
+    m_recordedEvents.clear();
+}
+
+std::vector<InputEvent> Window::stopRecording()
+{
+    m_recording = false;
+    return std::move(m_recordedEvents);
+}
+
+void Window::replay(std::vector<InputEvent>&& events)
+{
+    m_replayEvents = std::move(events);
+    m_nextReplayEvent = 0;
+    m_replayFrame = 0;
+    m_replaying = !m_replayEvents.empty();
+    m_replayedKeys.fill(false);
+    m_replayedMouseButtons.fill(false);
+    requestRedraw();
+}
+
+bool Window::isReplaying() const
+{
+    return m_replaying;
+}
+
+void Window::dispatchLiveEvent(InputEvent event)
+{
+    // The replay replaces the real input.
+    if (m_replaying)
+        return;
+
+    if (m_recording) {
+        // Events that arrive while rendering belong to the next frame.
+        event.frame = m_frame - m_recordingStartFrame;
+        event.time = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_recordingStartTime).count();
+        m_recordedEvents.push_back(event);
+    }
+    invokeCallbacks(event);
+}
+
+void Window::dispatchReplayedEvent(const InputEvent& event)
+{
+    switch (event.type) {
+    case InputEventType::Key: {
+        if (event.key >= 0 && event.key <= GLFW_KEY_LAST)
+            m_replayedKeys[static_cast<size_t>(event.key)] = event.action != GLFW_RELEASE;
     } break;
-    case OpenGLVersion::GL3:
-    case OpenGLVersion::GL45: {
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    case InputEventType::MouseButton: {
+        if (event.button >= 0 && event.button <= GLFW_MOUSE_BUTTON_LAST)
+            m_replayedMouseButtons[static_cast<size_t>(event.button)] = event.action != GLFW_RELEASE;
     } break;
+    case InputEventType::MouseMove: {
+        m_replayedCursorPos = event.position;
+    } break;
+    case InputEventType::WindowResize: {
+        const glm::ivec2 size { event.position };
+        if (m_pHeadlessContext)
+            m_pHeadlessContext->resize(glm::max(size, glm::ivec2(1)));
+        else
+            glfwSetWindowSize(m_pWindow, size.x, size.y);
+    } break;
+    default:
+        break;
     };
+    invokeCallbacks(event);
+}
 
-    glfwSwapBuffers(m_pWindow);
+void Window::invokeCallbacks(const InputEvent& event)
+{
+    m_dirty = true;
+    switch (event.type) {
+    case InputEventType::Key: {
+        for (const auto& callback : m_keyCallbacks)
+            callback(event.key, event.scancode, event.action, event.mods);
+    } break;
+    case InputEventType::Char: {
+        for (const auto& callback : m_charCallbacks)
+            callback(event.codePoint);
+    } break;
+    case InputEventType::MouseButton: {
+        for (const auto& callback : m_mouseButtonCallbacks)
+            callback(event.button, event.action, event.mods);
+    } break;
+    case InputEventType::MouseMove: {
+        for (const auto& callback : m_mouseMoveCallbacks)
+            callback(event.position);
+    } break;
+    case InputEventType::Scroll: {
+        for (const auto& callback : m_scrollCallbacks)
+            callback(event.position);
+    } break;
+    case InputEventType::WindowResize: {
+        m_windowSize = glm::ivec2(event.position);
+        for (const auto& callback : m_windowResizeCallbacks)
+            callback(m_windowSize);
+    } break;
+    };
 }
 
 void Window::registerKeyCallback(KeyCallback&& callback)
@@ -238,19 +469,19 @@ void Window::registerMouseMoveCallback(MouseMoveCallback&& callback)
 
 void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+    markDirty(window);
     ImGui_ImplGlfw_KeyCallback(window, key, scancode, action, mods);
 
     // Ignore callbacks when the user is interacting with imgui.
     if (ImGui::GetIO().WantCaptureKeyboard)
         return;
 
-    const Window* pThisWindow = static_cast<const Window*>(glfwGetWindowUserPointer(window));
-    for (auto& callback : pThisWindow->m_keyCallbacks)
-        callback(key, scancode, action, mods);
+    static_cast<Window*>(glfwGetWindowUserPointer(window))->dispatchLiveEvent({ .type = InputEventType::Key, .key = key, .scancode = scancode, .action = action, .mods = mods });
 }
 
 void Window::charCallback(GLFWwindow* window, unsigned unicodeCodePoint)
 {
+    markDirty(window);
     ImGui_ImplGlfw_CharCallback(window, unicodeCodePoint);
 
     // Ignore callbacks when the user is interacting with imgui.
@@ -258,65 +489,72 @@ void Window::charCallback(GLFWwindow* window, unsigned unicodeCodePoint)
         return;
     }
     
-    const Window* pThisWindow = static_cast<const Window*>(glfwGetWindowUserPointer(window));
-    for (auto& callback : pThisWindow->m_charCallbacks)
-        callback(unicodeCodePoint);
+    static_cast<Window*>(glfwGetWindowUserPointer(window))->dispatchLiveEvent({ .type = InputEventType::Char, .codePoint = unicodeCodePoint });
 }
 
 void Window::mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
+    markDirty(window);
+
     // Ignore callbacks when the user is interacting with imgui.
     if (ImGui::GetIO().WantCaptureMouse)
         return;
 
-    const Window* pThisWindow = static_cast<const Window*>(glfwGetWindowUserPointer(window));
-    for (auto& callback : pThisWindow->m_mouseButtonCallbacks)
-        callback(button, action, mods);
+    static_cast<Window*>(glfwGetWindowUserPointer(window))->dispatchLiveEvent({ .type = InputEventType::MouseButton, .action = action, .mods = mods, .button = button });
 }
 
 void Window::mouseMoveCallback(GLFWwindow* window, double xpos, double ypos)
 {
+    markDirty(window);
+
     // Ignore callbacks when the user is interacting with imgui.
     if (ImGui::GetIO().WantCaptureMouse)
         return;
 
-    const Window* pThisWindow = static_cast<const Window*>(glfwGetWindowUserPointer(window));
-    for (auto& callback : pThisWindow->m_mouseMoveCallbacks)
-        callback(glm::vec2(xpos, pThisWindow->m_windowSize.y - 1 - ypos));
+    Window* pThisWindow = static_cast<Window*>(glfwGetWindowUserPointer(window));
+    pThisWindow->dispatchLiveEvent({ .type = InputEventType::MouseMove, .position = glm::vec2(xpos, pThisWindow->m_windowSize.y - 1 - ypos) });
 }
 
 void Window::scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
+    markDirty(window);
+
     // Ignore callbacks when the user is interacting with imgui.
     if (ImGui::GetIO().WantCaptureMouse)
         return;
 
-    const Window* pThisWindow = static_cast<const Window*>(glfwGetWindowUserPointer(window));
-    for (auto& callback : pThisWindow->m_scrollCallbacks)
-        callback(glm::vec2(xoffset, yoffset));
+    static_cast<Window*>(glfwGetWindowUserPointer(window))->dispatchLiveEvent({ .type = InputEventType::Scroll, .position = glm::vec2(xoffset, yoffset) });
 }
 
 void Window::windowSizeCallback(GLFWwindow* window, int width, int height)
 {
-    Window* pThisWindow = static_cast<Window*>(glfwGetWindowUserPointer(window));
-    pThisWindow->m_windowSize = glm::ivec2 { width, height };
+    static_cast<Window*>(glfwGetWindowUserPointer(window))->dispatchLiveEvent({ .type = InputEventType::WindowResize, .position = glm::vec2(width, height) });
+}
 
-    for (const auto& callback : pThisWindow->m_windowResizeCallbacks)
-        callback(glm::ivec2(width, height));
+// The contents of the window were damaged (e.g. uncovered) and have to be drawn again.
+void Window::windowRefreshCallback(GLFWwindow* window)
+{
+    markDirty(window);
 }
 
 bool Window::isKeyPressed(int key) const
 {
+    if (m_pHeadlessContext || m_replaying)
+        return key >= 0 && key <= GLFW_KEY_LAST && m_replayedKeys[static_cast<size_t>(key)];
     return glfwGetKey(m_pWindow, key) == GLFW_PRESS;
 }
 
 bool Window::isMouseButtonPressed(int button) const
 {
+    if (m_pHeadlessContext || m_replaying)
+        return button >= 0 && button <= GLFW_MOUSE_BUTTON_LAST && m_replayedMouseButtons[static_cast<size_t>(button)];
     return glfwGetMouseButton(m_pWindow, button) == GLFW_PRESS;
 }
 
 glm::vec2 Window::getCursorPos() const
 {
+    if (m_pHeadlessContext || m_replaying)
+        return m_replayedCursorPos;
     double x, y;
     glfwGetCursorPos(m_pWindow, &x, &y);
     return glm::vec2(x, m_windowSize.y - 1 - y);
@@ -329,6 +567,9 @@ glm::vec2 Window::getNormalizedCursorPos() const
 
 glm::vec2 Window::getCursorPixel() const
 {
+    if (m_pHeadlessContext)
+        return getCursorPos() + glm::vec2(0.5f);
+
     // https://stackoverflow.com/questions/45796287/screen-coordinates-to-world-coordinates
     // Coordinates returned by glfwGetCursorPos are in screen coordinates which may not map 1:1 to
     // pixel coordinates on some machines (e.g. with resolution scaling).
@@ -348,6 +589,8 @@ glm::vec2 Window::getCursorPixel() const
 
 void Window::setMouseCapture(bool capture)
 {
+    if (m_pHeadlessContext)
+        return;
     if (capture) {
         glfwSetInputMode(m_pWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     } else {
@@ -364,6 +607,8 @@ glm::ivec2 Window::getWindowSize() const
 
 glm::ivec2 Window::getFrameBufferSize() const
 {
+    if (m_pHeadlessContext)
+        return m_windowSize;
     glm::ivec2 out{};
     glfwGetFramebufferSize(m_pWindow, &out.x, &out.y);
     return out;
@@ -380,3 +625,13 @@ float Window::getDpiScalingFactor() const
 {
     return m_dpiScalingFactor;
 }
+
+bool Window::isHeadless() const
+{
+    return m_pHeadlessContext != nullptr;
+}
+
+GLuint Window::defaultFramebuffer() const
+{
+    return m_pHeadlessContext ? m_pHeadlessContext->framebuffer() : 0;
+}
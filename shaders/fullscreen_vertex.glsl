@@ -0,0 +1,11 @@
+#version 430
+
+// Single triangle that covers the whole viewport, generated from gl_VertexID (draw 3 vertices without
+// any vertex attributes bound). The texture coordinates are [0, 1] over the viewport.
+out vec2 texCoord;
+
+void main() {
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    texCoord = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
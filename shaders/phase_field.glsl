@@ -3,8 +3,26 @@
 
 // Global variables for lighting calculations
 //layout(location = 1) uniform vec3 viewPos;
-layout (location = 13) uniform float _b;
-layout (location = 14) uniform int _impPerKernel;
+layout (location = 13) uniform float u_b;
+layout (location = 14) uniform int u_impPerKernel;
+layout (location = 15) uniform int u_period;
+
+// Contact sheet (swatch_vertex.glsl): instance i renders the phase field of tile i of the atlas.
+struct PhaseFieldTile {
+    float b;
+    int impPerKernel;
+    int period;
+};
+layout (std430, binding = 1) readonly buffer PhaseFieldTiles {
+    PhaseFieldTile phaseFieldTiles[];
+};
+layout (location = 45) uniform bool contactSheet;
+flat in int swatchIndex;
+
+// Parameters of the phase field: the uniforms, or those of the tile in the contact sheet (see main).
+float _b = u_b;
+int _impPerKernel = u_impPerKernel;
+int _period = u_period;
 
 // Output for on-screen color
 layout(location = 0) out vec4 outColor;
@@ -15,6 +33,33 @@ in vec3 fragPos; // World-space position
 in vec3 fragNormal; // World-space normal
 
 vec2 fragCoord = fragPos.xy;
+vec3 faceNormal = fragNormal;
+
+// Full screen path of the 2D noise views (screen_vertex.glsl): instead of rasterizing the mesh, every
+// pixel intersects its view ray with the faces of the square (|x|, |y| <= 1 at z = +-0.1) and shows the
+// first one that it hits.
+layout (location = 44) uniform bool screenMapped;
+noperspective in vec4 rayNear;
+noperspective in vec4 rayFar;
+
+bool screen_mapped_surface(out vec3 position, out vec3 normal)
+{
+    vec3 near = rayNear.xyz / rayNear.w;
+    vec3 dir = rayFar.xyz / rayFar.w - near;
+    float closest = 1.0; // Fraction of the segment between the near and far plane.
+    bool hit = false;
+    for (int side = -1; side <= 1; side += 2) {
+        float t = (0.1 * float(side) - near.z) / dir.z;
+        vec3 p = near + t * dir;
+        if (t >= 0.0 && t <= closest && abs(p.x) <= 1.0 && abs(p.y) <= 1.0) {
+            closest = t;
+            position = p;
+            normal = vec3(0.0, 0.0, float(side));
+            hit = true;
+        }
+    }
+    return hit;
+}
 
 //phasor noise parameters
 //float _b = 2.0;
@@ -53,6 +98,14 @@ int morton(int x, int y)
 
 
 
+// When _period > 0 the cell indices wrap around so that the noise tiles every _period cells.
+ivec2 wrap_cell(ivec2 ij)
+{
+	if (_period <= 0)
+		return ij;
+	return ij - _period * ivec2(floor(vec2(ij) / float(_period)));
+}
+
 void init_noise()
 {
     _kr = sqrt(-log(0.05) / M_PI) / _b;
@@ -61,7 +114,8 @@ void init_noise()
 
 vec2 cell(ivec2 ij, vec2 uv, float b)
 {
-	int s= morton(ij.x,ij.y) + 333;
+	ivec2 wij = wrap_cell(ij);
+	int s= morton(wij.x,wij.y) + 333;
 	s = s==0? 1: s +_seed;
 	seed(s);
 	int impulse  =0;
@@ -97,6 +151,19 @@ vec2 eval_noise(vec2 uv, float b)
 
 void main()
 {
+  if (contactSheet) {
+    PhaseFieldTile tile = phaseFieldTiles[swatchIndex];
+    _b = tile.b;
+    _impPerKernel = tile.impPerKernel;
+    _period = tile.period;
+  }
+  if (screenMapped) {
+    vec3 position, normal;
+    if (!screen_mapped_surface(position, normal))
+      discard;
+    fragCoord = position.xy;
+    faceNormal = normal;
+  }
   uv = fragCoord;
   uv.y=-uv.y;
   init_noise();
@@ -104,5 +171,8 @@ void main()
   vec2 gaussian_field = vec2(eval_noise(uv,_b));
   //gaussian_field = normalize(gaussian_field);
   float angle = atan(gaussian_field.y,gaussian_field.x)/2.0/M_PI;
-  outColor = vec4(vec3(angle,angle, angle), max(0, -fragNormal.z));
+  outColor = vec4(vec3(angle,angle, angle), max(0, -faceNormal.z));
+  // The mesh path blends with the alpha on top of black, the full screen path does not blend.
+  if (screenMapped)
+    outColor.rgb *= outColor.a;
 }
\ No newline at end of file
@@ -5,13 +5,60 @@
 //layout(location = 1) uniform vec3 viewPos;
 layout (location = 2) uniform sampler2D phaseField;
 layout (location = 3) uniform sampler2D dogImage;
-layout (location = 12) uniform float _f;
-layout (location = 13) uniform float _b;
-layout (location = 14) uniform int _impPerKernel;
-layout (location = 31) uniform bool first;
-layout (location = 32) uniform bool second;
-layout (location = 33) uniform bool third;
-layout (location = 34) uniform bool fourth;
+layout (location = 12) uniform float u_f;
+layout (location = 13) uniform float u_b;
+layout (location = 14) uniform int u_impPerKernel;
+layout (location = 15) uniform int u_period;
+layout (location = 31) uniform bool u_first;
+layout (location = 32) uniform bool u_second;
+layout (location = 33) uniform bool u_third;
+layout (location = 34) uniform bool u_fourth;
+layout (location = 35) uniform bool fusedPhaseField;
+layout (location = 36) uniform bool bicubicPhaseField;
+layout (location = 37) uniform bool imageGuidedPhaseField;
+// Progressive refinement: only impulses [_impulseBegin, _impulseEnd) of every cell are evaluated, the
+// accumulate pass outputs the complex noise and the resolve pass reads it back from accumulatedNoise.
+layout (location = 38) uniform int _impulseBegin;
+layout (location = 39) uniform int _impulseEnd;
+layout (location = 40) uniform bool accumulateNoise;
+layout (location = 41) uniform bool resolveNoise;
+layout (location = 42) uniform sampler2D accumulatedNoise;
+layout (location = 43) uniform vec2 _viewportSize;
+// Outputs the normal map of the bump of the sine profile instead of the profiles, from the analytic
+// derivatives of the noise (see phasor()). _bumpSlope is the steepest slope of the bump.
+layout (location = 52) uniform bool normalMap;
+layout (location = 53) uniform float _bumpSlope;
+// Period of the image orientation in turns (PhaseField::period, 0.5 for the axial edge tangents).
+layout (location = 54) uniform float _imageOrientationPeriod;
+
+// Contact sheet (swatch_vertex.glsl): instance i renders swatch i with its own parameters. The phase
+// fields of the swatches are stored side by side in an atlas of _phaseFieldTiles tiles.
+struct Swatch {
+    float f;
+    float b;
+    int impPerKernel;
+    int profiles; // Bit i enables profile i.
+    int period;
+    int phaseFieldTile;
+};
+layout (std430, binding = 0) readonly buffer Swatches {
+    Swatch swatches[];
+};
+layout (location = 45) uniform bool contactSheet;
+layout (location = 51) uniform int _phaseFieldTiles;
+flat in int swatchIndex;
+
+// Parameters of the noise: the uniforms, or those of the swatch in the contact sheet (see main).
+float _f = u_f;
+float _b = u_b;
+int _impPerKernel = u_impPerKernel;
+int _period = u_period;
+bool first = u_first;
+bool second = u_second;
+bool third = u_third;
+bool fourth = u_fourth;
+int phaseFieldTile = 0;
+int numPhaseFieldTiles = 1;
 
 // Output for on-screen color
 layout(location = 0) out vec4 outColor;
@@ -21,6 +68,33 @@ in vec3 fragPos; // World-space position
 in vec3 fragNormal; // World-space normal
 
 vec2 fragCoord = fragPos.xy;
+vec3 surfaceNormal = fragNormal;
+
+// Full screen path of the 2D noise views (screen_vertex.glsl): instead of rasterizing the mesh, every
+// pixel intersects its view ray with the faces of the square (|x|, |y| <= 1 at z = +-0.1) and shows the
+// first one that it hits.
+layout (location = 44) uniform bool screenMapped;
+noperspective in vec4 rayNear;
+noperspective in vec4 rayFar;
+
+bool screen_mapped_surface(out vec3 position, out vec3 normal)
+{
+    vec3 near = rayNear.xyz / rayNear.w;
+    vec3 dir = rayFar.xyz / rayFar.w - near;
+    float closest = 1.0; // Fraction of the segment between the near and far plane.
+    bool hit = false;
+    for (int side = -1; side <= 1; side += 2) {
+        float t = (0.1 * float(side) - near.z) / dir.z;
+        vec3 p = near + t * dir;
+        if (t >= 0.0 && t <= closest && abs(p.x) <= 1.0 && abs(p.y) <= 1.0) {
+            closest = t;
+            position = p;
+            normal = vec3(0.0, 0.0, float(side));
+            hit = true;
+        }
+    }
+    return hit;
+}
 
 //phasor noise parameters
 //float _f = 40.0;
@@ -29,6 +103,7 @@ vec2 fragCoord = fragPos.xy;
 float _kr;
 //int _impPerKernel = 16;
 int _seed = 1;
+int _fieldSeed = 6; // Seed used by phase_field.glsl.
 
 vec2 uv;
 
@@ -56,13 +131,139 @@ int morton(int x, int y)
 
 
 
-vec2 phasor(vec2 x, float f, float b, float o, float phi)
+// When _period > 0 the cell indices wrap around so that the noise tiles every _period cells.
+ivec2 wrap_cell(ivec2 ij)
+{
+	if (_period <= 0)
+		return ij;
+	return ij - _period * ivec2(floor(vec2(ij) / float(_period)));
+}
+
+int cell_seed(ivec2 ij, int s)
+{
+	ij = wrap_cell(ij);
+	int h = morton(ij.x, ij.y) + 333;
+	return h == 0 ? 1 : h + s;
+}
+
+///////////////////////////////////////////////
+//fused phase field
+///////////////////////////////////////////////
+
+// Instead of sampling the phase field texture at every impulse centre, the fused mode evaluates
+// the phase field of phase_field.glsl in this shader, once per noise cell at the centre of the cell,
+// and the impulses of the cell share that orientation. Field cells coincide with noise cells. Field
+// impulses further than a cell (2 _kr, where the gaussian is below 1e-5) from the centre are skipped,
+// and so are the diagonal field cells, which are at least 0.71 cells away (gaussian below 3e-3).
+// The seeds of the field cells are memoized, since cell_seed() is the expensive part.
+int fieldSeeds[49]; // PRNG seeds of the 7x7 field cells -3..3 around ij.
+
+void init_fused_field(ivec2 ij)
+{
+	for (int j = 0; j < 7; j++) {
+		for (int i = 0; i < 7; i++)
+			fieldSeeds[j * 7 + i] = cell_seed(ij + ivec2(i - 3, j - 3), _fieldSeed);
+	}
+}
+
+float fused_orientation(ivec2 nij, float b)
+{
+	const ivec2 fieldCells[5] = ivec2[5](ivec2(0, 0), ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
+	float cellsz = 2.0 * _kr;
+	vec2 field = vec2(0.0);
+	for (int k = 0; k < 5; k++) {
+		ivec2 c = nij + fieldCells[k];
+		seed(fieldSeeds[(c.y + 3) * 7 + c.x + 3]);
+		for (int impulse = 0; impulse <= _impPerKernel; impulse++) {
+			// Centre of the noise cell relative to the field impulse, in cells.
+			vec2 d = vec2(0.5) - vec2(fieldCells[k]) - vec2(uni_0_1(), uni_0_1());
+			float omega = uni(-2.4, 2.4);
+			if (dot(d, d) < 1.0)
+				field += exp(-M_PI * (b * b) * dot(d, d) * (cellsz * cellsz)) * vec2(cos(omega), sin(omega));
+		}
+	}
+	return atan(field.y, field.x);
+}
+
+///////////////////////////////////////////////
+//phase field upsampling
+///////////////////////////////////////////////
+
+vec4 bspline_weights(float t)
+{
+	float t2 = t * t;
+	float t3 = t2 * t;
+	float s = 1.0 - t;
+	return vec4(s * s * s, 3.0 * t3 - 6.0 * t2 + 4.0, -3.0 * t3 + 3.0 * t2 + 3.0 * t + 1.0, t3) / 6.0;
+}
+
+// The phase field is rendered at a reduced resolution. The bicubic path reconstructs it with a
+// cubic B-spline (same as PhaseField::sampleBicubic on the CPU). Texels are unwrapped by the period
+// of the orientations (1 turn for the phase field pass, 0.5 for the axial image orientation) relative
+// to the nearest texel so that the filter does not blend across the discontinuity. This rules out
+// the usual 4-tap bilinear trick, and hardware filtering in the bilinear path as well.
+// Samples tile `tile` of an atlas of numTiles phase fields side by side (a single tile outside of the
+// contact sheet), clamped to the edges of the tile or repeating it.
+ivec2 phase_field_texel(ivec2 texel, ivec2 size, bool repeat)
+{
+	if (repeat)
+		return texel - size * ivec2(floor(vec2(texel) / vec2(size)));
+	return clamp(texel, ivec2(0), size - 1);
+}
+
+float sample_phase_field(sampler2D field, vec2 uv, int tile, int numTiles, float period, bool repeat)
+{
+	ivec2 atlasSize = textureSize(field, 0);
+	ivec2 size = ivec2(atlasSize.x / numTiles, atlasSize.y);
+	ivec2 origin = ivec2(tile * size.x, 0);
+	vec2 st = uv * vec2(size) - 0.5;
+	vec2 t = fract(st);
+	ivec2 base = ivec2(floor(st));
+	ivec2 nearest = phase_field_texel(base + ivec2(step(0.5, t)), size, repeat);
+	float reference = texelFetch(field, origin + nearest, 0).x;
+
+	if (!bicubicPhaseField) {
+		float result = 0.0;
+		for (int j = 0; j < 2; j++) {
+			for (int i = 0; i < 2; i++) {
+				float value = texelFetch(field, origin + phase_field_texel(base + ivec2(i, j), size, repeat), 0).x;
+				value -= period * round((value - reference) / period);
+				result += (i == 0 ? 1.0 - t.x : t.x) * (j == 0 ? 1.0 - t.y : t.y) * value;
+			}
+		}
+		return result;
+	}
+
+	vec4 wx = bspline_weights(t.x);
+	vec4 wy = bspline_weights(t.y);
+	float result = 0.0;
+	for (int j = 0; j < 4; j++) {
+		for (int i = 0; i < 4; i++) {
+			float value = texelFetch(field, origin + phase_field_texel(base + ivec2(i - 1, j - 1), size, repeat), 0).x;
+			value -= period * round((value - reference) / period);
+			result += wx[i] * wy[j] * value;
+		}
+	}
+	return result;
+}
+
+// For the normal map the derivatives of the kernel with respect to x.x and x.y are added to dNoise.xy and
+// dNoise.zw. Differentiating the gaussian gives -2 pi b^2 x and differentiating the phase gives
+// i 2 pi f (cos o, sin o), so they cost a few multiplications instead of two more evaluations.
+vec2 phasor(vec2 x, float f, float b, float o, float phi, inout vec4 dNoise)
 {
     
     float a = exp(-M_PI * (b * b) * ((x.x * x.x) + (x.y * x.y)));
     float s = sin (2.0* M_PI * f  * (x.x*cos(o) + x.y*sin(o))+phi);
     float c = cos (2.0* M_PI * f  * (x.x*cos(o) + x.y*sin(o))+phi);
-    return vec2(a*c,a*s);
+    vec2 kernel = vec2(a*c,a*s);
+    if (normalMap) {
+        vec2 gaussian = -2.0 * M_PI * (b * b) * x;
+        vec2 frequency = 2.0 * M_PI * f * vec2(cos(o), sin(o));
+        vec2 iKernel = vec2(-kernel.y, kernel.x);
+        dNoise += vec4(gaussian.x * kernel + frequency.x * iKernel, gaussian.y * kernel + frequency.y * iKernel);
+    }
+    return kernel;
 }
 
 
@@ -73,11 +274,10 @@ void init_noise()
 }
 
 
-vec2 cell(ivec2 ij, vec2 uv, float f, float b)
+vec2 cell(ivec2 ij, ivec2 nij, vec2 uv, float f, float b, inout vec4 dNoise)
 {
-	int s= morton(ij.x,ij.y) + 333;
-	s = s==0? 1: s +_seed;
-	seed(s);
+	float fusedOrientation = fusedPhaseField ? fused_orientation(nij, b) : 0.0;
+	seed(cell_seed(ij, _seed));
 	int impulse  =0;
 	int nImpulse = _impPerKernel;
 	float  cellsz = 2.0 * _kr;
@@ -86,26 +286,50 @@ vec2 cell(ivec2 ij, vec2 uv, float f, float b)
 		vec2 impulse_centre = vec2(uni_0_1(),uni_0_1());
 		vec2 d = (uv - impulse_centre) *cellsz;
 		float rp = uni(0.0,2.0*M_PI) ;
-        vec2 trueUv = ((vec2(ij) + impulse_centre) *cellsz);
-		trueUv.y = -trueUv.y;
-        float o = texture(phaseField, trueUv).x *2.0* M_PI;
-		noise += phasor(d, f, b ,o, rp);
+		// The PRNG is sequential, so skipped impulses still have to draw their numbers.
+		if (impulse < _impulseBegin || impulse >= _impulseEnd) {
+			impulse++;
+			continue;
+		}
+        float o;
+        if (fusedPhaseField) {
+            o = fusedOrientation;
+        } else {
+            vec2 trueUv = ((vec2(ij) + impulse_centre) *cellsz);
+            trueUv.y = -trueUv.y;
+            if (imageGuidedPhaseField) {
+                // The (mirrored) noise domain spans [0, 1] x [-1, 1]; stretch the image over it. Tileable
+                // noise repeats the image once per period instead (same as imageOrientationSource() in main.cpp).
+                if (_period > 0)
+                    o = sample_phase_field(dogImage, trueUv / (float(_period) * cellsz) + vec2(0.0, 1.0), 0, 1, _imageOrientationPeriod, true) *2.0* M_PI;
+                else
+                    o = sample_phase_field(dogImage, vec2(trueUv.x, trueUv.y * 0.5 + 0.5), 0, 1, _imageOrientationPeriod, false) *2.0* M_PI;
+            } else {
+                // The phase field texture covers the same [0, 1] x [-1, 1] domain as the image.
+                o = sample_phase_field(phaseField, vec2(trueUv.x, trueUv.y * 0.5 + 0.5), phaseFieldTile, numPhaseFieldTiles, 1.0, false) *2.0* M_PI;
+            }
+        }
+		noise += phasor(d, f, b ,o, rp, dNoise);
 		impulse++;
 	}
 	return noise;
 }
 
-vec2 eval_noise(vec2 uv, float f, float b)
+// dNoise: derivatives of the noise with respect to uv.x (xy) and uv.y (zw), only with normalMap.
+vec2 eval_noise(vec2 uv, float f, float b, out vec4 dNoise)
 {   
 	float cellsz = 2.0 *_kr;
 	vec2 _ij = uv / cellsz;
 	ivec2  ij = ivec2(_ij);
 	vec2  fij = _ij - vec2(ij);
 	vec2 noise = vec2(0.0);
+	dNoise = vec4(0.0);
+	if (fusedPhaseField)
+		init_fused_field(ij);
 	for (int j = -2; j <= 2; j++) {
 		for (int i = -2; i <= 2; i++) {
 			ivec2 nij = ivec2(i, j);
-			noise += cell(ij + nij , fij - vec2(nij),f,b);
+			noise += cell(ij + nij, nij, fij - vec2(nij),f,b, dNoise);
 		}
 	}
     return noise;
@@ -128,15 +352,55 @@ float sawTooth(float x)
 
 void main()
 {
+    if (contactSheet) {
+        Swatch swatch = swatches[swatchIndex];
+        _f = swatch.f;
+        _b = swatch.b;
+        _impPerKernel = swatch.impPerKernel;
+        _period = swatch.period;
+        first = (swatch.profiles & 1) != 0;
+        second = (swatch.profiles & 2) != 0;
+        third = (swatch.profiles & 4) != 0;
+        fourth = (swatch.profiles & 8) != 0;
+        phaseFieldTile = swatch.phaseFieldTile;
+        numPhaseFieldTiles = _phaseFieldTiles;
+    }
+    if (screenMapped) {
+        vec3 position, normal;
+        if (!screen_mapped_surface(position, normal))
+            discard;
+        fragCoord = position.xy;
+        surfaceNormal = normal;
+    }
     uv = fragCoord;
     uv.y=-uv.y;
     uv.x = abs(uv.x);
     init_noise();
     float o = uv.x * 2.0*M_PI;
-    vec2 phasorNoise = eval_noise(uv,_f,_b);
+    vec2 phasorNoise;
+    vec4 dNoise = vec4(0.0);
+    if (resolveNoise)
+        phasorNoise = texture(accumulatedNoise, gl_FragCoord.xy / _viewportSize).xy;
+    else
+        phasorNoise = eval_noise(uv,_f,_b, dNoise);
+    if (accumulateNoise) {
+        outColor = vec4(phasorNoise, 0.0, 1.0);
+        return;
+    }
     vec2 dir = vec2(cos(o),sin(o));
     float phi = atan(phasorNoise.y,phasorNoise.x);
     float I = length(phasorNoise);
+    if (normalMap) {
+        // d atan(im, re) = (re dim - im dre) / I^2, undefined at the zeros of the noise. uv mirrors x and
+        // flips y of the surface, and the tangent of the face at z = -0.1 points along -x.
+        float I2 = I * I;
+        vec2 dPhi = I2 > 0.0 ? vec2(phasorNoise.x * dNoise.y - phasorNoise.y * dNoise.x, phasorNoise.x * dNoise.w - phasorNoise.y * dNoise.z) / I2 : vec2(0.0);
+        dPhi *= vec2(sign(fragCoord.x) * sign(surfaceNormal.z), -1.0);
+        // The height is sin(phi) scaled by _bumpSlope / (2 pi f), and |dPhi| is close to 2 pi f.
+        vec2 slope = _bumpSlope / (2.0 * M_PI * _f) * cos(phi) * dPhi;
+        outColor = vec4(normalize(vec3(-slope, 1.0)) * 0.5 + 0.5, 1.0);
+        return;
+    }
     float angle = texture(phaseField, vec2(1.0-abs(fragCoord.x), fragCoord.y) ).x;
     
     float p1 = 0.0;
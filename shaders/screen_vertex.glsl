@@ -0,0 +1,26 @@
+#version 430
+
+// Model/view/projection matrix
+layout(location = 0) uniform mat4 mvp;
+
+// Data to pass to fragment shader. Only the mesh path (vertex.glsl) interpolates a surface.
+out vec3 fragPos;
+out vec3 fragNormal;
+// End points of the view ray through the pixel in world space (homogeneous). They are linear in screen
+// space, so interpolating them without perspective correction is exact.
+noperspective out vec4 rayNear;
+noperspective out vec4 rayFar;
+flat out int swatchIndex; // Only used by the contact sheet (swatch_vertex.glsl).
+
+// Full screen triangle for the 2D noise views, generated from gl_VertexID (draw 3 vertices without any
+// vertex attributes bound). The fragment shaders find the point of the square seen by every pixel.
+void main() {
+    vec2 ndc = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    mat4 clipToWorld = inverse(mvp);
+    rayNear = clipToWorld * vec4(ndc, -1.0, 1.0);
+    rayFar = clipToWorld * vec4(ndc, 1.0, 1.0);
+    fragPos = vec3(0.0);
+    fragNormal = vec3(0.0);
+    swatchIndex = 0;
+    gl_Position = vec4(ndc, 0.0, 1.0);
+}
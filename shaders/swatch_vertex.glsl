@@ -0,0 +1,35 @@
+#version 430
+
+// Contact sheet: instance i draws swatch i of a grid with _grid.x columns and _grid.y rows (row 0 at the
+// top) inside _sheetRect (NDC, min in xy and max in zw). Every swatch covers the domain rectangle
+// [_domainMin, _domainMax]. Draw 6 vertices per instance without any vertex attributes bound.
+layout(location = 46) uniform ivec2 _grid;
+layout(location = 47) uniform vec4 _sheetRect;
+layout(location = 48) uniform vec2 _domainMin;
+layout(location = 49) uniform vec2 _domainMax;
+// Gap around every swatch as a fraction of its size.
+layout(location = 50) uniform float _swatchMargin;
+
+// Data to pass to fragment shader
+out vec3 fragPos;
+out vec3 fragNormal;
+noperspective out vec4 rayNear;
+noperspective out vec4 rayFar;
+flat out int swatchIndex;
+
+const vec2 corners[6] = vec2[](vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0));
+
+void main() {
+    vec2 corner = corners[gl_VertexID];
+    ivec2 cell = ivec2(gl_InstanceID % _grid.x, _grid.y - 1 - gl_InstanceID / _grid.x);
+    vec2 cellSize = (_sheetRect.zw - _sheetRect.xy) / vec2(_grid);
+    vec2 position = _sheetRect.xy + (vec2(cell) + _swatchMargin + corner * (1.0 - 2.0 * _swatchMargin)) * cellSize;
+
+    fragPos = vec3(mix(_domainMin, _domainMax, corner), 0.0);
+    // Faces the default camera like the square of the noise views.
+    fragNormal = vec3(0.0, 0.0, -1.0);
+    rayNear = vec4(0.0);
+    rayFar = vec4(0.0);
+    swatchIndex = gl_InstanceID;
+    gl_Position = vec4(position, 0.0, 1.0);
+}
@@ -0,0 +1,47 @@
+#version 430
+
+// Upscales the region [0, _renderSize) of the scene target (rendered at a reduced resolution by the
+// dynamic resolution scaling) to the whole viewport.
+layout (location = 0) uniform sampler2D scene;
+layout (location = 1) uniform ivec2 _renderSize;
+layout (location = 2) uniform int _filter; // 0 = nearest, 1 = bilinear, 2 = bicubic (same as UpscaleFilter).
+
+layout(location = 0) out vec4 outColor;
+
+in vec2 texCoord;
+
+vec4 catmull_rom_weights(float t)
+{
+	float t2 = t * t;
+	float t3 = t2 * t;
+	return vec4(-t3 + 2.0 * t2 - t, 3.0 * t3 - 5.0 * t2 + 2.0, -3.0 * t3 + 4.0 * t2 + t, t3 - t2) * 0.5;
+}
+
+// Texel of the rendered region, clamped so that the filters never read the unused part of the target.
+vec4 fetch(ivec2 texel)
+{
+	return texelFetch(scene, clamp(texel, ivec2(0), _renderSize - 1), 0);
+}
+
+void main() {
+	vec2 st = texCoord * vec2(_renderSize) - 0.5;
+	ivec2 base = ivec2(floor(st));
+	vec2 t = fract(st);
+
+	if (_filter == 0) {
+		outColor = fetch(base + ivec2(step(0.5, t)));
+	} else if (_filter == 1) {
+		outColor = mix(mix(fetch(base), fetch(base + ivec2(1, 0)), t.x),
+			mix(fetch(base + ivec2(0, 1)), fetch(base + ivec2(1, 1)), t.x), t.y);
+	} else {
+		vec4 wx = catmull_rom_weights(t.x);
+		vec4 wy = catmull_rom_weights(t.y);
+		vec4 result = vec4(0.0);
+		for (int j = 0; j < 4; j++) {
+			for (int i = 0; i < 4; i++)
+				result += wx[i] * wy[j] * fetch(base + ivec2(i - 1, j - 1));
+		}
+		// Catmull-Rom has negative lobes, which can overshoot the [0, 1] range at sharp edges.
+		outColor = clamp(result, 0.0, 1.0);
+	}
+}
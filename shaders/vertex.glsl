@@ -10,6 +10,10 @@ layout(location = 1) in vec3 normal; // World-space normal
 // Data to pass to fragment shader
 out vec3 fragPos;
 out vec3 fragNormal;
+// Only used by the full screen path (screen_vertex.glsl) and the contact sheet (swatch_vertex.glsl).
+noperspective out vec4 rayNear;
+noperspective out vec4 rayFar;
+flat out int swatchIndex;
 
 void main() {
 	// Transform 3D position into on-screen position
@@ -18,4 +22,7 @@ void main() {
     // Pass position and normal through to fragment shader
     fragPos = pos;
     fragNormal = normal;
+    rayNear = vec4(0.0);
+    rayFar = vec4(0.0);
+    swatchIndex = 0;
 }
\ No newline at end of file
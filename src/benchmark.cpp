@@ -0,0 +1,161 @@
+#include "benchmark.h"
+#include <framework/disable_all_warnings.h>
+#include <framework/json.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/gtc/constants.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+// Frames between two changes of b or the impulses per kernel.
+static constexpr int parameterStep = 32;
+
+static constexpr std::array scenarios {
+    BenchmarkScenario { .name = "phase field view", .phaseField = true, .phasorNoise = false },
+    BenchmarkScenario { .name = "phasor noise" },
+    BenchmarkScenario { .name = "phasor noise (mesh)", .screenMappedNoise = false },
+    BenchmarkScenario { .name = "fused phase field", .fusedPhaseField = true },
+    BenchmarkScenario { .name = "image guided", .imageGuidedPhaseField = true },
+    BenchmarkScenario { .name = "progressive", .progressive = true },
+    BenchmarkScenario { .name = "contact sheet", .contactSheet = true }
+};
+
+std::span<const BenchmarkScenario> benchmarkScenarios()
+{
+    return scenarios;
+}
+
+BenchmarkFrame benchmarkFrame(int frame, int numFrames)
+{
+    const int numScenarios = static_cast<int>(scenarios.size());
+    const int framesPerScenario = std::max(numFrames / numScenarios, 1);
+    const int scenario = std::min(frame / framesPerScenario, numScenarios - 1);
+    const int frameInScenario = frame - scenario * framesPerScenario;
+
+    // One orbit per 256 frames that stays within the square.
+    const float t = static_cast<float>(frame) / 256.0f * glm::two_pi<float>();
+    constexpr std::array bValues { 30.0f, 20.0f, 40.0f };
+    constexpr std::array impulsesPerKernelValues { 16, 8, 24 };
+    const int step = frameInScenario / parameterStep;
+
+    BenchmarkFrame out;
+    out.scenario = scenario;
+    out.warmup = frameInScenario < benchmarkWarmupFrames;
+    out.cameraRotation = glm::vec3(0.3f * std::sin(t), 0.4f * std::sin(2.0f * t), 0.0f);
+    out.cameraDistance = 4.0f + 0.75f * std::cos(t);
+    out.f = 50.0f + 20.0f * std::sin(0.5f * t);
+    out.b = bValues[static_cast<size_t>(step) % bValues.size()];
+    out.impulsesPerKernel = impulsesPerKernelValues[static_cast<size_t>(step / 2) % impulsesPerKernelValues.size()];
+    return out;
+}
+
+Percentiles percentiles(std::vector<float> samples)
+{
+    Percentiles out;
+    out.count = samples.size();
+    if (samples.empty())
+        return out;
+
+    std::sort(std::begin(samples), std::end(samples));
+    auto rank = [&](float p) {
+        const size_t index = static_cast<size_t>(std::ceil(p * static_cast<float>(samples.size())));
+        return samples[std::clamp<size_t>(index, 1, samples.size()) - 1];
+    };
+    out.mean = std::accumulate(std::begin(samples), std::end(samples), 0.0f) / static_cast<float>(samples.size());
+    out.p50 = rank(0.50f);
+    out.p95 = rank(0.95f);
+    out.p99 = rank(0.99f);
+    out.max = samples.back();
+    return out;
+}
+
+void BenchmarkRecorder::addFrame(std::string_view scenario, float frameTime, std::optional<float> gpuFrameTime)
+{
+    if (m_scenarioFrames.empty() || m_scenarioFrames.back().first != scenario)
+        m_scenarioFrames.emplace_back(std::string(scenario), FrameSamples {});
+    for (FrameSamples* pSamples : { &m_allFrames, &m_scenarioFrames.back().second }) {
+        pSamples->frameTimes.push_back(frameTime);
+        if (gpuFrameTime)
+            pSamples->gpuFrameTimes.push_back(*gpuFrameTime);
+    }
+}
+
+void BenchmarkRecorder::addPassTime(std::string_view pass, float gpuTime)
+{
+    auto iter = m_passTimes.find(pass);
+    if (iter == std::end(m_passTimes))
+        iter = m_passTimes.emplace(std::string(pass), std::vector<float> {}).first;
+    iter->second.push_back(gpuTime);
+}
+
+static void writeJsonPercentiles(std::ostream& stream, const std::vector<float>& samples)
+{
+    const Percentiles p = percentiles(samples);
+    stream << "{ \"count\": " << p.count << ", \"mean\": " << p.mean << ", \"p50\": " << p.p50
+           << ", \"p95\": " << p.p95 << ", \"p99\": " << p.p99 << ", \"max\": " << p.max << " }";
+}
+
+void BenchmarkRecorder::writeJson(const std::filesystem::path& filePath, const glm::ivec2& resolution, std::string_view renderer) const
+{
+    std::ofstream file { filePath };
+    if (!file) {
+        std::cerr << "Could not open " << filePath << " for writing" << std::endl;
+        throw std::exception();
+    }
+
+    file << "{\n";
+    file << "  \"renderer\": ";
+    writeJsonString(file, renderer);
+    file << ",\n  \"resolution\": [" << resolution.x << ", " << resolution.y << "],\n";
+    file << "  \"units\": \"ms\",\n";
+    file << "  \"frame\": { \"time\": ";
+    writeJsonPercentiles(file, m_allFrames.frameTimes);
+    file << ", \"gpu\": ";
+    writeJsonPercentiles(file, m_allFrames.gpuFrameTimes);
+    file << " },\n";
+
+    file << "  \"scenarios\": [";
+    for (auto iter = std::begin(m_scenarioFrames); iter != std::end(m_scenarioFrames); iter++) {
+        file << (iter == std::begin(m_scenarioFrames) ? "\n" : ",\n") << "    { \"name\": ";
+        writeJsonString(file, iter->first);
+        file << ", \"time\": ";
+        writeJsonPercentiles(file, iter->second.frameTimes);
+        file << ", \"gpu\": ";
+        writeJsonPercentiles(file, iter->second.gpuFrameTimes);
+        file << " }";
+    }
+    file << "\n  ],\n";
+
+    file << "  \"passes\": {";
+    for (auto iter = std::begin(m_passTimes); iter != std::end(m_passTimes); iter++) {
+        file << (iter == std::begin(m_passTimes) ? "\n" : ",\n") << "    ";
+        writeJsonString(file, iter->first);
+        file << ": ";
+        writeJsonPercentiles(file, iter->second);
+    }
+    file << "\n  }\n}\n";
+
+    if (!file) {
+        std::cerr << "Failed to write " << filePath << std::endl;
+        throw std::exception();
+    }
+}
+
+void BenchmarkRecorder::printSummary() const
+{
+    auto print = [](std::string_view name, const std::vector<float>& samples) {
+        const Percentiles p = percentiles(samples);
+        std::cout << name << ": p50 " << p.p50 << " ms, p95 " << p.p95 << " ms, p99 " << p.p99 << " ms (" << p.count << " samples)" << std::endl;
+    };
+    print("frame", m_allFrames.frameTimes);
+    print("frame (GPU)", m_allFrames.gpuFrameTimes);
+    for (const auto& [scenario, samples] : m_scenarioFrames)
+        print(scenario + " (GPU)", samples.gpuFrameTimes);
+    for (const auto& [pass, samples] : m_passTimes)
+        print("pass " + pass, samples);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Viewer mode (the globals of the same name in main.cpp) that one segment of the benchmark measures.
+struct BenchmarkScenario {
+    std::string_view name;
+    bool phaseField { false };
+    bool phasorNoise { true };
+    bool fusedPhaseField { false };
+    bool imageGuidedPhaseField { false };
+    bool progressive { false };
+    bool screenMappedNoise { true };
+    bool contactSheet { false };
+};
+
+// The first frames of a scenario (re)allocate targets and wait for the GPU timers of the previous
+// scenario, so they are not measured.
+constexpr int benchmarkWarmupFrames = 8;
+
+// State of the viewer in one frame of the benchmark.
+struct BenchmarkFrame {
+    int scenario; // Index into benchmarkScenarios().
+    bool warmup;
+    glm::vec3 cameraRotation; // Euler angles (in radians) of the trackball.
+    float cameraDistance;
+    float f, b;
+    int impulsesPerKernel;
+};
+
+[[nodiscard]] std::span<const BenchmarkScenario> benchmarkScenarios();
+// The timeline only depends on the frame index: the frames are split evenly over the scenarios, the camera
+// orbits around the square every frame and b and the impulses per kernel change in steps, so both the
+// passes that follow the camera and the ones that are skipped until a parameter changes are measured.
+[[nodiscard]] BenchmarkFrame benchmarkFrame(int frame, int numFrames);
+
+struct Percentiles {
+    size_t count { 0 };
+    float mean { 0.0f };
+    float p50 { 0.0f }, p95 { 0.0f }, p99 { 0.0f };
+    float max { 0.0f };
+};
+// Nearest rank percentiles of the samples.
+[[nodiscard]] Percentiles percentiles(std::vector<float> samples);
+
+// Collects the timings (in milliseconds) of the measured benchmark frames.
+class BenchmarkRecorder {
+public:
+    // frameTime is the wall clock time between two presented frames. GPU times come from timer queries
+    // that complete a few frames later, so frames without a completed query only add the frame time.
+    void addFrame(std::string_view scenario, float frameTime, std::optional<float> gpuFrameTime);
+    void addPassTime(std::string_view pass, float gpuTime);
+
+    // Writes the percentiles of the frame times (over all frames and per scenario) and of the GPU time
+    // of every render pass. Throws if the file cannot be written.
+    void writeJson(const std::filesystem::path& filePath, const glm::ivec2& resolution, std::string_view renderer) const;
+    void printSummary() const;
+
+private:
+    struct FrameSamples {
+        std::vector<float> frameTimes;
+        std::vector<float> gpuFrameTimes;
+    };
+
+    FrameSamples m_allFrames;
+    std::vector<std::pair<std::string, FrameSamples>> m_scenarioFrames; // In the order of the benchmark.
+    std::map<std::string, std::vector<float>, std::less<>> m_passTimes;
+};
@@ -0,0 +1,81 @@
+#include "contact_sheet.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+
+static void applyAxis(ContactSheetAxis axis, int index, int count, float range, PhasorNoiseParams& params)
+{
+    // In [-0.5, 0.5] over the axis.
+    const float t = count > 1 ? static_cast<float>(index) / static_cast<float>(count - 1) - 0.5f : 0.0f;
+    const float scale = std::pow(range, t);
+    switch (axis) {
+    case ContactSheetAxis::Frequency: {
+        params.f *= scale;
+    } break;
+    case ContactSheetAxis::Bandwidth: {
+        params.b *= scale;
+    } break;
+    case ContactSheetAxis::ImpulsesPerKernel: {
+        params.impulsesPerKernel = std::max(1, static_cast<int>(std::round(static_cast<float>(params.impulsesPerKernel) * scale)));
+    } break;
+    case ContactSheetAxis::Profiles: {
+        // Every non-empty combination of the four profiles.
+        const int profiles = index % 15 + 1;
+        for (size_t i = 0; i < params.profiles.size(); i++)
+            params.profiles[i] = (profiles >> i) & 1;
+    } break;
+    };
+}
+
+ContactSheet makeContactSheet(const ContactSheetSettings& settings, const PhasorNoiseParams& centre, float tileSize)
+{
+    ContactSheet out;
+    out.swatches.reserve(static_cast<size_t>(settings.columns * settings.rows));
+    for (int row = 0; row < settings.rows; row++) {
+        for (int column = 0; column < settings.columns; column++) {
+            PhasorNoiseParams params = centre;
+            applyAxis(settings.columnAxis, column, settings.columns, settings.range, params);
+            applyAxis(settings.rowAxis, row, settings.rows, settings.range, params);
+            params.period = tileSize > 0.0f ? periodInCells(tileSize, params.b) : 0;
+
+            const GPUPhaseFieldTile tile { params.b, params.impulsesPerKernel, params.period };
+            auto iter = std::find_if(std::begin(out.phaseFieldTiles), std::end(out.phaseFieldTiles), [&](const GPUPhaseFieldTile& other) {
+                return other.b == tile.b && other.impulsesPerKernel == tile.impulsesPerKernel && other.period == tile.period;
+            });
+            if (iter == std::end(out.phaseFieldTiles))
+                iter = out.phaseFieldTiles.insert(iter, tile);
+
+            int profiles = 0;
+            for (size_t i = 0; i < params.profiles.size(); i++)
+                profiles |= params.profiles[i] << i;
+            out.swatches.push_back({ params.f, params.b, params.impulsesPerKernel, profiles, params.period, static_cast<int>(iter - std::begin(out.phaseFieldTiles)) });
+        }
+    }
+    return out;
+}
+
+glm::vec4 contactSheetRect(const ContactSheetSettings& settings, const glm::ivec2& viewportSize)
+{
+    // Largest square swatch that fits, with the grid centred in the viewport.
+    const glm::vec2 grid { settings.columns, settings.rows };
+    const float swatchSize = glm::min(static_cast<float>(viewportSize.x) / grid.x, static_cast<float>(viewportSize.y) / grid.y);
+    const glm::vec2 extent = swatchSize * grid / glm::vec2(viewportSize);
+    return glm::vec4(-extent, extent);
+}
+
+std::string_view axisName(ContactSheetAxis axis)
+{
+    switch (axis) {
+    case ContactSheetAxis::Frequency:
+        return "f";
+    case ContactSheetAxis::Bandwidth:
+        return "b";
+    case ContactSheetAxis::ImpulsesPerKernel:
+        return "ipk";
+    case ContactSheetAxis::Profiles:
+        return "profiles";
+    };
+    return "";
+}
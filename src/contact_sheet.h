@@ -0,0 +1,58 @@
+#pragma once
+#include "phasor_noise.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+#include <string_view>
+#include <vector>
+
+// Parameter that varies along the columns or rows of the contact sheet.
+enum class ContactSheetAxis {
+    Frequency,
+    Bandwidth,
+    ImpulsesPerKernel,
+    Profiles
+};
+constexpr int numContactSheetAxes = 4;
+
+struct ContactSheetSettings {
+    int columns { 8 };
+    int rows { 8 };
+    ContactSheetAxis columnAxis { ContactSheetAxis::Frequency };
+    ContactSheetAxis rowAxis { ContactSheetAxis::Bandwidth };
+    // Ratio of the largest and smallest f, b or impulses per kernel along an axis. The values are spaced
+    // geometrically around the current value. The profiles axis goes through the 15 combinations instead.
+    float range { 4.0f };
+};
+
+// Per-instance data of the noise swatches, matches the std430 layout of Swatch in phasor_noise.glsl.
+struct GPUSwatch {
+    float f;
+    float b;
+    int impulsesPerKernel;
+    int profiles; // Bit i enables profile i.
+    int period;
+    int phaseFieldTile;
+};
+// Per-instance data of the phase field atlas, matches PhaseFieldTile in phase_field.glsl.
+struct GPUPhaseFieldTile {
+    float b;
+    int impulsesPerKernel;
+    int period;
+};
+
+// Grid of swatches (row major, row 0 at the top) with the phase fields that they use. Swatches with the
+// same b, impulses per kernel and period share their phase field.
+struct ContactSheet {
+    std::vector<GPUSwatch> swatches;
+    std::vector<GPUPhaseFieldTile> phaseFieldTiles;
+};
+
+// Varies centre along the axes of the settings. tileSize is the period in world units of tileable
+// noise, or 0 if the noise does not tile.
+[[nodiscard]] ContactSheet makeContactSheet(const ContactSheetSettings& settings, const PhasorNoiseParams& centre, float tileSize);
+// Part of the viewport (in NDC, min in xy and max in zw) covered by the grid such that the swatches are square.
+[[nodiscard]] glm::vec4 contactSheetRect(const ContactSheetSettings& settings, const glm::ivec2& viewportSize);
+[[nodiscard]] std::string_view axisName(ContactSheetAxis axis);
@@ -0,0 +1,58 @@
+#include "dynamic_resolution.h"
+#include <framework/gpu_timer.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+
+// Exponential smoothing of the measured frame times, which are noisy from frame to frame.
+static constexpr float smoothing = 0.25f;
+// The scale only changes when it is off by more than this (relative), which prevents oscillation.
+static constexpr float hysteresis = 0.05f;
+// Scales are rounded to multiples of this, so the render resolution does not creep by single pixels.
+static constexpr float scaleStep = 1.0f / 32.0f;
+
+bool DynamicResolution::update(float frameTime)
+{
+    if (!settings.enabled || frameTime <= 0.0f)
+        return false;
+
+    // Measurements that were issued before the last change of the scale.
+    if (m_samplesToSkip > 0) {
+        m_samplesToSkip--;
+        return false;
+    }
+
+    m_smoothedFrameTime = m_smoothedFrameTime < 0.0f ? frameTime : m_smoothedFrameTime + smoothing * (frameTime - m_smoothedFrameTime);
+    const float idealScale = m_scale * std::sqrt(settings.targetFrameTime / m_smoothedFrameTime);
+    float newScale = std::clamp(std::round(idealScale / scaleStep) * scaleStep, settings.minScale, settings.maxScale);
+    // Small corrections are ignored, but the bounds are always respected.
+    if (std::abs(newScale - m_scale) <= hysteresis * m_scale)
+        newScale = std::clamp(m_scale, settings.minScale, settings.maxScale);
+    if (newScale == m_scale)
+        return false;
+
+    // Rescale the history to the new resolution instead of throwing it away.
+    m_smoothedFrameTime *= (newScale * newScale) / (m_scale * m_scale);
+    m_scale = newScale;
+    m_samplesToSkip = static_cast<int>(GpuTimer::numFramesInFlight);
+    return true;
+}
+
+void DynamicResolution::reset()
+{
+    m_smoothedFrameTime = -1.0f;
+    m_samplesToSkip = 0;
+}
+
+float DynamicResolution::scale() const
+{
+    return settings.enabled ? m_scale : settings.maxScale;
+}
+
+glm::ivec2 DynamicResolution::renderResolution(const glm::ivec2& windowSize) const
+{
+    const glm::vec2 size = glm::round(glm::vec2(windowSize) * scale());
+    return glm::clamp(glm::ivec2(size), glm::ivec2(1), glm::max(windowSize, glm::ivec2(1)));
+}
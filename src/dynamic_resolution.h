@@ -0,0 +1,44 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+
+// Filter used to upscale the internal render resolution to the window.
+enum class UpscaleFilter {
+    Nearest,
+    Bilinear,
+    Bicubic // Catmull-Rom, keeps the noise sharper than bilinear.
+};
+
+struct DynamicResolutionSettings {
+    bool enabled { true };
+    // GPU time budget (in milliseconds) of the main scene pass.
+    float targetFrameTime { 1000.0f / 60.0f };
+    // Bounds of the scale of the render resolution relative to the window (per axis).
+    float minScale { 0.25f };
+    float maxScale { 1.0f };
+    UpscaleFilter filter { UpscaleFilter::Bicubic };
+};
+
+// Picks the internal render resolution that holds the GPU time of the scene at the target frame time.
+// The cost of the noise passes is proportional to the number of pixels, so the scale per axis is
+// corrected by the square root of the ratio of the target and the (smoothed) measured frame time.
+class DynamicResolution {
+public:
+    // Feeds a measured GPU time (in milliseconds). Returns true if the scale changed.
+    bool update(float frameTime);
+    // Forgets the timing history, e.g. after a change that makes the old measurements meaningless.
+    void reset();
+
+    [[nodiscard]] float scale() const;
+    [[nodiscard]] glm::ivec2 renderResolution(const glm::ivec2& windowSize) const;
+
+public:
+    DynamicResolutionSettings settings;
+
+private:
+    float m_scale { 1.0f };
+    float m_smoothedFrameTime { -1.0f };
+    int m_samplesToSkip { 0 };
+};
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// 64 bit FNV-1a over the bytes of trivially copyable values.
+class Hasher {
+public:
+    template <typename T>
+    void add(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        addBytes(&value, sizeof(T));
+    }
+    void addBytes(const void* pData, size_t size)
+    {
+        const auto* pBytes = static_cast<const unsigned char*>(pData);
+        for (size_t i = 0; i < size; i++) {
+            m_hash ^= pBytes[i];
+            m_hash *= 0x100000001b3ull;
+        }
+    }
+    [[nodiscard]] uint64_t hash() const { return m_hash; }
+
+private:
+    uint64_t m_hash { 0xcbf29ce484222325ull };
+};
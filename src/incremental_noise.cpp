@@ -0,0 +1,150 @@
+#include "incremental_noise.h"
+#include "parallel.h"
+#include <framework/trace.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+IncrementalPhasorNoise::IncrementalPhasorNoise(const PhasorNoiseParams& params, const SampledOrientation& orientation, const PhasorNoiseRegion& region, int tileSize)
+    : m_params(params)
+    , m_orientation(orientation)
+    , m_region(region)
+    , m_tileSize(tileSize)
+    , m_numTiles((glm::ivec2(region.width, region.height) + tileSize - 1) / tileSize)
+    , m_image { region.width, region.height, std::vector<float>(static_cast<size_t>(region.width) * static_cast<size_t>(region.height)) }
+    , m_dirtyTiles(static_cast<size_t>(m_numTiles.x) * static_cast<size_t>(m_numTiles.y), true)
+{
+    assert(tileSize > 0);
+    const glm::vec2 regionEnd = region.origin + region.size;
+    glm::ivec2 cellMin, cellMax;
+    cellRangeForRegion(params.b, glm::min(region.origin, regionEnd), glm::max(region.origin, regionEnd), cellMin, cellMax);
+    m_grid = ImpulseGrid { params, orientation, cellMin, cellMax };
+}
+
+void IncrementalPhasorNoise::orientationChanged(const glm::ivec2& texelBegin, const glm::ivec2& texelEnd)
+{
+    if (glm::any(glm::greaterThanEqual(texelBegin, texelEnd)))
+        return;
+
+    if (m_params.period > 0) {
+        // The phase field repeats, so the texels are sampled in every period.
+        m_grid.regenerate(m_params, m_orientation, m_grid.cellMin, m_grid.cellMax);
+        std::fill(std::begin(m_dirtyTiles), std::end(m_dirtyTiles), true);
+        return;
+    }
+
+    // A bicubic sample reads the 4x4 texels around it, and the texels at the border are extended outwards.
+    const glm::vec2 fieldSize { m_orientation.pPhaseField->width, m_orientation.pPhaseField->height };
+    glm::vec2 uvBegin = glm::vec2(texelBegin - 2) / fieldSize;
+    glm::vec2 uvEnd = glm::vec2(texelEnd + 2) / fieldSize;
+    for (int axis = 0; axis < 2; axis++) {
+        if (texelBegin[axis] <= 0)
+            uvBegin[axis] = -std::numeric_limits<float>::infinity();
+        if (static_cast<float>(texelEnd[axis]) >= fieldSize[axis])
+            uvEnd[axis] = std::numeric_limits<float>::infinity();
+    }
+    const float cellsz = cellSize(m_params.b);
+    const glm::vec2 gridMin = glm::vec2(m_grid.cellMin - 1) * cellsz;
+    const glm::vec2 gridMax = glm::vec2(m_grid.cellMax + 2) * cellsz;
+    const glm::vec2 worldA = glm::clamp(m_orientation.origin + uvBegin * m_orientation.extent, gridMin, gridMax);
+    const glm::vec2 worldB = glm::clamp(m_orientation.origin + uvEnd * m_orientation.extent, gridMin, gridMax);
+
+    // The impulses of a cell lie up to one cell outside of it, and their kernels reach one more cell.
+    const glm::ivec2 cellsMin = glm::ivec2(glm::floor(glm::min(worldA, worldB) / cellsz)) - 1;
+    const glm::ivec2 cellsMax = glm::ivec2(glm::floor(glm::max(worldA, worldB) / cellsz)) + 1;
+    m_grid.regenerate(m_params, m_orientation, cellsMin, cellsMax);
+    markDirty(glm::vec2(cellsMin - 2) * cellsz, glm::vec2(cellsMax + 3) * cellsz);
+}
+
+std::vector<glm::ivec2> IncrementalPhasorNoise::update(const CancellationToken& cancellation)
+{
+    std::vector<glm::ivec2> tiles;
+    for (int y = 0; y < m_numTiles.y; y++) {
+        for (int x = 0; x < m_numTiles.x; x++) {
+            if (isDirty({ x, y }))
+                tiles.emplace_back(x, y);
+        }
+    }
+    if (tiles.empty())
+        return tiles;
+
+    TRACE_ZONE("IncrementalPhasorNoise::update");
+    std::vector<char> evaluated(tiles.size(), false);
+    parallelForChunks(0, static_cast<int>(tiles.size()), [&](int begin, int end) {
+        for (int i = begin; i < end && !cancellation.isCancelled(); i++) {
+            evaluateTile(tiles[static_cast<size_t>(i)]);
+            evaluated[static_cast<size_t>(i)] = true;
+        }
+    });
+
+    std::vector<glm::ivec2> out;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        if (!evaluated[i])
+            continue;
+        const glm::ivec2& tile = tiles[i];
+        m_dirtyTiles[static_cast<size_t>(tile.y) * static_cast<size_t>(m_numTiles.x) + static_cast<size_t>(tile.x)] = false;
+        out.push_back(tile);
+    }
+    return out;
+}
+
+const NoiseImage& IncrementalPhasorNoise::image() const
+{
+    return m_image;
+}
+
+int IncrementalPhasorNoise::tileSize() const
+{
+    return m_tileSize;
+}
+
+glm::ivec2 IncrementalPhasorNoise::numTiles() const
+{
+    return m_numTiles;
+}
+
+bool IncrementalPhasorNoise::isDirty(const glm::ivec2& tile) const
+{
+    return m_dirtyTiles[static_cast<size_t>(tile.y) * static_cast<size_t>(m_numTiles.x) + static_cast<size_t>(tile.x)];
+}
+
+bool IncrementalPhasorNoise::hasDirtyTiles() const
+{
+    return std::find(std::begin(m_dirtyTiles), std::end(m_dirtyTiles), true) != std::end(m_dirtyTiles);
+}
+
+void IncrementalPhasorNoise::markDirty(const glm::vec2& worldMin, const glm::vec2& worldMax)
+{
+    // Pixel centres lie at origin + (pixel + 0.5) * pixelSize (the size may be negative along an axis).
+    const glm::vec2 pixelSize = m_region.size / glm::vec2(m_region.width, m_region.height);
+    const glm::vec2 a = (worldMin - m_region.origin) / pixelSize - 0.5f;
+    const glm::vec2 b = (worldMax - m_region.origin) / pixelSize - 0.5f;
+    const glm::vec2 lastPixel = glm::vec2(m_region.width, m_region.height) - 1.0f;
+    if (glm::any(glm::lessThan(glm::max(a, b), glm::vec2(0.0f))) || glm::any(glm::greaterThan(glm::min(a, b), lastPixel)))
+        return;
+
+    const glm::ivec2 tileMin = glm::ivec2(glm::floor(glm::clamp(glm::min(a, b), glm::vec2(0.0f), lastPixel))) / m_tileSize;
+    const glm::ivec2 tileMax = glm::ivec2(glm::ceil(glm::clamp(glm::max(a, b), glm::vec2(0.0f), lastPixel))) / m_tileSize;
+    for (int y = tileMin.y; y <= tileMax.y; y++) {
+        for (int x = tileMin.x; x <= tileMax.x; x++)
+            m_dirtyTiles[static_cast<size_t>(y) * static_cast<size_t>(m_numTiles.x) + static_cast<size_t>(x)] = true;
+    }
+}
+
+void IncrementalPhasorNoise::evaluateTile(const glm::ivec2& tile)
+{
+    // Same pixel positions as renderPhasorNoise(), so the result does not depend on the order of the edits.
+    const glm::vec2 pixelSize = m_region.size / glm::vec2(m_region.width, m_region.height);
+    const glm::ivec2 begin = tile * m_tileSize;
+    const glm::ivec2 end = glm::min(begin + m_tileSize, glm::ivec2(m_region.width, m_region.height));
+    for (int y = begin.y; y < end.y; y++) {
+        for (int x = begin.x; x < end.x; x++) {
+            const glm::vec2 p = m_region.origin + (glm::vec2(x, y) + 0.5f) * pixelSize;
+            const glm::vec2 noise = evaluatePhasorNoise(m_grid, m_params.b, p);
+            m_image.pixels[static_cast<size_t>(y) * static_cast<size_t>(m_region.width) + static_cast<size_t>(x)] = applyProfiles(m_params.profiles, noise, p.x);
+        }
+    }
+}
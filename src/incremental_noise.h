@@ -0,0 +1,48 @@
+#pragma once
+#include "phasor_noise.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include <vector>
+
+// Noise of a fixed region whose orientation comes from a phase field that is edited locally (with a brush,
+// by pasting a patch of a guide image, ...). The impulses of the whole region are kept between edits, so an
+// edit only regenerates the cells whose impulses sample the changed texels and only re-evaluates the output
+// tiles within kernel reach of those cells, which are tracked in a bitmap of dirty tiles. The cost of an edit
+// follows the size of the edit instead of the size of the image.
+class IncrementalPhasorNoise {
+public:
+    // The phase field of the orientation has to outlive this object. Edit it in place and report the
+    // changed texels with orientationChanged(). All tiles start dirty.
+    IncrementalPhasorNoise(const PhasorNoiseParams& params, const SampledOrientation& orientation, const PhasorNoiseRegion& region, int tileSize = 64);
+
+    // Texels [texelBegin, texelEnd) of the phase field changed: regenerates the affected impulses and marks
+    // the tiles that they reach as dirty.
+    void orientationChanged(const glm::ivec2& texelBegin, const glm::ivec2& texelEnd);
+    // Evaluates the dirty tiles again and returns them. After a cancellation the tiles that did not start yet
+    // stay dirty and are not returned.
+    std::vector<glm::ivec2> update(const CancellationToken& cancellation = {});
+
+    // Row 0 corresponds to region.origin.y (like renderPhasorNoise()).
+    [[nodiscard]] const NoiseImage& image() const;
+    [[nodiscard]] int tileSize() const;
+    [[nodiscard]] glm::ivec2 numTiles() const;
+    [[nodiscard]] bool isDirty(const glm::ivec2& tile) const;
+    [[nodiscard]] bool hasDirtyTiles() const;
+
+private:
+    // Marks the tiles that overlap the world space rectangle as dirty.
+    void markDirty(const glm::vec2& worldMin, const glm::vec2& worldMax);
+    void evaluateTile(const glm::ivec2& tile);
+
+private:
+    PhasorNoiseParams m_params;
+    SampledOrientation m_orientation;
+    PhasorNoiseRegion m_region;
+    int m_tileSize;
+    glm::ivec2 m_numTiles;
+    ImpulseGrid m_grid;
+    NoiseImage m_image;
+    std::vector<bool> m_dirtyTiles; // Row major.
+};
@@ -4,6 +4,7 @@
 DISABLE_WARNINGS_PUSH()
 // Include glad before glfw3
 #include <GLFW/glfw3.h>
+#include <glm/common.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/mat4x4.hpp>
@@ -17,15 +18,46 @@ DISABLE_WARNINGS_PUSH()
 DISABLE_WARNINGS_POP()
 #include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
 #include <cstdlib> // EXIT_FAILURE
+#include <exception>
+#include <framework/gl_state.h>
+#include <framework/gpu_timer.h>
+#include <framework/input_recording.h>
+#include <framework/job_system.h>
 #include <framework/mesh.h>
+#include <framework/render_graph.h>
 #include <framework/shader.h>
+#include <framework/trace.h>
 #include <framework/trackball.h>
+#include <framework/triple_buffer.h>
 #include <framework/window.h>
+#include "benchmark.h"
+#include "contact_sheet.h"
+#include "dynamic_resolution.h"
+#include "hash.h"
+#include "incremental_noise.h"
+#include "noise_writer.h"
+#include "orientation_brush.h"
+#include "phase_field.h"
+#include "phasor_noise.h"
+#include "progressive_refinement.h"
+#include "render_target.h"
+#include "structure_tensor.h"
+#include "tile_cache.h"
+#include "tile_render_job.h"
 #include <iostream>
+#include <limits>
+#include <mutex>
 #include <numeric>
 #include <optional>
 #include <span>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #define GLM_ENABLE_EXPERIMENTAL
@@ -35,7 +67,7 @@ extern "C"
     __declspec(dllexport) unsigned long NvOptimusEnablement = 0x00000001;
 }
 
-// Configuration
+// Configuration (initial window size, the render targets follow the window when it is resized).
 const int WIDTH = 800;
 const int HEIGHT = 800;
 
@@ -46,24 +78,176 @@ bool first = false;
 bool second = false;
 bool third = false;
 bool fourth = false;
+bool fusedPhaseField = false;
+bool imageGuidedPhaseField = false;
+bool tileable = false;
+bool progressive = false;
+// Draw the 2D noise views with a full screen triangle instead of the mesh (see screen_vertex.glsl).
+bool screenMappedNoise = true;
+// Grid of phasor noise swatches with varying parameters, drawn in a single instanced draw.
+bool contactSheet = false;
+ContactSheetSettings contactSheetSettings {};
+// Noise rendered by the CPU engine in the background and shown as its tiles finish.
+bool cpuPreview = false;
+// Left dragging paints the image guided orientation (the direction of the stroke) instead of rotating the camera.
+bool brushMode = false;
+OrientationBrushSettings brushSettings {};
+// The noise views show the normal map of the bump of the sine profile, from the analytic derivatives of the noise.
+bool normalMap = false;
+bool bakeRequested = false;
+bool continuousRedraw = false;
+DynamicResolutionSettings dynamicResolutionSettings {};
+uint64_t dynamicResolutionResets = 0;
+// Incremented for every handled key, after which the renderer prints the parameters and statistics.
+uint64_t statusRequests = 0;
 int currentVar = 1;
 
-static void printHelp();
-
 float f = 50.0f;
 float b = 30.0f;
 int ipk = 16;
+PhaseFieldSettings phaseFieldSettings {};
+// Size (in world units) of the tile that repeats when tileable is enabled.
+constexpr float tileSize = 1.0f;
+// Steepest slope of the bump in the normal maps (see bumpNormal()).
+constexpr float bumpSlope = 1.0f;
+
+// Copy of the parameters above and of the camera. The input handling publishes one after every update
+// and the renderer only reads these, so it can run on its own thread (see TripleBuffer).
+struct ViewerState {
+    bool debug, phasorNoise, phaseField;
+    bool first, second, third, fourth;
+    bool fusedPhaseField, imageGuidedPhaseField, tileable, progressive, screenMappedNoise, contactSheet;
+    ContactSheetSettings contactSheetSettings;
+    bool cpuPreview;
+    bool brushMode;
+    OrientationBrushSettings brushSettings;
+    bool normalMap;
+    float f, b;
+    int ipk;
+    PhaseFieldSettings phaseFieldSettings;
+    DynamicResolutionSettings dynamicResolutionSettings;
+    uint64_t dynamicResolutionResets;
+    bool continuousRedraw;
+    uint64_t statusRequests;
+    int currentVar;
+    glm::mat4 view { 1.0f }, projection { 1.0f };
+    glm::ivec2 windowSize { 0 };
+    bool quit { false }; // Stops the render thread.
+};
+
+static void printHelp();
+static ViewerState currentViewerState();
+static PhasorNoiseParams phasorNoiseParams(const ViewerState& state);
+static SampledOrientation imageOrientationSource(const PhaseField& imageOrientation, const PhasorNoiseParams& params);
+static std::optional<glm::vec2> orientationTexelOfPixel(const glm::mat4& mvp, const glm::vec2& ndc, const SampledOrientation& mapping, bool repeat);
+static std::optional<glm::ivec4> orientationEditScreenRect(const TexelRect& edit, const glm::ivec2& fieldSize, float bandwidth, const glm::mat4& mvp, const glm::ivec2& renderSize);
+static void bakePhasorNoise(const ViewerState& state, const PhaseField& imageOrientation);
+static int runViewer(int argc, char** argv);
+static int renderPlate(int argc, char** argv);
+static void writePhasorNoise(const std::filesystem::path& filePath, const PhasorNoiseParams& params, const OrientationSource& orientation, const PhasorNoiseRegion& region, int bitsPerSample = 8);
 
 // Program entry point. Everything starts here.
 int main(int argc, char** argv)
 {
-    printHelp();
+    // --trace <file.json>: records the CPU zones, render passes and counters of the run (viewer or plate)
+    // and writes them as a Chrome trace (ui.perfetto.dev, chrome://tracing) when the program exits.
+    std::vector<char*> arguments { argv, argv + argc };
+    std::optional<std::filesystem::path> traceFile;
+    if (const auto iter = std::find_if(std::begin(arguments), std::end(arguments), [](const char* argument) { return std::string_view(argument) == "--trace"; });
+        iter != std::end(arguments) && std::next(iter) != std::end(arguments)) {
+        traceFile = *std::next(iter);
+        arguments.erase(iter, std::next(iter, 2));
+        setTraceThreadName("main");
+        startTracing();
+    }
+
+    // Offline rendering of (arbitrarily large) noise plates without opening a window.
+    const int numArguments = static_cast<int>(arguments.size());
+    const int result = numArguments >= 2 && std::string_view(arguments[1]) == "--plate"
+        ? renderPlate(numArguments, arguments.data())
+        : runViewer(numArguments, arguments.data());
+
+    if (traceFile) {
+        stopTracing();
+        writeChromeTrace(*traceFile);
+        std::cout << "Wrote the trace to " << *traceFile << std::endl;
+    }
+    return result;
+}
+
+static int runViewer(int argc, char** argv)
+{
+    // --headless [frames]: draws the given number of frames (1 by default) without a display or window
+    // system and writes the last one to headless.png, e.g. to run the GLSL passes on CI machines.
+    // --benchmark [frames]: replays a scripted timeline of camera poses, parameters and modes (see
+    // benchmarkFrame()) without vsync and writes the percentiles of the frame and pass times to benchmark.json.
+    // --record <file>: writes the input events of the session to the file when the viewer closes.
+    // --replay <file>: feeds a recording to the viewer instead of the real input. Combined with --headless
+    // or --benchmark, the replay replaces the frame count (and the scripted timeline).
+    // --no-render-thread: renders on the input thread, which headless, benchmark and replay runs always do
+    // to keep their frames deterministic.
+    std::optional<int> headlessFrames;
+    std::optional<int> benchmarkFrames;
+    std::optional<std::filesystem::path> recordFile, replayFile;
+    bool renderThreadDisabled = false;
+    std::filesystem::path meshFile = "resources/square_centered.obj";
+    auto parseFrameCount = [&](int& i, int defaultCount) {
+        if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+            return std::max(1, std::atoi(argv[++i]));
+        return defaultCount;
+    };
+    for (int i = 1; i < argc; i++) {
+        if (std::string_view(argv[i]) == "--headless") {
+            headlessFrames = parseFrameCount(i, 1);
+        } else if (std::string_view(argv[i]) == "--benchmark") {
+            benchmarkFrames = parseFrameCount(i, 256 * static_cast<int>(benchmarkScenarios().size()));
+        } else if (std::string_view(argv[i]) == "--record" && i + 1 < argc) {
+            recordFile = argv[++i];
+        } else if (std::string_view(argv[i]) == "--replay" && i + 1 < argc) {
+            replayFile = argv[++i];
+        } else if (std::string_view(argv[i]) == "--no-render-thread") {
+            renderThreadDisabled = true;
+        } else {
+            meshFile = argv[i];
+        }
+    }
+
+    if (!headlessFrames && !benchmarkFrames)
+        printHelp();
+    // Interactive sessions handle the input on this thread and render on another one, so a slow frame
+    // does not hold up the input.
+    const bool renderThread = !headlessFrames && !benchmarkFrames && !replayFile && !renderThreadDisabled;
 
-    Window window { "Shading", glm::ivec2(WIDTH, HEIGHT), OpenGLVersion::GL45 };
+    // Parsing the mesh and the orientation of the image does not need the OpenGL context, so it runs on other
+    // threads while the window is created and the shaders are compiled. The uploads wait for the results.
+    JobFuture<Mesh> meshFuture = jobSystem().async([&meshFile]() { return loadMesh(meshFile)[0]; });
+    // Orientation field that follows the structure of an image (edge tangents of the smoothed structure tensor).
+    JobFuture<PhaseField> imageOrientationFuture = jobSystem().async([]() {
+        return structureTensorOrientation(Image("resources/dog2.png"), StructureTensorSettings {});
+    });
+
+    Window window { "Shading", glm::ivec2(WIDTH, HEIGHT), OpenGLVersion::GL45, headlessFrames ? WindowMode::Headless : WindowMode::Windowed };
     Trackball trackball { &window, glm::radians(50.0f) };
     Trackball trackball2{ &window, glm::radians(50.0f) };
 
-    const Mesh mesh = loadMesh(argc == 2 ? argv[1] : "resources/square_centered.obj")[0];
+    // Nothing in the scene animates, so frames are only drawn when the input or a parameter changed.
+    window.setRedrawMode(RedrawMode::OnDemand);
+    // Scales the internal render resolution to hold the GPU time of the scene at a target frame time.
+    DynamicResolution dynamicResolution;
+    // Passes of every frame are declared in the render graph, which skips passes whose output would not change.
+    RenderGraph renderGraph;
+
+    // Frames of the benchmark are drawn back to back at a fixed resolution.
+    BenchmarkRecorder benchmarkRecorder;
+    GpuTimer benchmarkFrameTimer;
+    int benchmarkFrameIndex = 0;
+    std::chrono::steady_clock::time_point previousFrameEnd;
+    if (benchmarkFrames) {
+        window.setVSync(false);
+        window.setRedrawMode(RedrawMode::Continuous);
+        continuousRedraw = true;
+        dynamicResolutionSettings.enabled = false;
+    }
 
     window.registerKeyCallback([&](int key, int /* scancode */, int action, int /* mods */) {
         if (action != GLFW_RELEASE)
@@ -84,6 +268,14 @@ int main(int argc, char** argv)
             phasorNoise = !phasorNoise;
             break;
         }
+        case GLFW_KEY_2: {
+            fusedPhaseField = !fusedPhaseField;
+            break;
+        }
+        case GLFW_KEY_3: {
+            imageGuidedPhaseField = !imageGuidedPhaseField;
+            break;
+        }
         case GLFW_KEY_5: {
             first = !first;
             break;
@@ -113,6 +305,86 @@ int main(int argc, char** argv)
             currentVar = 4;
             break;
         }
+        case GLFW_KEY_S: {
+            currentVar = 5;
+            break;
+        }
+        case GLFW_KEY_T: {
+            tileable = !tileable;
+            break;
+        }
+        case GLFW_KEY_K: {
+            bakeRequested = true;
+            break;
+        }
+        case GLFW_KEY_G: {
+            progressive = !progressive;
+            break;
+        }
+        case GLFW_KEY_O: {
+            continuousRedraw = !continuousRedraw;
+            // The render thread keeps drawing by itself, so the input thread only has to wake up for events.
+            if (!renderThread)
+                window.setRedrawMode(continuousRedraw ? RedrawMode::Continuous : RedrawMode::OnDemand);
+            break;
+        }
+        case GLFW_KEY_D: {
+            dynamicResolutionSettings.enabled = !dynamicResolutionSettings.enabled;
+            dynamicResolutionResets++;
+            break;
+        }
+        case GLFW_KEY_N: {
+            dynamicResolutionSettings.filter = static_cast<UpscaleFilter>((static_cast<int>(dynamicResolutionSettings.filter) + 1) % 3);
+            break;
+        }
+        case GLFW_KEY_V: {
+            currentVar = 6;
+            break;
+        }
+        case GLFW_KEY_Q: {
+            screenMappedNoise = !screenMappedNoise;
+            break;
+        }
+        case GLFW_KEY_C: {
+            contactSheet = !contactSheet;
+            break;
+        }
+        case GLFW_KEY_H: {
+            contactSheetSettings.columnAxis = static_cast<ContactSheetAxis>((static_cast<int>(contactSheetSettings.columnAxis) + 1) % numContactSheetAxes);
+            break;
+        }
+        case GLFW_KEY_J: {
+            contactSheetSettings.rowAxis = static_cast<ContactSheetAxis>((static_cast<int>(contactSheetSettings.rowAxis) + 1) % numContactSheetAxes);
+            break;
+        }
+        case GLFW_KEY_U: {
+            phaseFieldSettings.bicubic = !phaseFieldSettings.bicubic;
+            break;
+        }
+        case GLFW_KEY_L: {
+            cpuPreview = !cpuPreview;
+            break;
+        }
+        case GLFW_KEY_E: {
+            brushMode = !brushMode;
+            trackball.setRotationEnabled(!brushMode);
+            // The brush paints the orientation of the image guided phase field.
+            if (brushMode)
+                imageGuidedPhaseField = true;
+            break;
+        }
+        case GLFW_KEY_W: {
+            currentVar = 7;
+            break;
+        }
+        case GLFW_KEY_A: {
+            normalMap = !normalMap;
+            break;
+        }
+        case GLFW_KEY_P: {
+            phaseFieldSettings.format = phaseFieldSettings.format == PhaseFieldFormat::R16F ? PhaseFieldFormat::R32F : PhaseFieldFormat::R16F;
+            break;
+        }
         case GLFW_KEY_RIGHT: {
             switch (currentVar) {
             case 2: {
@@ -127,6 +399,18 @@ int main(int argc, char** argv)
                 ipk += 1.0;
                 break;
             }
+            case 5: {
+                phaseFieldSettings.samplesPerKernelRadius += 1.0f;
+                break;
+            }
+            case 6: {
+                dynamicResolutionSettings.targetFrameTime += 1.0f;
+                break;
+            }
+            case 7: {
+                brushSettings.radius += 2.0f;
+                break;
+            }
             default:
                 return;
             };
@@ -146,6 +430,18 @@ int main(int argc, char** argv)
                 ipk -= 1.0;
                 break;
             }
+            case 5: {
+                phaseFieldSettings.samplesPerKernelRadius = std::max(phaseFieldSettings.samplesPerKernelRadius - 1.0f, 1.0f);
+                break;
+            }
+            case 6: {
+                dynamicResolutionSettings.targetFrameTime = std::max(dynamicResolutionSettings.targetFrameTime - 1.0f, 1.0f);
+                break;
+            }
+            case 7: {
+                brushSettings.radius = std::max(brushSettings.radius - 2.0f, 1.0f);
+                break;
+            }
             default:
                 return;
             };
@@ -208,39 +504,22 @@ int main(int argc, char** argv)
             return;
         };
 
-        if (phaseField) {
-            std::cout << "PHASE FIELD!" << std::endl;
-        }
-        else {
-            if (phasorNoise) {
-                std::cout << "PHASOR NOISE!" << std::endl;
-                if (first) {
-                    std::cout << "function 1 ON" << std::endl;
-                }
-                if (second) {
-                    std::cout << "function 2 ON" << std::endl;
-                }
-                if (third) {
-                    std::cout << "function 3 ON" << std::endl;
-                }
-                if (fourth) {
-                    std::cout << "function 4 ON" << std::endl;
-                }
-            }
-        }
-        std::cout << "f = " << f << std::endl;
-        std::cout << "b = " << b << std::endl;
-        std::cout << "ipk = " << ipk << std::endl;
-        std::cout << "current var = " << currentVar << std::endl;
-        std::cout << "__________________" << std::endl;
-        
+        statusRequests++;
     });
 
-    const Shader debugShader = ShaderBuilder().addStage(GL_VERTEX_SHADER, "shaders/vertex.glsl").addStage(GL_FRAGMENT_SHADER, "shaders/debug_frag.glsl").build();
-    const Shader phasorNoiseShader = ShaderBuilder().addStage(GL_VERTEX_SHADER, "shaders/vertex.glsl").addStage(GL_FRAGMENT_SHADER, "shaders/phasor_noise.glsl").build();
-    const Shader bufferAShader = ShaderBuilder().addStage(GL_VERTEX_SHADER, "shaders/vertex.glsl").addStage(GL_FRAGMENT_SHADER, "shaders/phase_field.glsl").build();
+    // All programs are submitted before the first one is waited for, so drivers with parallel shader
+    // compilation build them at the same time (and while the buffers below are uploaded).
+    PendingShader pendingDebugShader = ShaderBuilder().addStage(GL_VERTEX_SHADER, "shaders/vertex.glsl").addStage(GL_FRAGMENT_SHADER, "shaders/debug_frag.glsl").buildAsync();
+    PendingShader pendingPhasorNoiseShader = ShaderBuilder().addStage(GL_VERTEX_SHADER, "shaders/vertex.glsl").addStage(GL_FRAGMENT_SHADER, "shaders/phasor_noise.glsl").buildAsync();
+    PendingShader pendingBufferAShader = ShaderBuilder().addStage(GL_VERTEX_SHADER, "shaders/vertex.glsl").addStage(GL_FRAGMENT_SHADER, "shaders/phase_field.glsl").buildAsync();
+    PendingShader pendingPhasorNoiseScreenShader = ShaderBuilder().addStage(GL_VERTEX_SHADER, "shaders/screen_vertex.glsl").addStage(GL_FRAGMENT_SHADER, "shaders/phasor_noise.glsl").buildAsync();
+    PendingShader pendingPhaseFieldScreenShader = ShaderBuilder().addStage(GL_VERTEX_SHADER, "shaders/screen_vertex.glsl").addStage(GL_FRAGMENT_SHADER, "shaders/phase_field.glsl").buildAsync();
+    PendingShader pendingPhasorNoiseSwatchShader = ShaderBuilder().addStage(GL_VERTEX_SHADER, "shaders/swatch_vertex.glsl").addStage(GL_FRAGMENT_SHADER, "shaders/phasor_noise.glsl").buildAsync();
+    PendingShader pendingPhaseFieldSwatchShader = ShaderBuilder().addStage(GL_VERTEX_SHADER, "shaders/swatch_vertex.glsl").addStage(GL_FRAGMENT_SHADER, "shaders/phase_field.glsl").buildAsync();
+    PendingShader pendingUpscaleShader = ShaderBuilder().addStage(GL_VERTEX_SHADER, "shaders/fullscreen_vertex.glsl").addStage(GL_FRAGMENT_SHADER, "shaders/upscale.glsl").buildAsync();
 
     // Create Vertex Buffer Object and Index Buffer Objects.
+    const Mesh mesh = meshFuture.get();
     GLuint vbo;
     glCreateBuffers(1, &vbo);
     glNamedBufferStorage(vbo, static_cast<GLsizeiptr>(mesh.vertices.size() * sizeof(Vertex)), mesh.vertices.data(), 0);
@@ -265,157 +544,871 @@ int main(int argc, char** argv)
     glEnableVertexArrayAttrib(vao, 0);
     glEnableVertexArrayAttrib(vao, 1);    
 
-    GLuint framebufferTexture;     // actual texture
-    glCreateTextures(GL_TEXTURE_2D, 1, &framebufferTexture);            // create a 2d texture for the framebufferTexture
-    glTextureStorage2D(framebufferTexture, 1, GL_RGB8, WIDTH, HEIGHT);  // It has 3 chanels and width heigt
+    // The scene is rendered into the lower left renderResolution() pixels of this target and then upscaled
+    // to the window, so a change of the render resolution does not reallocate anything.
+    RenderTarget sceneTarget;
+    sceneTarget.resize(glm::max(window.getWindowSize(), glm::ivec2(1)));
+
+    // Float targets in which the complex noise is accumulated over several frames in progressive mode.
+    ProgressiveRefinement progressiveRefinement;
+
+    // Single channel float target of the phase field pass. Its resolution follows b (see phaseFieldResolution).
+    PhaseFieldTarget phaseFieldTarget;
+    // The target covers the [0, 1] x [-1, 1] part of the square that the (mirrored) noise samples, like the
+    // image orientation. The orthographic projection looks at it from -z like the default camera, so the
+    // full screen pass sees the same face as the phase field view.
+    const glm::mat4 phaseFieldDomain = glm::ortho(0.0f, 1.0f, -1.0f, 1.0f, 1.0f, -1.0f);
+    constexpr float phaseFieldExtent = 2.0f;
+
+    // Per-swatch parameters of the contact sheet and the phase field atlas (one tile per distinct b, ipk
+    // and period), drawn with attribute-less instanced draws.
+    GLuint swatchBuffer, phaseFieldTileBuffer, swatchVao;
+    glCreateBuffers(1, &swatchBuffer);
+    glCreateBuffers(1, &phaseFieldTileBuffer);
+    glCreateVertexArrays(1, &swatchVao);
+    uint64_t uploadedSwatches = 0;
+    RenderTarget phaseFieldAtlas;
+    GLint maxTextureSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
 
-    glTextureParameteri(framebufferTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);    // Set the clamping mode
-    glTextureParameteri(framebufferTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    PhaseField imageOrientation = imageOrientationFuture.get();
+    GLuint imageOrientationTexture;
+    glCreateTextures(GL_TEXTURE_2D, 1, &imageOrientationTexture);
+    glTextureStorage2D(imageOrientationTexture, 1, GL_R32F, imageOrientation.width, imageOrientation.height);
+    glTextureSubImage2D(imageOrientationTexture, 0, 0, 0, imageOrientation.width, imageOrientation.height, GL_RED, GL_FLOAT, imageOrientation.values.data());
+    // Axial orientations cannot be filtered by the hardware, the shader unwraps and filters the texels itself.
+    glTextureParameteri(imageOrientationTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(imageOrientationTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTextureParameteri(imageOrientationTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(imageOrientationTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    GLuint fbo;     // frame buffer for the extra texture
-    glCreateFramebuffers(1, &fbo);
-    glNamedFramebufferTexture(fbo, GL_COLOR_ATTACHMENT0, framebufferTexture, 0);    // Atach this frame buffer to the texture
+    // The brush paints into paintedOrientation on the input thread. At the start of a frame the renderer copies
+    // the painted texels into imageOrientation (which the CPU preview reads) and uploads them to the texture.
+    PhaseField paintedOrientation = imageOrientation;
+    std::mutex orientationEditMutex;
+    TexelRect pendingOrientationEdit; // Guarded by orientationEditMutex.
+    uint64_t orientationGeneration = 0; // Content hash of the texture, incremented by every upload.
+    // Cursor position of the previous event of the stroke (in texels of the orientation).
+    std::optional<glm::vec2> brushPosition;
+    auto cursorTexel = [&]() {
+        const glm::vec2 ndc = window.getCursorPixel() / glm::vec2(glm::max(window.getWindowSize(), glm::ivec2(1))) * 2.0f - 1.0f;
+        const PhasorNoiseParams params = phasorNoiseParams(currentViewerState());
+        return orientationTexelOfPixel(trackball.projectionMatrix() * trackball.viewMatrix(), ndc, imageOrientationSource(paintedOrientation, params), params.period > 0);
+    };
+    window.registerMouseButtonCallback([&](int button, int action, int /* mods */) {
+        if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+            brushPosition = cursorTexel();
+    });
+    window.registerMouseMoveCallback([&](const glm::vec2& /* cursorPos */) {
+        if (!brushMode || !window.isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT))
+            return;
+        const std::optional<glm::vec2> texel = cursorTexel();
+        if (brushPosition && texel) {
+            std::scoped_lock lock { orientationEditMutex };
+            pendingOrientationEdit = pendingOrientationEdit.united(paintOrientation(paintedOrientation, *brushPosition, *texel, brushSettings));
+        }
+        brushPosition = texel;
+    });
+
+    const Shader debugShader = pendingDebugShader.get();
+    const Shader phasorNoiseShader = pendingPhasorNoiseShader.get();
+    const Shader bufferAShader = pendingBufferAShader.get();
+    const Shader phasorNoiseScreenShader = pendingPhasorNoiseScreenShader.get();
+    const Shader phaseFieldScreenShader = pendingPhaseFieldScreenShader.get();
+    const Shader phasorNoiseSwatchShader = pendingPhasorNoiseSwatchShader.get();
+    const Shader phaseFieldSwatchShader = pendingPhaseFieldSwatchShader.get();
+    const Shader upscaleShader = pendingUpscaleShader.get();
   
     // Enable depth testing.
-    glEnable(GL_DEPTH_TEST);
+    glState().depth(true, GL_LEQUAL, true);
 
     const glm::mat4 oldView = trackball.viewMatrix();
 
-    // Main loop.
-    while (!window.shouldClose()) {
-        window.updateInput();
+    // The first recorded frame is the first frame of the main loop.
+    if (replayFile)
+        window.replay(loadInputRecording(*replayFile));
+    if (recordFile)
+        window.startRecording();
 
-        // Clear the framebuffer to black and depth to maximum value (ranges from [-1.0 to +1.0]).
-        glViewport(0, 0, window.getWindowSize().x, window.getWindowSize().y);
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // The CPU preview covers the noise domain of the bake. A change of the parameters cancels the stale render
+    // and the tiles of the current one are uploaded (on the thread with the context) as they finish.
+    std::unique_ptr<TileRenderJob> pCpuPreviewJob;
+    // The image guided preview keeps its impulses instead, so a brush stroke only re-evaluates and uploads the
+    // tiles that the stroke reaches. cpuPreviewUpdate evaluates the dirty tiles and then uploads them.
+    std::unique_ptr<IncrementalPhasorNoise> pIncrementalPreview;
+    JobHandle cpuPreviewUpdate;
+    CancellationToken cpuPreviewCancellation;
+    uint64_t cpuPreviewSignature = 0;
+    uint64_t cpuPreviewGeneration = 0; // Uploads of older renders are dropped.
+    int cpuPreviewUploads = 0;
+    GLuint cpuPreviewTexture = 0;
+    glm::ivec2 cpuPreviewSize { 0 };
+    auto stopCpuPreview = [&]() {
+        pCpuPreviewJob.reset();
+        if (cpuPreviewUpdate.valid()) {
+            cpuPreviewCancellation.cancel();
+            cpuPreviewUpdate.wait();
+            cpuPreviewUpdate = {};
+        }
+        pIncrementalPreview.reset();
+    };
+    auto cpuPreviewUpdating = [&]() {
+        return cpuPreviewUpdate.valid() && !cpuPreviewUpdate.isDone();
+    };
+    // Evaluates the dirty tiles of the image guided preview in the background and uploads them afterwards.
+    auto startIncrementalUpdate = [&]() {
+        cpuPreviewCancellation = CancellationToken::create();
+        auto pTiles = std::make_shared<std::vector<glm::ivec2>>();
+        const JobHandle update = jobSystem().submit([&, pTiles, cancellation = cpuPreviewCancellation]() {
+            *pTiles = pIncrementalPreview->update(cancellation);
+        },
+            {}, JobAffinity::Any, JobPriority::High);
+        cpuPreviewUpdate = jobSystem().then(update, [&, pTiles, cancellation = cpuPreviewCancellation]() {
+            if (cancellation.isCancelled())
+                return;
+            const NoiseImage& image = pIncrementalPreview->image();
+            const int previewTileSize = pIncrementalPreview->tileSize();
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, image.width);
+            for (const glm::ivec2& tile : *pTiles) {
+                const glm::ivec2 begin = tile * previewTileSize;
+                const glm::ivec2 end = glm::min(begin + previewTileSize, glm::ivec2(image.width, image.height));
+                const size_t firstPixel = static_cast<size_t>(begin.y) * static_cast<size_t>(image.width) + static_cast<size_t>(begin.x);
+                glTextureSubImage2D(cpuPreviewTexture, 0, begin.x, begin.y, end.x - begin.x, end.y - begin.y, GL_RED, GL_FLOAT, image.pixels.data() + firstPixel);
+            }
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            cpuPreviewUploads++;
+        },
+            JobAffinity::MainThread);
+    };
+    // Starts a render of the CPU preview when the parameters or the size changed.
+    auto updateCpuPreview = [&](const ViewerState& state, const glm::ivec2& size) {
+        Hasher signature;
+        const PhasorNoiseParams params = phasorNoiseParams(state);
+        signature.add(params.f);
+        signature.add(params.b);
+        signature.add(params.impulsesPerKernel);
+        signature.add(params.profiles);
+        signature.add(params.period);
+        signature.add(state.imageGuidedPhaseField);
+        signature.add(size);
+        if ((pCpuPreviewJob || pIncrementalPreview) && signature.hash() == cpuPreviewSignature) {
+            if (pIncrementalPreview && !cpuPreviewUpdating() && pIncrementalPreview->hasDirtyTiles())
+                startIncrementalUpdate();
+            return;
+        }
+
+        stopCpuPreview();
+        cpuPreviewSignature = signature.hash();
+        cpuPreviewGeneration++;
+        cpuPreviewUploads = 0;
+        if (size != cpuPreviewSize) {
+            renderGraph.invalidate(cpuPreviewTexture);
+            glState().textureDeleted(cpuPreviewTexture);
+            glDeleteTextures(1, &cpuPreviewTexture);
+            glCreateTextures(GL_TEXTURE_2D, 1, &cpuPreviewTexture);
+            glTextureStorage2D(cpuPreviewTexture, 1, GL_R32F, size.x, size.y);
+            // Grayscale when it is sampled like the colour of the scene.
+            const GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+            glTextureParameteriv(cpuPreviewTexture, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+            cpuPreviewSize = size;
+        }
+        const float black = 0.0f;
+        glClearTexImage(cpuPreviewTexture, 0, GL_RED, GL_FLOAT, &black);
+
+        // Square pixels over [0, 1] x [-1, 1]; row 0 of the texture is y = -1 like in the phase field domain.
+        if (state.imageGuidedPhaseField) {
+            const PhasorNoiseRegion region { glm::vec2(0.0f, -1.0f), glm::vec2(1.0f, 2.0f), size.x, size.y };
+            pIncrementalPreview = std::make_unique<IncrementalPhasorNoise>(params, imageOrientationSource(imageOrientation, params), region, 64);
+            startIncrementalUpdate();
+            return;
+        }
+        const TileGrid grid { glm::vec2(0.0f, -1.0f), glm::vec2(1.0f, 2.0f) / glm::vec2(size), 64 };
+        pCpuPreviewJob = std::make_unique<TileRenderJob>(params, ProceduralOrientation {}, grid, size, TileOrder { .focus = glm::vec2(size) * 0.5f }, JobPriority::High,
+            [&, generation = cpuPreviewGeneration](const RenderedTile& tile) {
+                jobSystem().submit([&, generation, tile]() {
+                    if (generation != cpuPreviewGeneration)
+                        return;
+                    glTextureSubImage2D(cpuPreviewTexture, 0, tile.pixelBegin.x, tile.pixelBegin.y, tile.image.width, tile.image.height, GL_RED, GL_FLOAT, tile.image.pixels.data());
+                    cpuPreviewUploads++;
+                },
+                    {}, JobAffinity::MainThread);
+            });
+    };
+
+    std::optional<BenchmarkFrame> benchmarkStep;
+    uint64_t appliedDynamicResolutionResets = 0;
+    // Signature of the phasor noise in the scene target (and the render size) when the last frame drew it in
+    // full screen. Brush strokes only re-render the pixels that they affect over it.
+    std::optional<uint64_t> sceneNoiseSignature;
+    uint64_t printedStatusRequests = 0;
+    auto printStatus = [&](const ViewerState& state) {
+        if (state.phaseField) {
+            std::cout << "PHASE FIELD!" << std::endl;
+        }
+        else {
+            if (state.phasorNoise) {
+                std::cout << "PHASOR NOISE!" << std::endl;
+                if (state.fusedPhaseField) {
+                    std::cout << "fused phase field ON" << std::endl;
+                }
+                if (state.imageGuidedPhaseField) {
+                    std::cout << "image guided phase field ON" << std::endl;
+                }
+                if (state.brushMode) {
+                    std::cout << "orientation brush ON (radius of " << state.brushSettings.radius << " texels)" << std::endl;
+                }
+                if (state.progressive) {
+                    std::cout << "progressive refinement ON" << (state.normalMap ? " (paused by the normal map)" : "") << std::endl;
+                }
+                if (state.normalMap) {
+                    std::cout << "normal map ON" << std::endl;
+                }
+                if (state.tileable) {
+                    std::cout << "tileable ON (period of " << periodInCells(tileSize, state.b) << " cells)" << std::endl;
+                }
+                if (state.cpuPreview) {
+                    std::cout << "CPU preview ON";
+                    if (pCpuPreviewJob)
+                        std::cout << " (" << pCpuPreviewJob->numPublished() << " / " << pCpuPreviewJob->numTiles() << " tiles)";
+                    else if (pIncrementalPreview)
+                        std::cout << " (" << pIncrementalPreview->numTiles().x * pIncrementalPreview->numTiles().y << " tiles, " << (cpuPreviewUpdating() ? "updating" : "up to date") << ")";
+                    std::cout << std::endl;
+                }
+                if (state.contactSheet) {
+                    std::cout << "contact sheet ON (" << axisName(state.contactSheetSettings.columnAxis) << " along the columns, "
+                              << axisName(state.contactSheetSettings.rowAxis) << " along the rows)" << std::endl;
+                }
+                if (state.first) {
+                    std::cout << "function 1 ON" << std::endl;
+                }
+                if (state.second) {
+                    std::cout << "function 2 ON" << std::endl;
+                }
+                if (state.third) {
+                    std::cout << "function 3 ON" << std::endl;
+                }
+                if (state.fourth) {
+                    std::cout << "function 4 ON" << std::endl;
+                }
+            }
+        }
+        std::cout << "f = " << state.f << std::endl;
+        std::cout << "b = " << state.b << std::endl;
+        std::cout << "ipk = " << state.ipk << std::endl;
+        std::cout << "phase field: " << (state.phaseFieldSettings.format == PhaseFieldFormat::R16F ? "R16F" : "R32F")
+                  << ", " << state.phaseFieldSettings.samplesPerKernelRadius << " samples per kernel radius"
+                  << (state.phaseFieldSettings.bicubic ? ", bicubic" : ", bilinear") << std::endl;
+        constexpr const char* upscaleFilterNames[] = { "nearest", "bilinear", "bicubic" };
+        std::cout << "dynamic resolution: " << (dynamicResolution.settings.enabled ? "ON" : "OFF")
+                  << ", scale " << dynamicResolution.scale() << ", target " << dynamicResolution.settings.targetFrameTime << " ms"
+                  << ", " << upscaleFilterNames[static_cast<int>(dynamicResolution.settings.filter)] << " upscaling" << std::endl;
+        for (const PassStatistics& pass : renderGraph.statistics())
+            std::cout << "pass " << pass.name << ": " << pass.gpuTime << " ms, " << pass.executed << " executed, " << pass.skipped << " skipped" << std::endl;
+        for (int kind = 0; kind < static_cast<int>(GLStateKind::Count); kind++) {
+            const GLStateCounters counters = glState().counters(static_cast<GLStateKind>(kind));
+            std::cout << "GL " << GLState::name(static_cast<GLStateKind>(kind)) << " changes: " << counters.issued << " issued, " << counters.skipped << " redundant" << std::endl;
+        }
+        std::cout << "current var = " << state.currentVar << std::endl;
+        std::cout << "__________________" << std::endl;
+    };
+    // Draws a frame of the state and returns whether another frame should follow even if the state does not
+    // change (while the progressive refinement converges or the dynamic resolution adapts). It only touches
+    // the renderer, so it can run on the render thread while this thread handles the input.
+    auto renderFrame = [&](const ViewerState& state) {
+        bool redraw = false;
+        dynamicResolution.settings = state.dynamicResolutionSettings;
+        if (state.dynamicResolutionResets != appliedDynamicResolutionResets) {
+            dynamicResolution.reset();
+            appliedDynamicResolutionResets = state.dynamicResolutionResets;
+        }
+        // The new textures can get the names of the old ones, so the render graph has to forget those first.
+        // A minimized window has a size of 0.
+        const GLuint oldSceneTextures[] = { sceneTarget.colorTexture(), sceneTarget.depthTexture() };
+        if (sceneTarget.resize(glm::max(state.windowSize, glm::ivec2(1)))) {
+            for (const GLuint texture : oldSceneTextures)
+                renderGraph.invalidate(texture);
+            dynamicResolution.reset();
+            sceneNoiseSignature.reset();
+        }
+        const std::optional<uint64_t> previousSceneNoise = std::exchange(sceneNoiseSignature, std::nullopt);
+
+        // Uploads the texels that the brush painted since the last frame. The image guided CPU preview reads
+        // imageOrientation while it updates, so the texels wait for the update.
+        TexelRect orientationEdit;
+        if (cpuPreviewUpdating()) {
+            redraw = true;
+        } else {
+            std::scoped_lock lock { orientationEditMutex };
+            orientationEdit = std::exchange(pendingOrientationEdit, TexelRect {});
+        }
+        if (!orientationEdit.empty()) {
+            const glm::ivec2 editSize = orientationEdit.end - orientationEdit.begin;
+            const size_t firstTexel = static_cast<size_t>(orientationEdit.begin.y) * static_cast<size_t>(imageOrientation.width) + static_cast<size_t>(orientationEdit.begin.x);
+            {
+                std::scoped_lock lock { orientationEditMutex };
+                for (int y = 0; y < editSize.y; y++) {
+                    const size_t rowBegin = firstTexel + static_cast<size_t>(y) * static_cast<size_t>(imageOrientation.width);
+                    std::copy_n(std::begin(paintedOrientation.values) + static_cast<ptrdiff_t>(rowBegin), editSize.x, std::begin(imageOrientation.values) + static_cast<ptrdiff_t>(rowBegin));
+                }
+            }
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, imageOrientation.width);
+            glTextureSubImage2D(imageOrientationTexture, 0, orientationEdit.begin.x, orientationEdit.begin.y, editSize.x, editSize.y, GL_RED, GL_FLOAT, imageOrientation.values.data() + firstTexel);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            orientationGeneration++;
+            if (pIncrementalPreview)
+                pIncrementalPreview->orientationChanged(orientationEdit.begin, orientationEdit.end);
+        }
+
+        const glm::ivec2 windowSize = state.windowSize;
+        const glm::ivec2 renderSize = dynamicResolution.renderResolution(windowSize);
 
         // Set model/view/projection matrix.
         const glm::vec3 cameraPos = glm::vec3(5.0f, 0.0f, 0.0f);
         const glm::mat4 model { 1.0f };
-        const glm::mat4 view = trackball.viewMatrix();
-        const glm::mat4 projection = trackball.projectionMatrix();
+        const glm::mat4 view = state.view;
+        const glm::mat4 projection = state.projection;
         glm::mat4 mvp = projection * view * model;
+        const int period = state.tileable ? periodInCells(tileSize, state.b) : 0;
 
-        bool renderedSomething = false;
         auto render = [&]() {
-            renderedSomething = true;
-
             // Set the model/view/projection matrix that is used to transform the vertices in the vertex shader.
-            glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(mvp));
+            glState().uniformMatrix4(0, mvp);
 
             // Bind vertex data.
-            glBindVertexArray(vao);
+            glState().bindVertexArray(vao);
 
             // Execute draw command.
             glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh.triangles.size()) * 3, GL_UNSIGNED_INT, nullptr);
         };
 
-        if (!debug) {
-            // Draw mesh into depth buffer but disable color writes.
-            glDepthMask(GL_TRUE);
-            glDepthFunc(GL_LEQUAL);
-            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-            debugShader.bind();
-            render();
+        renderGraph.beginFrame();
+        const RenderGraphTexture sceneColor = renderGraph.importTexture("scene colour", sceneTarget.colorTexture(), { sceneTarget.size(), GL_RGBA8 });
+        const RenderGraphTexture sceneDepth = renderGraph.importTexture("scene depth", sceneTarget.depthTexture(), { sceneTarget.size(), GL_DEPTH_COMPONENT32F });
+        // Clear the framebuffer to black and depth to maximum value.
+        const Attachment clearSceneColor { sceneColor, LoadOp::Clear, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) };
+        const Attachment clearSceneDepth { sceneDepth, LoadOp::Clear, glm::vec4(1.0f) };
+        Hasher cameraSignature;
+        cameraSignature.add(mvp);
 
-            // Draw the mesh again for each light / shading model.
-            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE); // Enable color writes.
-            glDepthMask(GL_FALSE); // Disable depth writes.
-            glDepthFunc(GL_EQUAL); // Only draw a pixel if it's depth matches the value stored in the depth buffer.
-            glEnable(GL_BLEND); // Enable blending.
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE); // Additive blending.
+        // Pass whose GPU time drives the dynamic resolution.
+        std::string_view scenePass = "debug";
+        bool partialScene = false; // The scene pass only re-renders a scissor rectangle.
+        std::optional<ProgressiveStep> progressiveStep;
+        GLuint progressiveTexture = 0;
 
-            renderedSomething = false;
-            if (!renderedSomething) {
+        auto setPhasorNoiseUniforms = [&]() {
+            // texture from framebuffer
+            glState().bindTextureUnit(0, phaseFieldTarget.texture());
+            glUniform1i(2, 0);
+            glState().bindTextureUnit(1, imageOrientationTexture);
+            glUniform1i(3, 1);
+            glUniform1f(12, state.f);
+            glUniform1f(13, state.b);
+            glUniform1i(14, state.ipk);
+            glUniform1i(15, period);
+            glUniform1i(31, state.first);
+            glUniform1i(32, state.second);
+            glUniform1i(33, state.third);
+            glUniform1i(34, state.fourth);
+            glUniform1i(35, state.fusedPhaseField);
+            glUniform1i(36, state.phaseFieldSettings.bicubic);
+            glUniform1i(37, state.imageGuidedPhaseField);
+            glUniform1i(38, 0);
+            glUniform1i(39, state.ipk + 1);
+            glUniform1i(40, false);
+            glUniform1i(41, false);
+            glUniform1i(52, state.normalMap);
+            glUniform1f(53, bumpSlope);
+            glUniform1f(54, imageOrientation.period);
+        };
+        const GLenum phaseFieldFormat = state.phaseFieldSettings.format == PhaseFieldFormat::R16F ? GL_R16F : GL_R32F;
+        // The accumulation textures only hold the complex noise, not its derivatives.
+        const bool progressiveNoise = state.progressive && !state.normalMap;
 
+        if (state.debug || (!state.phaseField && !state.phasorNoise)) {
+            renderGraph.addPass({ .name = "debug", .colorAttachments = { clearSceneColor }, .depthAttachment = clearSceneDepth, .viewportSize = renderSize, .signature = cameraSignature.hash() },
+                [&]() {
+                    debugShader.bind();
+                    render();
+                });
+        } else if (state.cpuPreview && !state.phaseField) {
+            // Pixels of about the size of those of the window.
+            updateCpuPreview(state, glm::ivec2(std::max(windowSize.y / 2, 1), std::max(windowSize.y, 1)));
+            Hasher uploads;
+            uploads.add(cpuPreviewGeneration);
+            uploads.add(cpuPreviewUploads);
+            const RenderGraphTexture preview = renderGraph.importTexture("cpu preview", cpuPreviewTexture, { cpuPreviewSize, GL_R32F }, uploads.hash());
+            Hasher signature;
+            signature.add(renderSize);
+            scenePass = "cpu preview";
+            renderGraph.addFullscreenPass({ .name = "cpu preview", .colorAttachments = { clearSceneColor }, .reads = { preview }, .viewportSize = renderSize, .signature = signature.hash() },
+                [&]() {
+                    upscaleShader.bind();
+                    glState().bindTextureUnit(0, cpuPreviewTexture);
+                    glUniform1i(0, 0);
+                    glUniform2iv(1, 1, glm::value_ptr(cpuPreviewSize));
+                    glUniform1i(2, static_cast<int>(UpscaleFilter::Bilinear));
+                });
+            // Keep drawing frames until the last tile was uploaded.
+            if (pCpuPreviewJob ? !pCpuPreviewJob->isDone() || cpuPreviewUploads < pCpuPreviewJob->numPublished() : cpuPreviewUpdating())
+                redraw = true;
+        } else if (state.contactSheet && !state.phaseField) {
+            // All swatches are drawn with one instanced draw. Their parameters come from swatchBuffer and
+            // swatches with equal b, ipk and period share a tile of the phase field atlas.
+            const ContactSheet sheet = makeContactSheet(state.contactSheetSettings, phasorNoiseParams(state), state.tileable ? tileSize : 0.0f);
+            const int numSwatches = static_cast<int>(sheet.swatches.size());
+            const int numTiles = static_cast<int>(sheet.phaseFieldTiles.size());
+            // The tiles follow from the swatches, so they only change together.
+            Hasher swatchesSignature;
+            swatchesSignature.addBytes(sheet.swatches.data(), sheet.swatches.size() * sizeof(GPUSwatch));
+            if (swatchesSignature.hash() != uploadedSwatches) {
+                glNamedBufferData(swatchBuffer, static_cast<GLsizeiptr>(sheet.swatches.size() * sizeof(GPUSwatch)), sheet.swatches.data(), GL_STATIC_DRAW);
+                glNamedBufferData(phaseFieldTileBuffer, static_cast<GLsizeiptr>(sheet.phaseFieldTiles.size() * sizeof(GPUPhaseFieldTile)), sheet.phaseFieldTiles.data(), GL_STATIC_DRAW);
+                uploadedSwatches = swatchesSignature.hash();
+            }
 
-                // ------------------------------------------------- this is useful
+            std::vector<RenderGraphTexture> sheetInputs;
+            if (!state.fusedPhaseField && !state.imageGuidedPhaseField) {
+                // All tiles get the resolution that the largest b needs.
+                float maxB = 0.0f;
+                for (const GPUPhaseFieldTile& tile : sheet.phaseFieldTiles)
+                    maxB = std::max(maxB, tile.b);
+                const int tileRes = phaseFieldResolution(maxB, phaseFieldExtent, state.phaseFieldSettings, std::min(std::max(windowSize.x, windowSize.y), maxTextureSize / numTiles));
+                const glm::ivec2 atlasSize { numTiles * tileRes, tileRes };
+                const GLuint oldAtlasTextures[] = { phaseFieldAtlas.colorTexture(), phaseFieldAtlas.depthTexture() };
+                if (phaseFieldAtlas.resize(atlasSize, phaseFieldFormat)) {
+                    for (const GLuint texture : oldAtlasTextures)
+                        renderGraph.invalidate(texture);
+                }
+                const RenderGraphTexture atlas = renderGraph.importTexture("phase field atlas", phaseFieldAtlas.colorTexture(), { atlasSize, phaseFieldFormat });
+                sheetInputs.push_back(atlas);
 
-                if (phaseField) {
+                Hasher signature;
+                signature.addBytes(sheet.phaseFieldTiles.data(), sheet.phaseFieldTiles.size() * sizeof(GPUPhaseFieldTile));
+                renderGraph.addPass({ .name = "phase field atlas", .colorAttachments = { { atlas, LoadOp::Clear } }, .state = { .depthTest = false }, .signature = signature.hash() },
+                    [&, numTiles]() {
+                        phaseFieldSwatchShader.bind();
+                        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, phaseFieldTileBuffer);
+                        glUniform1i(45, true);
+                        // One row of tiles that covers the [0, 1] x [-1, 1] domain of the phase field target.
+                        glUniform2i(46, numTiles, 1);
+                        glUniform4f(47, -1.0f, -1.0f, 1.0f, 1.0f);
+                        glUniform2f(48, 0.0f, -1.0f);
+                        glUniform2f(49, 1.0f, 1.0f);
+                        glUniform1f(50, 0.0f);
+                        glState().bindVertexArray(swatchVao);
+                        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, numTiles);
+                    });
+            }
+            if (state.imageGuidedPhaseField)
+                sheetInputs.push_back(renderGraph.importTexture("image orientation", imageOrientationTexture, { glm::ivec2(imageOrientation.width, imageOrientation.height), GL_R32F }, orientationGeneration));
 
-                    bufferAShader.bind();
-                    glUniform1f(13, b);
-                    glUniform1i(14, ipk);
-                    render();
+            const glm::vec4 sheetRect = contactSheetRect(state.contactSheetSettings, renderSize);
+            Hasher signature = swatchesSignature;
+            signature.add(sheetRect);
+            for (const bool option : { state.fusedPhaseField, state.phaseFieldSettings.bicubic, state.imageGuidedPhaseField, state.normalMap })
+                signature.add(option);
+            scenePass = "contact sheet";
+            renderGraph.addPass({ .name = "contact sheet", .colorAttachments = { clearSceneColor }, .reads = sheetInputs, .viewportSize = renderSize, .state = { .depthTest = false }, .signature = signature.hash() },
+                [&, numSwatches, numTiles, sheetRect]() {
+                    phasorNoiseSwatchShader.bind();
+                    setPhasorNoiseUniforms();
+                    glState().bindTextureUnit(0, phaseFieldAtlas.colorTexture());
+                    // The swatches have their own number of impulses per kernel.
+                    glUniform1i(39, std::numeric_limits<int>::max());
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, swatchBuffer);
+                    glUniform1i(45, true);
+                    glUniform2i(46, state.contactSheetSettings.columns, state.contactSheetSettings.rows);
+                    glUniform4fv(47, 1, glm::value_ptr(sheetRect));
+                    glUniform2f(48, -1.0f, -1.0f);
+                    glUniform2f(49, 1.0f, 1.0f);
+                    glUniform1f(50, 0.02f);
+                    glUniform1i(51, numTiles);
+                    glState().bindVertexArray(swatchVao);
+                    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, numSwatches);
+                });
+        } else {
+            cameraSignature.add(state.screenMappedNoise);
+            if (!state.screenMappedNoise) {
+                // Draw mesh into depth buffer but disable color writes.
+                renderGraph.addPass({ .name = "depth prepass", .colorAttachments = { clearSceneColor }, .depthAttachment = clearSceneDepth, .viewportSize = renderSize, .state = { .colorWrite = false }, .signature = cameraSignature.hash() },
+                    [&]() {
+                        debugShader.bind();
+                        render();
+                    });
+            }
+
+            // The full screen path shades every pixel of the square once, straight into the cleared target.
+            // The mesh path draws the mesh again, only where its depth matches the depth buffer (no depth
+            // writes) and with additive blending.
+            const PassState additive { .depthFunc = GL_EQUAL, .depthWrite = false, .blend = BlendState { GL_SRC_ALPHA, GL_ONE } };
+            // With a scissor rectangle the full screen path only shades those pixels over the current contents,
+            // which then match the full pass, so the next frame can skip it.
+            auto addScenePass = [&](std::string name, std::vector<RenderGraphTexture> reads, uint64_t signature, const Shader& meshShader, const Shader& screenShader, std::function<void()> setUniforms,
+                                    std::optional<glm::ivec4> scissor = {}) {
+                if (state.screenMappedNoise) {
+                    const Attachment color = scissor ? Attachment { sceneColor, LoadOp::Update, clearSceneColor.clearValue } : clearSceneColor;
+                    renderGraph.addFullscreenPass({ .name = std::move(name), .colorAttachments = { color }, .reads = std::move(reads), .viewportSize = renderSize, .state = { .scissor = scissor }, .signature = signature },
+                        [&, setUniforms]() {
+                            screenShader.bind();
+                            setUniforms();
+                            glUniform1i(44, true);
+                            glState().uniformMatrix4(0, mvp);
+                        });
+                } else {
+                    renderGraph.addPass({ .name = std::move(name), .colorAttachments = { { sceneColor } }, .depthAttachment = Attachment { sceneDepth }, .reads = std::move(reads), .viewportSize = renderSize, .state = additive, .signature = signature },
+                        [&, setUniforms]() {
+                            meshShader.bind();
+                            setUniforms();
+                            render();
+                        });
                 }
+            };
 
-                
-                else {
-                    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-
-                    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-                    glViewport(0, 0, WIDTH, HEIGHT);
-
-                    bufferAShader.bind();
-
-                    glUniform1f(13, b);
-                    glUniform1i(14, ipk);
-                    glm::mat4 mvp2 = glm::mat4(-2.15, 0, 0, 0,
-                        0, 2.15, 0, 0,
-                        0, 0, 1, 1,
-                        -1.75, -3.86, 4, 4);
-                    //const glm::mat4 lightMVP = glm::mat4(-2.14451, 0, 0, 1.02936,
-                    //    0, 2.14451, 0, -1.0937,
-                    //    0, 0, 1.0002, 1.4803,
-                    //    0, 0, 1, 1); // this was kinda close to letting the existing cube fill the screen but not quite good
-
-                    //const glm::mat4 view2 = trackball2.viewMatrix();
-                    //glm::mat4 mvp2 = projection * view2 * model;
-                    glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(mvp2));
-
-                    // Bind vertex data. would be nicer to directly draw a quad in view space if i know how to open gl
-                    glBindVertexArray(vao);
-
-                    // Execute draw command to render the cube to the texture.
-                    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh.triangles.size()) * 3, GL_UNSIGNED_INT, nullptr);
-
-                    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-
-                    if (phasorNoise) {
-                        phasorNoiseShader.bind();
-
-                        // texture from framebuffer
-                        glActiveTexture(GL_TEXTURE0);
-                        glBindTexture(GL_TEXTURE_2D, framebufferTexture);
-                        glUniform1i(2, 0);
-                        glUniform1f(12, f);
-                        glUniform1f(13, b);
-                        glUniform1i(14, ipk);
-                        glUniform1i(31, first);
-                        glUniform1i(32, second);
-                        glUniform1i(33, third);
-                        glUniform1i(34, fourth);
-                        render();
+            if (state.phaseField) {
+                Hasher signature = cameraSignature;
+                signature.add(state.b);
+                signature.add(state.ipk);
+                signature.add(period);
+                scenePass = "phase field view";
+                addScenePass("phase field view", {}, signature.hash(), bufferAShader, phaseFieldScreenShader,
+                    [&]() {
+                        glUniform1f(13, state.b);
+                        glUniform1i(14, state.ipk);
+                        glUniform1i(15, period);
+                    });
+            } else {
+                std::vector<RenderGraphTexture> noiseInputs;
+
+                // The fused mode evaluates the phase field inside the phasor shader and the image guided
+                // mode uses a precomputed texture, so the phase field pass is only needed otherwise.
+                if (!state.fusedPhaseField && !state.imageGuidedPhaseField) {
+                    const int phaseFieldRes = phaseFieldResolution(state.b, phaseFieldExtent, state.phaseFieldSettings, std::max(windowSize.x, windowSize.y));
+                    const GLuint oldPhaseFieldTexture = phaseFieldTarget.texture();
+                    if (phaseFieldTarget.resize(phaseFieldRes, state.phaseFieldSettings.format))
+                        renderGraph.invalidate(oldPhaseFieldTexture);
+                    const RenderGraphTexture phaseFieldTexture = renderGraph.importTexture("phase field", phaseFieldTarget.texture(), { glm::ivec2(phaseFieldRes), phaseFieldFormat });
+                    noiseInputs.push_back(phaseFieldTexture);
+
+                    // Only depends on the noise parameters, so it is skipped while the camera moves.
+                    Hasher signature;
+                    signature.add(state.b);
+                    signature.add(state.ipk);
+                    signature.add(period);
+                    renderGraph.addFullscreenPass({ .name = "phase field", .colorAttachments = { { phaseFieldTexture, LoadOp::Clear, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) } }, .signature = signature.hash() },
+                        [&]() {
+                            phaseFieldScreenShader.bind();
+                            glUniform1f(13, state.b);
+                            glUniform1i(14, state.ipk);
+                            glUniform1i(15, period);
+                            glUniform1i(44, true);
+                            glState().uniformMatrix4(0, phaseFieldDomain);
+                        });
+                }
+                if (state.imageGuidedPhaseField) {
+                    // Only changes when the brush paints.
+                    noiseInputs.push_back(renderGraph.importTexture("image orientation", imageOrientationTexture, { glm::ivec2(imageOrientation.width, imageOrientation.height), GL_R32F }, orientationGeneration));
+                }
+
+                if (progressiveNoise) {
+                    // Everything that changes the complex noise restarts the refinement. The profiles
+                    // are only applied when resolving, so toggling them does not.
+                    Hasher signature;
+                    signature.add(mvp);
+                    signature.add(state.f);
+                    signature.add(state.b);
+                    signature.add(period);
+                    signature.add(state.fusedPhaseField);
+                    signature.add(state.imageGuidedPhaseField);
+                    signature.add(orientationGeneration);
+                    signature.add(state.phaseFieldSettings.format);
+                    signature.add(state.phaseFieldSettings.samplesPerKernelRadius);
+                    signature.add(state.phaseFieldSettings.bicubic);
+                    signature.add(state.screenMappedNoise);
+                    // Reallocated levels can get the names of the old ones, so the render graph has to forget those first.
+                    if (progressiveRefinement.resolution(ProgressiveRefinement::numLevels - 1) != renderSize) {
+                        for (int level = 0; level < ProgressiveRefinement::numLevels; level++) {
+                            renderGraph.invalidate(progressiveRefinement.texture(level));
+                            renderGraph.invalidate(progressiveRefinement.depthTexture(level));
+                        }
                     }
+                    progressiveRefinement.restartIfChanged(signature.hash(), renderSize, state.ipk + 1);
 
+                    progressiveStep = progressiveRefinement.currentStep();
+                    if (progressiveStep) {
+                        const RenderGraphTexture accumulation = renderGraph.importTexture("progressive accumulation", progressiveRefinement.texture(progressiveStep->level), { progressiveStep->resolution, GL_RG32F });
+                        const RenderGraphTexture accumulationDepth = renderGraph.importTexture("progressive depth", progressiveRefinement.depthTexture(progressiveStep->level), { progressiveStep->resolution, GL_DEPTH_COMPONENT32F });
+                        auto setAccumulateUniforms = [&, setPhasorNoiseUniforms]() {
+                            setPhasorNoiseUniforms();
+                            glUniform1i(38, progressiveStep->impulseBegin);
+                            glUniform1i(39, progressiveStep->impulseEnd);
+                            glUniform1i(40, true);
+                        };
+                        const BlendState accumulate { GL_ONE, GL_ONE };
+                        if (state.screenMappedNoise) {
+                            const LoadOp load = progressiveStep->clear ? LoadOp::Clear : LoadOp::Load;
+                            renderGraph.addFullscreenPass({ .name = "progressive accumulate", .colorAttachments = { { accumulation, load } }, .reads = noiseInputs, .state = { .blend = accumulate } },
+                                [&, setAccumulateUniforms]() {
+                                    phasorNoiseScreenShader.bind();
+                                    setAccumulateUniforms();
+                                    glUniform1i(44, true);
+                                    glState().uniformMatrix4(0, mvp);
+                                });
+                        } else {
+                            if (progressiveStep->clear) {
+                                // Depth prepass of the level, like the prepass of the scene.
+                                renderGraph.addPass({ .name = "progressive prepass", .colorAttachments = { { accumulation, LoadOp::Clear } }, .depthAttachment = Attachment { accumulationDepth, LoadOp::Clear, glm::vec4(1.0f) }, .state = { .colorWrite = false } },
+                                    [&]() {
+                                        debugShader.bind();
+                                        render();
+                                    });
+                            }
+                            renderGraph.addPass({ .name = "progressive accumulate", .colorAttachments = { { accumulation } }, .depthAttachment = Attachment { accumulationDepth }, .reads = noiseInputs, .state = { .depthFunc = GL_EQUAL, .depthWrite = false, .blend = accumulate } },
+                                [&, setAccumulateUniforms]() {
+                                    phasorNoiseShader.bind();
+                                    setAccumulateUniforms();
+                                    render();
+                                });
+                        }
+                        progressiveRefinement.advance();
+                        // Keep drawing frames until the noise has converged.
+                        redraw = true;
+                    }
+
+                    const int displayLevel = progressiveRefinement.displayLevel();
+                    progressiveTexture = progressiveRefinement.texture(displayLevel);
+                    noiseInputs.push_back(renderGraph.importTexture("progressive display", progressiveTexture, { progressiveRefinement.resolution(displayLevel), GL_RG32F }));
                 }
 
+                Hasher signature = cameraSignature;
+                signature.add(state.f);
+                signature.add(state.b);
+                signature.add(state.ipk);
+                signature.add(period);
+                for (const bool option : { state.first, state.second, state.third, state.fourth, state.fusedPhaseField, state.phaseFieldSettings.bicubic, state.imageGuidedPhaseField, progressiveNoise, state.normalMap })
+                    signature.add(option);
+                // A brush stroke over the noise of the last frame only re-renders the pixels that it can affect,
+                // so painting stays interactive at high resolutions.
+                std::optional<glm::ivec4> scissor;
+                if (state.screenMappedNoise && !progressiveNoise) {
+                    Hasher contents = signature;
+                    contents.add(renderSize);
+                    // Tileable noise repeats the image over the domain, so an edit is not bounded on screen.
+                    if (!orientationEdit.empty() && previousSceneNoise == contents.hash() && !state.tileable)
+                        scissor = orientationEditScreenRect(orientationEdit, glm::ivec2(imageOrientation.width, imageOrientation.height), state.b, mvp, renderSize);
+                    sceneNoiseSignature = contents.hash();
+                }
+                partialScene = scissor.has_value();
+                scenePass = "phasor noise";
+                addScenePass("phasor noise", noiseInputs, signature.hash(), phasorNoiseShader, phasorNoiseScreenShader,
+                    [&, setPhasorNoiseUniforms]() {
+                        setPhasorNoiseUniforms();
+                        if (progressiveNoise) {
+                            glState().bindTextureUnit(2, progressiveTexture);
+                            glUniform1i(42, 2);
+                            glUniform2fv(43, 1, glm::value_ptr(glm::vec2(renderSize)));
+                            glUniform1i(41, true);
+                        }
+                    },
+                    scissor);
             }
-
-            // Restore default depth test settings and disable blending.
-            glDepthFunc(GL_LEQUAL);
-            glDepthMask(GL_TRUE);
-            glDisable(GL_BLEND);
         }
-        if (!renderedSomething) {
-            debugShader.bind();
-            //glUniform3fv(1, 1, glm::value_ptr(cameraPos)); // viewPos.
-            render();
+
+        // Frees the threads for other work.
+        if (scenePass != "cpu preview")
+            stopCpuPreview();
+
+        // Upscale the scene to the window.
+        const RenderGraphTexture backbuffer = renderGraph.importBackbuffer(windowSize, window.defaultFramebuffer());
+        renderGraph.addFullscreenPass({ .name = "upscale", .colorAttachments = { { backbuffer } }, .reads = { sceneColor } },
+            [&]() {
+                upscaleShader.bind();
+                glState().bindTextureUnit(0, sceneTarget.colorTexture());
+                glUniform1i(0, 0);
+                glUniform2iv(1, 1, glm::value_ptr(renderSize));
+                glUniform1i(2, static_cast<int>(dynamicResolution.settings.filter));
+            });
+        if (benchmarkFrames)
+            benchmarkFrameTimer.begin();
+        renderGraph.execute();
+        if (benchmarkFrames) {
+            benchmarkFrameTimer.end();
+            const bool warmup = benchmarkStep ? benchmarkStep->warmup : benchmarkFrameIndex < benchmarkWarmupFrames;
+            // Taken before the dynamic resolution (which is disabled) could take the time of the scene pass.
+            const std::optional<float> gpuFrameTime = benchmarkFrameTimer.poll();
+            for (const PassStatistics& pass : renderGraph.statistics()) {
+                if (const std::optional<float> gpuTime = renderGraph.takeGpuTime(pass.name); gpuTime && !warmup)
+                    benchmarkRecorder.addPassTime(pass.name, *gpuTime);
+            }
+            const auto frameEnd = std::chrono::steady_clock::now();
+            if (!warmup && benchmarkFrameIndex > 0) {
+                const std::string_view scenario = benchmarkStep ? benchmarkScenarios()[static_cast<size_t>(benchmarkStep->scenario)].name : "replay";
+                benchmarkRecorder.addFrame(scenario, std::chrono::duration<float, std::milli>(frameEnd - previousFrameEnd).count(), gpuFrameTime);
+            }
+            previousFrameEnd = frameEnd;
         }
 
+        // Progressive refinement already bounds the cost of every frame, and a change of the
+        // resolution would restart it. A partial update says nothing about the cost of a full frame.
+        if (const std::optional<float> sceneTime = renderGraph.takeGpuTime(scenePass); sceneTime && !progressiveNoise && !partialScene)
+            redraw |= dynamicResolution.update(*sceneTime);
+        TRACE_COUNTER("render scale", dynamicResolution.scale());
+
         // Present result to the screen.
         window.swapBuffers();
+        if (state.statusRequests != printedStatusRequests) {
+            printStatus(state);
+            printedStatusRequests = state.statusRequests;
+        }
+        return redraw;
+    };
+
+    // Snapshot of the parameters and the camera for the next frame.
+    auto viewerState = [&]() {
+        ViewerState state = currentViewerState();
+        state.view = trackball.viewMatrix();
+        state.projection = trackball.projectionMatrix();
+        state.windowSize = window.getWindowSize();
+        return state;
+    };
+    // Bakes run one after another in the background, with the parameters at the time of the request.
+    JobHandle bakeJob;
+    auto handleBakeRequest = [&](const ViewerState& state) {
+        if (!bakeRequested)
+            return;
+        bakeRequested = false;
+        // The bake (and the parallel loops inside of it) yields to the tiles of the CPU preview.
+        bakeJob = jobSystem().then(bakeJob, [state, orientation = paintedOrientation]() { bakePhasorNoise(state, orientation); }, JobAffinity::Any, JobPriority::Low);
+    };
+
+    if (renderThread) {
+        // The input thread publishes a snapshot after every update; the render thread owns the OpenGL context
+        // and draws the latest one. Snapshots that arrive while a frame is drawn replace each other, so the
+        // input never waits for the renderer.
+        TripleBuffer<ViewerState> states { viewerState() };
+        std::exception_ptr renderException;
+        window.releaseContext();
+        std::thread renderer([&]() {
+            setTraceThreadName("render");
+            window.makeContextCurrent();
+            // OpenGL work that background jobs hand to the main thread has to run here now.
+            jobSystem().setMainThread();
+            bool redraw = true;
+            try {
+                while (true) {
+                    if (!redraw && !states.front().continuousRedraw)
+                        states.waitForUpdate();
+                    states.update();
+                    const ViewerState& state = states.front();
+                    if (state.quit)
+                        break;
+                    TRACE_ZONE("frame");
+                    jobSystem().runMainThreadJobs();
+                    redraw = renderFrame(state);
+                }
+            } catch (...) {
+                renderException = std::current_exception();
+                window.close();
+                // Wakes up the input thread.
+                window.requestRedraw();
+            }
+            window.releaseContext();
+        });
+
+        // The render thread redraws continuously by itself, so this thread sleeps until there is input.
+        while (!window.shouldClose()) {
+            window.waitForInput();
+            const ViewerState state = viewerState();
+            handleBakeRequest(state);
+            states.publish(state);
+        }
+
+        ViewerState quit = viewerState();
+        quit.quit = true;
+        states.publish(quit);
+        renderer.join();
+        window.makeContextCurrent();
+        jobSystem().setMainThread();
+        if (renderException)
+            std::rethrow_exception(renderException);
+    }
+
+    // Main loop when rendering on this thread (the window is closed once the render thread stopped).
+    while (!window.shouldClose()) {
+        window.updateInput();
+        TRACE_ZONE("frame");
+        // OpenGL work that background jobs handed to the main thread.
+        jobSystem().runMainThreadJobs();
+
+        if (benchmarkFrames && !replayFile) {
+            benchmarkStep = benchmarkFrame(benchmarkFrameIndex, *benchmarkFrames);
+            const BenchmarkScenario& scenario = benchmarkScenarios()[static_cast<size_t>(benchmarkStep->scenario)];
+            debug = false;
+            phaseField = scenario.phaseField;
+            phasorNoise = scenario.phasorNoise;
+            fusedPhaseField = scenario.fusedPhaseField;
+            imageGuidedPhaseField = scenario.imageGuidedPhaseField;
+            progressive = scenario.progressive;
+            screenMappedNoise = scenario.screenMappedNoise;
+            contactSheet = scenario.contactSheet;
+            f = benchmarkStep->f;
+            b = benchmarkStep->b;
+            ipk = benchmarkStep->impulsesPerKernel;
+            trackball.setCamera(glm::vec3(0.0f), benchmarkStep->cameraRotation, benchmarkStep->cameraDistance);
+        }
+
+        const ViewerState state = viewerState();
+        handleBakeRequest(state);
+        if (renderFrame(state))
+            window.requestRedraw();
+
+        // The replay ends the benchmark or headless run once all of its events were dispatched.
+        const bool replayFinished = replayFile && !window.isReplaying();
+        benchmarkFrameIndex++;
+        if (benchmarkFrames && (replayFile ? replayFinished : benchmarkFrameIndex == *benchmarkFrames)) {
+            benchmarkRecorder.printSummary();
+            benchmarkRecorder.writeJson("benchmark.json", state.windowSize, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+            std::cout << "Wrote benchmark.json" << std::endl;
+            window.close();
+        } else if (headlessFrames && !benchmarkFrames && (replayFile ? replayFinished : --*headlessFrames == 0)) {
+            const glm::ivec2 windowSize = state.windowSize;
+            std::vector<uint8_t> pixels(static_cast<size_t>(windowSize.x * windowSize.y) * 4);
+            glState().bindFramebuffer(window.defaultFramebuffer());
+            glReadPixels(0, 0, windowSize.x, windowSize.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            // OpenGL stores the bottom row first. The rows are flipped here because stb's flip flag is global and
+            // would also flip the images that a bake writes at the same time.
+            const ptrdiff_t rowSize = static_cast<ptrdiff_t>(windowSize.x) * 4;
+            for (int y = 0; y < windowSize.y / 2; y++) {
+                const auto row = std::begin(pixels) + y * rowSize;
+                std::swap_ranges(row, row + rowSize, std::begin(pixels) + (windowSize.y - 1 - y) * rowSize);
+            }
+            stbi_write_png("headless.png", windowSize.x, windowSize.y, 4, pixels.data(), windowSize.x * 4);
+            window.close();
+        }
+    }
+
+    if (bakeJob.valid())
+        bakeJob.wait();
+
+    if (recordFile) {
+        saveInputRecording(*recordFile, window.stopRecording());
+        std::cout << "Wrote the input recording to " << *recordFile << std::endl;
     }
 
     // Be a nice citizen and clean up after yourself.
-    glDeleteTextures(1, &framebufferTexture);
+    stopCpuPreview();
+    glState().textureDeleted(cpuPreviewTexture);
+    glDeleteTextures(1, &cpuPreviewTexture);
+    glState().textureDeleted(imageOrientationTexture);
+    glDeleteTextures(1, &imageOrientationTexture);
     glDeleteBuffers(1, &vbo);
     glDeleteBuffers(1, &ibo);
-    glDeleteFramebuffers(1, &fbo);
+    glState().vertexArrayDeleted(vao);
     glDeleteVertexArrays(1, &vao);
+    glState().vertexArrayDeleted(swatchVao);
+    glDeleteVertexArrays(1, &swatchVao);
+    glDeleteBuffers(1, &swatchBuffer);
+    glDeleteBuffers(1, &phaseFieldTileBuffer);
 
     return 0;
 }
@@ -446,6 +1439,251 @@ static std::optional<glm::vec3> getWorldPositionOfPixel(const Trackball& trackba
     return glm::unProject(win, view, projection, viewport);
 }
 
+// Point of the square that the pixel (in normalized device coordinates) sees, found like screen_mapped_surface()
+// in phasor_noise.glsl, in texels of the image orientation. The point (x, y) lies at (|x|, -y) in the mirrored
+// noise domain, which the mapping (see imageOrientationSource()) takes to the texture coordinates.
+static std::optional<glm::vec2> orientationTexelOfPixel(const glm::mat4& mvp, const glm::vec2& ndc, const SampledOrientation& mapping, bool repeat)
+{
+    const glm::mat4 clipToWorld = glm::inverse(mvp);
+    const glm::vec4 rayNear = clipToWorld * glm::vec4(ndc, -1.0f, 1.0f);
+    const glm::vec4 rayFar = clipToWorld * glm::vec4(ndc, 1.0f, 1.0f);
+    const glm::vec3 near = glm::vec3(rayNear) / rayNear.w;
+    const glm::vec3 dir = glm::vec3(rayFar) / rayFar.w - near;
+    float closest = 1.0f;
+    std::optional<glm::vec2> texel;
+    for (const float z : { -0.1f, 0.1f }) {
+        const float t = (z - near.z) / dir.z;
+        const glm::vec3 p = near + t * dir;
+        if (t >= 0.0f && t <= closest && std::abs(p.x) <= 1.0f && std::abs(p.y) <= 1.0f) {
+            closest = t;
+            glm::vec2 uv = (glm::vec2(std::abs(p.x), -p.y) - mapping.origin) / mapping.extent;
+            if (repeat)
+                uv = glm::fract(uv);
+            texel = uv * glm::vec2(mapping.pPhaseField->width, mapping.pPhaseField->height);
+        }
+    }
+    return texel;
+}
+
+// Pixels (x, y, width, height) of the full screen noise views that a change of the texels of the image orientation
+// can affect, or nothing when they cannot be bounded (part of the region is behind the camera).
+static std::optional<glm::ivec4> orientationEditScreenRect(const TexelRect& edit, const glm::ivec2& fieldSize, float bandwidth, const glm::mat4& mvp, const glm::ivec2& renderSize)
+{
+    // A bicubic sample reads the texels up to 2 away, and the texels at the border are extended outwards.
+    glm::vec2 uvBegin = glm::vec2(edit.begin - 2) / glm::vec2(fieldSize);
+    glm::vec2 uvEnd = glm::vec2(edit.end + 2) / glm::vec2(fieldSize);
+    for (int axis = 0; axis < 2; axis++) {
+        if (edit.begin[axis] <= 0)
+            uvBegin[axis] = -std::numeric_limits<float>::infinity();
+        if (edit.end[axis] >= fieldSize[axis])
+            uvEnd[axis] = std::numeric_limits<float>::infinity();
+    }
+    // The orientation is sampled at the impulse centres, whose kernels are negligible beyond a cell (2 kernel radii).
+    const float reach = 2.0f * kernelRadius(bandwidth);
+    const glm::vec2 xRange = glm::clamp(glm::vec2(uvBegin.x - reach, uvEnd.x + reach), 0.0f, 1.0f);
+    const glm::vec2 yRange = glm::clamp(glm::vec2(2.0f * uvBegin.y - 1.0f - reach, 2.0f * uvEnd.y - 1.0f + reach), -1.0f, 1.0f);
+
+    // Bounds of both mirror images on both faces of the square.
+    glm::vec2 pixelMin { std::numeric_limits<float>::max() }, pixelMax { std::numeric_limits<float>::lowest() };
+    for (const float side : { -1.0f, 1.0f }) {
+        for (const float x : { xRange.x, xRange.y }) {
+            for (const float y : { yRange.x, yRange.y }) {
+                for (const float z : { -0.1f, 0.1f }) {
+                    const glm::vec4 clip = mvp * glm::vec4(side * x, y, z, 1.0f);
+                    if (clip.w <= 0.0f)
+                        return {};
+                    const glm::vec2 pixel = (glm::vec2(clip) / clip.w * 0.5f + 0.5f) * glm::vec2(renderSize);
+                    pixelMin = glm::min(pixelMin, pixel);
+                    pixelMax = glm::max(pixelMax, pixel);
+                }
+            }
+        }
+    }
+    const glm::ivec2 begin = glm::clamp(glm::ivec2(glm::floor(pixelMin)) - 1, glm::ivec2(0), renderSize);
+    const glm::ivec2 end = glm::clamp(glm::ivec2(glm::ceil(pixelMax)) + 1, glm::ivec2(0), renderSize);
+    return glm::ivec4(begin, glm::max(end - begin, glm::ivec2(0)));
+}
+
+static ViewerState currentViewerState()
+{
+    ViewerState state;
+    state.debug = debug;
+    state.phasorNoise = phasorNoise;
+    state.phaseField = phaseField;
+    state.first = first;
+    state.second = second;
+    state.third = third;
+    state.fourth = fourth;
+    state.fusedPhaseField = fusedPhaseField;
+    state.imageGuidedPhaseField = imageGuidedPhaseField;
+    state.tileable = tileable;
+    state.progressive = progressive;
+    state.screenMappedNoise = screenMappedNoise;
+    state.contactSheet = contactSheet;
+    state.contactSheetSettings = contactSheetSettings;
+    state.cpuPreview = cpuPreview;
+    state.normalMap = normalMap;
+    state.brushMode = brushMode;
+    state.brushSettings = brushSettings;
+    state.f = f;
+    state.b = b;
+    state.ipk = ipk;
+    state.phaseFieldSettings = phaseFieldSettings;
+    state.dynamicResolutionSettings = dynamicResolutionSettings;
+    state.dynamicResolutionResets = dynamicResolutionResets;
+    state.continuousRedraw = continuousRedraw;
+    state.statusRequests = statusRequests;
+    state.currentVar = currentVar;
+    return state;
+}
+
+static PhasorNoiseParams phasorNoiseParams(const ViewerState& state)
+{
+    PhasorNoiseParams params;
+    params.f = state.f;
+    params.b = state.b;
+    params.impulsesPerKernel = state.ipk;
+    params.profiles = { state.first, state.second, state.third, state.fourth };
+    params.period = state.tileable ? periodInCells(tileSize, state.b) : 0;
+    return params;
+}
+
+// Same mapping as phasor_noise.glsl: the image covers [0, 1] x [-1, 1] with its top at y = -1. Tileable
+// noise stretches it over one period instead, where the sampling repeats it (see generateCellImpulses()).
+static SampledOrientation imageOrientationSource(const PhaseField& imageOrientation, const PhasorNoiseParams& params)
+{
+    if (params.period > 0) {
+        const float periodSize = static_cast<float>(params.period) * cellSize(params.b);
+        return SampledOrientation { &imageOrientation, glm::vec2(0.0f, periodSize), glm::vec2(periodSize, -periodSize) };
+    }
+    return SampledOrientation { &imageOrientation, glm::vec2(0.0f, 1.0f), glm::vec2(1.0f, -2.0f) };
+}
+
+// Render the phasor noise of the state on the CPU and write it to phasor_noise.png. When tileable is
+// enabled a single (seamlessly repeating) tile is written, otherwise the noise domain of the viewer.
+static void bakePhasorNoise(const ViewerState& state, const PhaseField& imageOrientation)
+{
+    const PhasorNoiseParams params = phasorNoiseParams(state);
+    OrientationSource orientation = ProceduralOrientation {};
+    if (state.imageGuidedPhaseField)
+        orientation = imageOrientationSource(imageOrientation, params);
+
+    PhasorNoiseRegion region;
+    if (state.tileable) {
+        const float periodSize = static_cast<float>(params.period) * cellSize(state.b);
+        region = PhasorNoiseRegion { glm::vec2(0.0f), glm::vec2(periodSize), 1024, 1024 };
+    } else {
+        region = PhasorNoiseRegion { glm::vec2(0.0f, -1.0f), glm::vec2(1.0f, 2.0f), 512, 1024 };
+    }
+    if (!state.normalMap) {
+        writePhasorNoise("phasor_noise.png", params, orientation, region);
+    } else {
+        // The height image comes from the same evaluations as the normals.
+        NoiseImage noise;
+        const NormalImage normals = renderPhasorNoiseNormals(params, orientation, region, bumpSlope, &noise);
+        NoiseFileWriter writer { "phasor_noise.png", NoiseFileFormat::Png, noise.width, noise.height };
+        writer.writeRows(noise.pixels);
+        writer.finish();
+        std::cout << "Wrote phasor_noise.png (" << noise.width << "x" << noise.height << ")" << std::endl;
+
+        // Rows go down along +y of the noise domain, so y is flipped for normals whose green points up the image.
+        std::vector<uint8_t> pixels(normals.normals.size() * 3);
+        for (size_t i = 0; i < normals.normals.size(); i++) {
+            const glm::vec3 normal = normals.normals[i] * glm::vec3(1.0f, -1.0f, 1.0f);
+            for (int c = 0; c < 3; c++)
+                pixels[i * 3 + static_cast<size_t>(c)] = static_cast<uint8_t>(std::lround((normal[c] * 0.5f + 0.5f) * 255.0f));
+        }
+        stbi_write_png("phasor_noise_normals.png", normals.width, normals.height, 3, pixels.data(), normals.width * 3);
+        std::cout << "Wrote phasor_noise_normals.png (" << normals.width << "x" << normals.height << ")" << std::endl;
+    }
+}
+
+// The whole argument has to be a number (nothing when it is not or when it is out of range).
+template <typename T>
+static std::optional<T> parseNumber(std::string_view text)
+{
+    T value {};
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size())
+        return {};
+    return value;
+}
+
+// --plate <file.png|.tif|.raw> <width> <height> [pixels per world unit = 1024] [bits = 8|16]
+//         [--cache <directory>] [--cache-size <MB>]
+// Renders the default noise (with the procedural phase field) in strips straight to disk, so the
+// size of the plate is not limited by the available memory. With --cache the plate is rendered in
+// tiles that are reused by later runs with the same parameters and resolution.
+static int renderPlate(int argc, char** argv)
+{
+    const auto printUsage = [&]() {
+        std::cerr << "Usage: " << argv[0] << " --plate <file.png|.tif|.raw> <width> <height> [pixels per unit] [8|16] [--cache <directory>] [--cache-size <MB>]" << std::endl;
+        return EXIT_FAILURE;
+    };
+    std::vector<std::string> arguments;
+    std::optional<std::filesystem::path> cacheDirectory;
+    std::optional<uint64_t> cacheSizeInMB = 4096;
+    for (int i = 2; i < argc; i++) {
+        const std::string_view argument { argv[i] };
+        if (argument == "--cache" && i + 1 < argc)
+            cacheDirectory = argv[++i];
+        else if (argument == "--cache-size" && i + 1 < argc)
+            cacheSizeInMB = parseNumber<uint64_t>(argv[++i]);
+        else
+            arguments.emplace_back(argument);
+    }
+    if (arguments.size() < 3)
+        return printUsage();
+    const std::filesystem::path filePath { arguments[0] };
+    const std::optional<int> widthArgument = parseNumber<int>(arguments[1]);
+    const std::optional<int> heightArgument = parseNumber<int>(arguments[2]);
+    const std::optional<float> pixelsPerUnitArgument = arguments.size() >= 4 ? parseNumber<float>(arguments[3]) : 1024.0f;
+    const std::optional<int> bitsPerSampleArgument = arguments.size() >= 5 ? parseNumber<int>(arguments[4]) : 8;
+    if (!widthArgument || !heightArgument || !pixelsPerUnitArgument || !bitsPerSampleArgument || !cacheSizeInMB)
+        return printUsage();
+    const int width = *widthArgument;
+    const int height = *heightArgument;
+    const float pixelsPerUnit = *pixelsPerUnitArgument;
+    const int bitsPerSample = *bitsPerSampleArgument;
+    if (width <= 0 || height <= 0 || !std::isfinite(pixelsPerUnit) || pixelsPerUnit <= 0.0f || (bitsPerSample != 8 && bitsPerSample != 16)) {
+        std::cerr << "Invalid plate size, resolution or bit depth" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!cacheDirectory) {
+        const PhasorNoiseRegion region { glm::vec2(0.0f), glm::vec2(width, height) / pixelsPerUnit, width, height };
+        writePhasorNoise(filePath, phasorNoiseParams(currentViewerState()), ProceduralOrientation {}, region, bitsPerSample);
+        return EXIT_SUCCESS;
+    }
+
+    TileCache cache { *cacheDirectory, *cacheSizeInMB << 20 };
+    const TileGrid grid { glm::vec2(0.0f), glm::vec2(1.0f / pixelsPerUnit), 256 };
+    NoiseFileWriter writer { filePath, noiseFileFormatFromPath(filePath), width, height, bitsPerSample };
+    renderPhasorNoiseTiles(phasorNoiseParams(currentViewerState()), ProceduralOrientation {}, grid, glm::ivec2(width, height), &cache, [&](const NoiseImage& strip) {
+        writer.writeRows(strip.pixels);
+        std::cout << "\rWrote " << writer.rowsWritten() << " / " << height << " rows" << std::flush;
+    });
+    writer.finish();
+    std::cout << std::endl
+              << "Wrote " << filePath.string() << " (" << width << "x" << height << "), "
+              << cache.hits() << " cached tiles, " << cache.misses() << " rendered" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+static void writePhasorNoise(const std::filesystem::path& filePath, const PhasorNoiseParams& params, const OrientationSource& orientation, const PhasorNoiseRegion& region, int bitsPerSample)
+{
+    // Strips of roughly 16M pixels keep the memory use bounded while giving every thread enough rows.
+    const int stripHeight = std::clamp((1 << 24) / region.width, 16, std::max(region.height, 16));
+    NoiseFileWriter writer { filePath, noiseFileFormatFromPath(filePath), region.width, region.height, bitsPerSample };
+    renderPhasorNoiseStrips(params, orientation, region, stripHeight, [&](const NoiseImage& strip) {
+        writer.writeRows(strip.pixels);
+        std::cout << "\rWrote " << writer.rowsWritten() << " / " << region.height << " rows" << std::flush;
+    });
+    writer.finish();
+    std::cout << std::endl
+              << "Wrote " << filePath.string() << " (" << region.width << "x" << region.height << ")" << std::endl;
+}
+
 static void printHelp()
 {
     Trackball::printHelp();
@@ -458,6 +1696,8 @@ static void printHelp()
     std::cout << "      6 - (De)activate function 2" << std::endl;
     std::cout << "      7 - (De)activate function 3" << std::endl;
     std::cout << "      8 - (De)activate function 4" << std::endl;
+    std::cout << "      2 - (De)activate fused phase field (no intermediate pass)" << std::endl;
+    std::cout << "      3 - (De)activate image guided phase field (resources/dog2.png)" << std::endl;
     std::cout << "9 - Phase field" << std::endl;
     std::cout << "______________________" << std::endl;
     std::cout << "RIGHT - Increase value" << std::endl;
@@ -465,4 +1705,23 @@ static void printHelp()
     std::cout << "F - Select f" << std::endl;
     std::cout << "B - Select b" << std::endl;
     std::cout << "I - Select ipk" << std::endl;
+    std::cout << "S - Select phase field samples per kernel radius" << std::endl;
+    std::cout << "U - Toggle bicubic / bilinear phase field upsampling" << std::endl;
+    std::cout << "P - Toggle 16 / 32 bit phase field" << std::endl;
+    std::cout << "T - Toggle tileable (periodic) noise" << std::endl;
+    std::cout << "K - Bake the phasor noise on the CPU to phasor_noise.png" << std::endl;
+    std::cout << "G - Toggle progressive refinement (fast previews while changing parameters)" << std::endl;
+    std::cout << "O - Toggle between redrawing on demand (default) and every frame" << std::endl;
+    std::cout << "D - Toggle dynamic resolution scaling (holds the target frame time)" << std::endl;
+    std::cout << "V - Select target frame time (ms)" << std::endl;
+    std::cout << "N - Cycle the upscale filter (nearest / bilinear / bicubic)" << std::endl;
+    std::cout << "Q - Toggle full screen (default) / mesh rendering of the noise views" << std::endl;
+    std::cout << "C - Toggle the contact sheet (grid of phasor noise swatches with varying parameters)" << std::endl;
+    std::cout << "H - Cycle the parameter along the columns of the contact sheet (f / b / ipk / profiles)" << std::endl;
+    std::cout << "J - Cycle the parameter along the rows of the contact sheet" << std::endl;
+    std::cout << "L - Toggle the CPU preview (the CPU engine renders the noise domain in tiles, centre first)" << std::endl;
+    std::cout << "E - Toggle the orientation brush (left drag paints the image guided orientation along the stroke)" << std::endl;
+    std::cout << "W - Select the brush radius (texels)" << std::endl;
+    std::cout << "A - Toggle the normal map of the bump of the sine profile (the bake also writes phasor_noise_normals.png)" << std::endl;
+    std::cout << "Run with --plate <file.png|.tif|.raw> <width> <height> to render a large noise plate without a window" << std::endl;
 }
@@ -0,0 +1,399 @@
+#include "noise_sampler.h"
+#include "parallel.h"
+#include <framework/trace.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <numbers>
+#if defined(__SSE2__) || defined(_M_X64) || defined(__AVX__)
+#include <immintrin.h>
+#define NOISE_SAMPLER_SSE 1
+#endif
+
+static constexpr float pi = std::numbers::pi_v<float>;
+// Impulses are generated for square blocks of cells, plus the neighbourhood of the cells at the border.
+static constexpr int blockShift = 4;
+static constexpr int blockCells = 1 << blockShift;
+// Cells further from the origin give no meaningful noise in single precision (and overflow the block keys).
+static constexpr float maxCellIndex = static_cast<float>(1 << 29);
+// Block indices are offset to make the keys positive, so keys sort in row major order of the blocks.
+static constexpr int64_t blockKeyOffset = int64_t(1) << 30;
+#ifdef NOISE_SAMPLER_SSE
+static constexpr size_t simdWidth = 4;
+#else
+static constexpr size_t simdWidth = 1;
+#endif
+
+// The impulses of each cell are padded to a multiple of the SIMD width with impulses far outside of the
+// kernel cutoff, so the impulses of a row of neighbouring cells form one contiguous range of the arrays.
+struct ImpulseBlock {
+    glm::ivec2 cellMin;
+    int numCellsX;
+    size_t stride; // Impulses per cell, including the padding.
+    std::vector<float> positionX, positionY, frequencyX, frequencyY, phase;
+
+    [[nodiscard]] size_t firstImpulse(const glm::ivec2& ij) const
+    {
+        const glm::ivec2 local = ij - cellMin;
+        return (static_cast<size_t>(local.y) * static_cast<size_t>(numCellsX) + static_cast<size_t>(local.x)) * stride;
+    }
+};
+
+static uint64_t blockKey(const glm::ivec2& block)
+{
+    return (static_cast<uint64_t>(block.y + blockKeyOffset) << 32) | static_cast<uint64_t>(block.x + blockKeyOffset);
+}
+
+static glm::ivec2 blockOfKey(uint64_t key)
+{
+    return { static_cast<int>(static_cast<int64_t>(key & 0xFFFFFFFFu) - blockKeyOffset), static_cast<int>(static_cast<int64_t>(key >> 32) - blockKeyOffset) };
+}
+
+static std::shared_ptr<const ImpulseBlock> generateBlock(const PhasorNoiseParams& params, const OrientationSource& orientation, uint64_t key)
+{
+    const glm::ivec2 firstCell = blockOfKey(key) * blockCells;
+    const ImpulseGrid grid { params, orientation, firstCell - cellNeighbourhood, firstCell + (blockCells - 1 + cellNeighbourhood) };
+
+    auto pBlock = std::make_shared<ImpulseBlock>();
+    const glm::ivec2 numCells = grid.cellMax - grid.cellMin + 1;
+    pBlock->cellMin = grid.cellMin;
+    pBlock->numCellsX = numCells.x;
+    pBlock->stride = (static_cast<size_t>(grid.impulsesPerCell) + simdWidth - 1) / simdWidth * simdWidth;
+    const size_t count = static_cast<size_t>(numCells.x) * static_cast<size_t>(numCells.y) * pBlock->stride;
+    // The squared distance to the padding stays finite, and its argument is 0.
+    pBlock->positionX.assign(count, 1e15f);
+    pBlock->positionY.assign(count, 1e15f);
+    pBlock->frequencyX.assign(count, 0.0f);
+    pBlock->frequencyY.assign(count, 0.0f);
+    pBlock->phase.assign(count, 0.0f);
+    std::vector<Impulse> impulses;
+    for (int j = grid.cellMin.y; j <= grid.cellMax.y; j++) {
+        for (int i = grid.cellMin.x; i <= grid.cellMax.x; i++) {
+            // Spatially sorted impulses make it likely that all impulses of a SIMD group are beyond the cutoff.
+            const std::span<const Impulse> cell = grid.cell({ i, j });
+            impulses.assign(std::begin(cell), std::end(cell));
+            std::sort(std::begin(impulses), std::end(impulses), [](const Impulse& lhs, const Impulse& rhs) { return lhs.position.y < rhs.position.y; });
+            size_t k = pBlock->firstImpulse({ i, j });
+            for (const Impulse& impulse : impulses) {
+                pBlock->positionX[k] = impulse.position.x;
+                pBlock->positionY[k] = impulse.position.y;
+                pBlock->frequencyX[k] = impulse.frequency.x;
+                pBlock->frequencyY[k] = impulse.frequency.y;
+                pBlock->phase[k++] = impulse.phase;
+            }
+        }
+    }
+    return pBlock;
+}
+
+struct PointQuery {
+    uint64_t block;
+    uint32_t cell; // Within the block, row major.
+    uint32_t index;
+};
+static constexpr uint64_t invalidBlock = std::numeric_limits<uint64_t>::max();
+
+// Sorts the queries by block and then by cell, which puts the points that read the same impulses next to each
+// other, with the invalid queries at the end. Batches of points in a bounded region (the common case) cover a
+// small range of blocks and are counting sorted in linear time, scattered batches fall back to std::sort.
+static void sortQueries(std::vector<PointQuery>& queries)
+{
+    TRACE_ZONE("sort queries");
+    glm::ivec2 blockMin { std::numeric_limits<int>::max() }, blockMax { std::numeric_limits<int>::min() };
+    for (const PointQuery& query : queries) {
+        if (query.block != invalidBlock) {
+            blockMin = glm::min(blockMin, blockOfKey(query.block));
+            blockMax = glm::max(blockMax, blockOfKey(query.block));
+        }
+    }
+    const int64_t numBlocksX = int64_t(blockMax.x) - blockMin.x + 1;
+    const int64_t numBuckets = std::max(numBlocksX * (int64_t(blockMax.y) - blockMin.y + 1), int64_t(0)) * blockCells * blockCells + 1;
+    if (numBuckets > 4 * static_cast<int64_t>(queries.size()) + 65536) {
+        std::sort(std::begin(queries), std::end(queries), [](const PointQuery& lhs, const PointQuery& rhs) {
+            return lhs.block != rhs.block ? lhs.block < rhs.block : lhs.cell < rhs.cell;
+        });
+        return;
+    }
+
+    // Keys are row major in the blocks like the block keys, the invalid queries go in the last bucket.
+    const auto bucketOf = [&](const PointQuery& query) {
+        if (query.block == invalidBlock)
+            return static_cast<size_t>(numBuckets - 1);
+        const glm::ivec2 block = blockOfKey(query.block) - blockMin;
+        return static_cast<size_t>((block.y * numBlocksX + block.x) * blockCells * blockCells + query.cell);
+    };
+    std::vector<uint32_t> offsets(static_cast<size_t>(numBuckets) + 1, 0);
+    for (const PointQuery& query : queries)
+        offsets[bucketOf(query) + 1]++;
+    std::partial_sum(std::begin(offsets), std::end(offsets), std::begin(offsets));
+    std::vector<PointQuery> sorted(queries.size());
+    for (const PointQuery& query : queries)
+        sorted[offsets[bucketOf(query)]++] = query;
+    queries = std::move(sorted);
+}
+
+#ifdef NOISE_SAMPLER_SSE
+// exp(x) for x <= 0 (clamped to -87): 2^(x log2(e)) with the nearest integer power in the exponent bits and
+// a Taylor polynomial for the remaining fraction in [-0.5, 0.5] (relative error around 1e-7).
+static __m128 exp4(__m128 x)
+{
+    const __m128 t = _mm_mul_ps(_mm_max_ps(x, _mm_set1_ps(-87.0f)), _mm_set1_ps(std::numbers::log2e_v<float>));
+    const __m128i n = _mm_cvtps_epi32(t);
+    const __m128 f = _mm_sub_ps(t, _mm_cvtepi32_ps(n));
+    __m128 poly = _mm_set1_ps(1.5403530e-4f);
+    poly = _mm_add_ps(_mm_mul_ps(poly, f), _mm_set1_ps(1.3333558e-3f));
+    poly = _mm_add_ps(_mm_mul_ps(poly, f), _mm_set1_ps(9.6181291e-3f));
+    poly = _mm_add_ps(_mm_mul_ps(poly, f), _mm_set1_ps(5.5504109e-2f));
+    poly = _mm_add_ps(_mm_mul_ps(poly, f), _mm_set1_ps(2.4022651e-1f));
+    poly = _mm_add_ps(_mm_mul_ps(poly, f), _mm_set1_ps(6.9314718e-1f));
+    poly = _mm_add_ps(_mm_mul_ps(poly, f), _mm_set1_ps(1.0f));
+    const __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+    return _mm_mul_ps(poly, scale);
+}
+
+// Sine and cosine of x. x is reduced to [-pi/4, pi/4] around the nearest multiple q of pi/2 and the quadrant
+// of q swaps and negates the two polynomials. pi/2 is subtracted in two parts, the first one short enough that
+// its product with q is exact, which keeps the error around 1e-7 for the arguments of the kernels.
+static void sincos4(__m128 x, __m128& s, __m128& c)
+{
+    const __m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(2.0f / pi)));
+    const __m128 qf = _mm_cvtepi32_ps(q);
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(1.5703125f)));
+    r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(4.8382679e-4f)));
+    const __m128 r2 = _mm_mul_ps(r, r);
+
+    __m128 sinPoly = _mm_set1_ps(-1.9515296e-4f);
+    sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, r2), _mm_set1_ps(8.3321609e-3f));
+    sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, r2), _mm_set1_ps(-1.6666655e-1f));
+    sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, r2), r), r);
+    __m128 cosPoly = _mm_set1_ps(2.4433157e-5f);
+    cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, r2), _mm_set1_ps(-1.3887316e-3f));
+    cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, r2), _mm_set1_ps(4.1666646e-2f));
+    cosPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(cosPoly, r2), r2), _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)));
+
+    // Quadrants 1 and 3 swap sine and cosine, 2 and 3 negate the sine, 1 and 2 negate the cosine.
+    const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+    const __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+    const __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+    s = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, cosPoly), _mm_andnot_ps(swap, sinPoly)), sinSign);
+    c = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, sinPoly), _mm_andnot_ps(swap, cosPoly)), cosSign);
+}
+
+static float horizontalSum(__m128 v)
+{
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, v);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+#endif
+
+// Same sums as evaluatePhasorNoiseDerivatives().
+template <bool Derivatives>
+static PhasorNoiseSample evaluatePoint(const ImpulseBlock& block, float b, const glm::vec2& p, const glm::ivec2& ij)
+{
+    const float cellsz = cellSize(b);
+    const float cutoff2 = cellsz * cellsz;
+    const float a = pi * b * b;
+    const size_t rowLength = static_cast<size_t>(2 * cellNeighbourhood + 1) * block.stride;
+
+    PhasorNoiseSample out;
+#ifdef NOISE_SAMPLER_SSE
+    const __m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y);
+    const __m128 minusA = _mm_set1_ps(-a), minusTwoA = _mm_set1_ps(-2.0f * a), cutoff = _mm_set1_ps(cutoff2);
+    __m128 re = _mm_setzero_ps(), im = _mm_setzero_ps();
+    __m128 reX = _mm_setzero_ps(), imX = _mm_setzero_ps(), reY = _mm_setzero_ps(), imY = _mm_setzero_ps();
+#endif
+    for (int dj = -cellNeighbourhood; dj <= cellNeighbourhood; dj++) {
+        const size_t first = block.firstImpulse(ij + glm::ivec2(-cellNeighbourhood, dj));
+        size_t k = first;
+#ifdef NOISE_SAMPLER_SSE
+        for (; k + 4 <= first + rowLength; k += 4) {
+            const __m128 dx = _mm_sub_ps(px, _mm_loadu_ps(&block.positionX[k]));
+            const __m128 dy = _mm_sub_ps(py, _mm_loadu_ps(&block.positionY[k]));
+            const __m128 r2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            // Most impulses of the outer cells are beyond the cutoff.
+            const __m128 inside = _mm_cmple_ps(r2, cutoff);
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+            const __m128 amplitude = _mm_and_ps(inside, exp4(_mm_mul_ps(minusA, r2)));
+            const __m128 fx = _mm_loadu_ps(&block.frequencyX[k]);
+            const __m128 fy = _mm_loadu_ps(&block.frequencyY[k]);
+            const __m128 argument = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, fx), _mm_mul_ps(dy, fy)), _mm_loadu_ps(&block.phase[k]));
+            __m128 s, c;
+            sincos4(argument, s, c);
+            const __m128 ac = _mm_mul_ps(amplitude, c), as = _mm_mul_ps(amplitude, s);
+            re = _mm_add_ps(re, ac);
+            im = _mm_add_ps(im, as);
+            if constexpr (Derivatives) {
+                const __m128 gx = _mm_mul_ps(minusTwoA, dx), gy = _mm_mul_ps(minusTwoA, dy);
+                reX = _mm_add_ps(reX, _mm_sub_ps(_mm_mul_ps(ac, gx), _mm_mul_ps(as, fx)));
+                imX = _mm_add_ps(imX, _mm_add_ps(_mm_mul_ps(as, gx), _mm_mul_ps(ac, fx)));
+                reY = _mm_add_ps(reY, _mm_sub_ps(_mm_mul_ps(ac, gy), _mm_mul_ps(as, fy)));
+                imY = _mm_add_ps(imY, _mm_add_ps(_mm_mul_ps(as, gy), _mm_mul_ps(ac, fy)));
+            }
+        }
+#endif
+        for (; k < first + rowLength; k++) {
+            const glm::vec2 d = p - glm::vec2(block.positionX[k], block.positionY[k]);
+            const float r2 = glm::dot(d, d);
+            if (r2 > cutoff2)
+                continue;
+            const glm::vec2 frequency { block.frequencyX[k], block.frequencyY[k] };
+            const float amplitude = std::exp(-a * r2);
+            const float argument = glm::dot(d, frequency) + block.phase[k];
+            const glm::vec2 kernel = amplitude * glm::vec2(std::cos(argument), std::sin(argument));
+            out.noise += kernel;
+            if constexpr (Derivatives) {
+                const glm::vec2 gradient = -2.0f * a * d;
+                out.ddx += gradient.x * kernel + frequency.x * glm::vec2(-kernel.y, kernel.x);
+                out.ddy += gradient.y * kernel + frequency.y * glm::vec2(-kernel.y, kernel.x);
+            }
+        }
+    }
+#ifdef NOISE_SAMPLER_SSE
+    out.noise += glm::vec2(horizontalSum(re), horizontalSum(im));
+    if constexpr (Derivatives) {
+        out.ddx += glm::vec2(horizontalSum(reX), horizontalSum(imX));
+        out.ddy += glm::vec2(horizontalSum(reY), horizontalSum(imY));
+    }
+#endif
+    return out;
+}
+
+PhasorNoiseSampler::PhasorNoiseSampler(const OrientationSource& orientation, size_t maxCachedBlocks)
+    : m_orientation(orientation)
+    , m_maxCachedBlocks(maxCachedBlocks)
+{
+}
+
+void PhasorNoiseSampler::evaluate(std::span<const float> xs, std::span<const float> ys, const PhasorNoiseParams& params,
+    std::span<float> phase, std::span<float> intensity, std::span<float> gradientX, std::span<float> gradientY)
+{
+    assert(xs.size() == ys.size() && xs.size() <= static_cast<size_t>(std::numeric_limits<int>::max()));
+    for (std::span<float> output : { phase, intensity, gradientX, gradientY })
+        assert(output.empty() || output.size() == xs.size());
+    if (m_cachedParams != params) {
+        clearCache();
+        m_cachedParams = params;
+    }
+    TRACE_ZONE("PhasorNoiseSampler::evaluate");
+    const int numPoints = static_cast<int>(xs.size());
+    const float cellsz = cellSize(params.b);
+    const bool derivatives = !gradientX.empty() || !gradientY.empty();
+
+    const auto store = [&](size_t index, const PhasorNoiseSample& sample) {
+        if (!phase.empty())
+            phase[index] = std::atan2(sample.noise.y, sample.noise.x);
+        if (!intensity.empty())
+            intensity[index] = glm::length(sample.noise);
+        if (!derivatives)
+            return;
+        const glm::vec2 gradient = phaseGradient(sample);
+        if (!gradientX.empty())
+            gradientX[index] = gradient.x;
+        if (!gradientY.empty())
+            gradientY[index] = gradient.y;
+    };
+
+    std::vector<PointQuery> queries(static_cast<size_t>(numPoints));
+    parallelForChunks(0, numPoints, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const size_t index = static_cast<size_t>(i);
+            const glm::vec2 cell = glm::floor(glm::vec2(xs[index], ys[index]) / cellsz);
+            // Also false for NaN.
+            if (!(std::abs(cell.x) <= maxCellIndex && std::abs(cell.y) <= maxCellIndex)) {
+                queries[index] = { invalidBlock, 0, static_cast<uint32_t>(i) };
+                for (std::span<float> output : { phase, intensity, gradientX, gradientY }) {
+                    if (!output.empty())
+                        output[index] = std::numeric_limits<float>::quiet_NaN();
+                }
+                continue;
+            }
+            const glm::ivec2 ij { cell };
+            const glm::ivec2 local = ij & (blockCells - 1);
+            queries[index] = { blockKey(ij >> blockShift), static_cast<uint32_t>(local.y * blockCells + local.x), static_cast<uint32_t>(i) };
+        }
+    });
+    sortQueries(queries);
+
+    // Runs of queries in the same block (the invalid ones sorted to the end).
+    std::vector<BlockKey> runBlocks;
+    std::vector<int> runStarts;
+    int numValid = 0;
+    for (; numValid < numPoints && queries[static_cast<size_t>(numValid)].block != invalidBlock; numValid++) {
+        if (runBlocks.empty() || runBlocks.back() != queries[static_cast<size_t>(numValid)].block) {
+            runBlocks.push_back(queries[static_cast<size_t>(numValid)].block);
+            runStarts.push_back(numValid);
+        }
+    }
+    const std::vector<std::shared_ptr<const ImpulseBlock>> blocks = acquireBlocks(params, runBlocks);
+
+    parallelForChunks(0, numValid, [&](int begin, int end) {
+        TRACE_ZONE("point queries");
+        size_t run = static_cast<size_t>(std::upper_bound(std::begin(runStarts), std::end(runStarts), begin) - std::begin(runStarts)) - 1;
+        for (int i = begin; i < end; i++) {
+            while (run + 1 < runStarts.size() && runStarts[run + 1] <= i)
+                run++;
+            const size_t index = queries[static_cast<size_t>(i)].index;
+            const glm::vec2 p { xs[index], ys[index] };
+            const glm::ivec2 ij { glm::floor(p / cellsz) };
+            store(index, derivatives ? evaluatePoint<true>(*blocks[run], params.b, p, ij) : evaluatePoint<false>(*blocks[run], params.b, p, ij));
+        }
+    });
+}
+
+void PhasorNoiseSampler::evaluateOrientation(std::span<const float> xs, std::span<const float> ys, const PhasorNoiseParams& params, std::span<float> out) const
+{
+    ::evaluateOrientation(params, m_orientation, xs, ys, out);
+}
+
+std::vector<std::shared_ptr<const ImpulseBlock>> PhasorNoiseSampler::acquireBlocks(const PhasorNoiseParams& params, std::span<const BlockKey> keys)
+{
+    std::vector<std::shared_ptr<const ImpulseBlock>> blocks(keys.size());
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (auto iter = m_cache.find(keys[i]); iter != std::end(m_cache)) {
+            blocks[i] = iter->second.pBlock;
+            m_lru.splice(std::end(m_lru), m_lru, iter->second.lruPosition);
+        } else {
+            missing.push_back(i);
+        }
+    }
+
+    if (!missing.empty()) {
+        TRACE_ZONE("generate impulse blocks");
+        parallelForChunks(0, static_cast<int>(missing.size()), [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const size_t block = missing[static_cast<size_t>(i)];
+                blocks[block] = generateBlock(params, m_orientation, keys[block]);
+            }
+        });
+    }
+    for (size_t block : missing)
+        m_cache[keys[block]] = { blocks[block], m_lru.insert(std::end(m_lru), keys[block]) };
+
+    // The blocks of this batch are the most recently used ones. Evicting them is safe, they stay alive until
+    // the batch is done.
+    while (m_cache.size() > m_maxCachedBlocks) {
+        m_cache.erase(m_lru.front());
+        m_lru.pop_front();
+    }
+    return blocks;
+}
+
+void PhasorNoiseSampler::clearCache()
+{
+    m_cache.clear();
+    m_lru.clear();
+}
+
+size_t PhasorNoiseSampler::numCachedBlocks() const
+{
+    return m_cache.size();
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "phasor_noise.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// Impulses of a block of cells in the layout of the sampler (noise_sampler.cpp).
+struct ImpulseBlock;
+
+// Random access point queries of the phasor noise, for code that needs the noise at arbitrary positions
+// (displacement, shading in an offline renderer, ...) instead of images of a region. Queries come in
+// large batches of positions stored as separate x and y arrays. Internally the batch is sorted by cell, so
+// points that share impulses are evaluated together, the impulses are generated in blocks of cells that are
+// cached between batches, and the sorted batch is evaluated on the shared job system with SIMD over the
+// impulses of each point.
+class PhasorNoiseSampler {
+public:
+    // The phase field of a sampled orientation has to outlive the sampler and must not change while it
+    // is in use (call clearCache() after editing it).
+    explicit PhasorNoiseSampler(const OrientationSource& orientation, size_t maxCachedBlocks = 256);
+    PhasorNoiseSampler(const PhasorNoiseSampler&) = delete;
+    PhasorNoiseSampler& operator=(const PhasorNoiseSampler&) = delete;
+
+    // Evaluates the noise at the points (xs[i], ys[i]) (world space, like the regions of renderPhasorNoise()):
+    //  - phase: argument of the complex noise in [-pi, pi], the phi that applyProfiles() shapes;
+    //  - intensity: modulus of the complex noise;
+    //  - gradientX/Y: analytic derivatives of the phase with respect to x and y (radians per world unit).
+    // Outputs with an empty span are skipped, the others need one entry per point. Points that are not finite
+    // (or too far from the origin to index cells) give NaN. Calls must not overlap, but one call uses all threads.
+    void evaluate(std::span<const float> xs, std::span<const float> ys, const PhasorNoiseParams& params,
+        std::span<float> phase, std::span<float> intensity, std::span<float> gradientX, std::span<float> gradientY);
+
+    // Orientation of the phase field at the points (see evaluateOrientation() in phasor_noise.h), e.g. to align
+    // other detail with the stripes of the noise. out needs one entry per point.
+    void evaluateOrientation(std::span<const float> xs, std::span<const float> ys, const PhasorNoiseParams& params, std::span<float> out) const;
+
+    // Drops the cached impulses (they are also dropped when the parameters change).
+    void clearCache();
+    [[nodiscard]] size_t numCachedBlocks() const;
+
+private:
+    using BlockKey = uint64_t;
+
+    // Blocks of the keys in the same order, from the cache or newly generated (and then added to the cache).
+    [[nodiscard]] std::vector<std::shared_ptr<const ImpulseBlock>> acquireBlocks(const PhasorNoiseParams& params, std::span<const BlockKey> keys);
+
+private:
+    OrientationSource m_orientation;
+    size_t m_maxCachedBlocks;
+    std::optional<PhasorNoiseParams> m_cachedParams;
+    // Least recently used block at the front.
+    std::list<BlockKey> m_lru;
+    struct CachedBlock {
+        std::shared_ptr<const ImpulseBlock> pBlock;
+        std::list<BlockKey>::iterator lruPosition;
+    };
+    std::unordered_map<BlockKey, CachedBlock> m_cache;
+};
@@ -0,0 +1,322 @@
+#include "noise_writer.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cctype>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <string>
+
+static constexpr size_t maxStoredBlockSize = 65535;
+static constexpr uint64_t classicTiffHeaderSize = 8;
+static constexpr uint64_t bigTiffHeaderSize = 16;
+
+enum TiffType : uint16_t {
+    TiffShort = 3,
+    TiffLong = 4,
+    TiffLong8 = 16
+};
+
+struct TiffEntry {
+    uint16_t tag;
+    uint16_t type;
+    std::vector<uint64_t> values;
+};
+
+static void appendLittleEndian(std::vector<uint8_t>& out, uint64_t value, int numBytes)
+{
+    for (int i = 0; i < numBytes; i++)
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+static void appendBigEndian(std::vector<uint8_t>& out, uint64_t value, int numBytes)
+{
+    for (int i = numBytes - 1; i >= 0; i--)
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+static uint32_t crc32(std::span<const uint8_t> data, uint32_t crc = 0)
+{
+    static const auto table = []() {
+        std::array<uint32_t, 256> out {};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            out[n] = c;
+        }
+        return out;
+    }();
+
+    crc = ~crc;
+    for (uint8_t byte : data)
+        crc = table[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static int tiffTypeSize(uint16_t type)
+{
+    switch (type) {
+    case TiffShort:
+        return 2;
+    case TiffLong:
+        return 4;
+    default:
+        return 8;
+    };
+}
+
+NoiseFileFormat noiseFileFormatFromPath(const std::filesystem::path& filePath)
+{
+    std::string extension = filePath.extension().string();
+    std::transform(std::begin(extension), std::end(extension), std::begin(extension), [](char c) { return static_cast<char>(std::tolower(c)); });
+    if (extension == ".png")
+        return NoiseFileFormat::Png;
+    if (extension == ".tif" || extension == ".tiff")
+        return NoiseFileFormat::Tiff;
+    return NoiseFileFormat::Raw;
+}
+
+NoiseFileWriter::NoiseFileWriter(const std::filesystem::path& filePath, NoiseFileFormat format, int width, int height, int bitsPerSample)
+    : m_file(filePath, std::ios::binary)
+    , m_format(format)
+    , m_width(width)
+    , m_height(height)
+    , m_bitsPerSample(bitsPerSample)
+{
+    assert(width > 0 && height > 0);
+    assert(bitsPerSample == 8 || bitsPerSample == 16);
+    if (!m_file) {
+        std::cerr << "Could not open " << filePath << " for writing" << std::endl;
+        throw std::exception();
+    }
+
+    const uint64_t rowBytes = static_cast<uint64_t>(width) * static_cast<uint64_t>(bitsPerSample / 8);
+    std::vector<uint8_t> header;
+    switch (format) {
+    case NoiseFileFormat::Raw:
+        break;
+    case NoiseFileFormat::Tiff: {
+        // Strips of roughly 64KB let readers decode the image piece by piece.
+        m_rowsPerStrip = static_cast<int>(std::clamp<uint64_t>(65536 / rowBytes, 1, static_cast<uint64_t>(height)));
+        const uint64_t numStrips = static_cast<uint64_t>((height + m_rowsPerStrip - 1) / m_rowsPerStrip);
+        const uint64_t classicFileSize = classicTiffHeaderSize + rowBytes * static_cast<uint64_t>(height) + 8 * numStrips + 512;
+        m_bigTiff = classicFileSize > std::numeric_limits<uint32_t>::max();
+
+        // The offset of the image file directory is patched in by finish().
+        header = { 'I', 'I' };
+        if (m_bigTiff) {
+            appendLittleEndian(header, 43, 2);
+            appendLittleEndian(header, 8, 2); // Size of offsets.
+            appendLittleEndian(header, 0, 2);
+            appendLittleEndian(header, 0, 8);
+        } else {
+            appendLittleEndian(header, 42, 2);
+            appendLittleEndian(header, 0, 4);
+        }
+        break;
+    }
+    case NoiseFileFormat::Png: {
+        header = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        m_file.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(header.size()));
+        header.clear();
+        appendBigEndian(header, static_cast<uint64_t>(width), 4);
+        appendBigEndian(header, static_cast<uint64_t>(height), 4);
+        header.push_back(static_cast<uint8_t>(bitsPerSample));
+        header.insert(std::end(header), { 0, 0, 0, 0 }); // Grayscale, deflate, no filter, no interlace.
+        writePngChunk("IHDR", header);
+        // Start of the zlib stream: deflate with a 32K window, no preset dictionary.
+        writePngChunk("IDAT", std::array<uint8_t, 2> { 0x78, 0x01 });
+        header.clear();
+        break;
+    }
+    };
+    m_file.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(header.size()));
+}
+
+int NoiseFileWriter::rowsWritten() const
+{
+    return m_rowsWritten;
+}
+
+void NoiseFileWriter::writeRows(std::span<const float> rows)
+{
+    assert(rows.size() % static_cast<size_t>(m_width) == 0);
+    const int numRows = static_cast<int>(rows.size() / static_cast<size_t>(m_width));
+    assert(m_rowsWritten + numRows <= m_height);
+    m_rowsWritten += numRows;
+
+    if (m_format == NoiseFileFormat::Png) {
+        quantizeRows(rows, true, true);
+
+        // Adler-32 of the uncompressed stream. 5552 is the largest run of bytes after which b cannot overflow.
+        for (size_t begin = 0; begin < m_buffer.size(); begin += 5552) {
+            const size_t end = std::min(begin + 5552, m_buffer.size());
+            for (size_t i = begin; i < end; i++) {
+                m_adlerA += m_buffer[i];
+                m_adlerB += m_adlerA;
+            }
+            m_adlerA %= 65521;
+            m_adlerB %= 65521;
+        }
+        m_pendingDeflate.insert(std::end(m_pendingDeflate), std::begin(m_buffer), std::end(m_buffer));
+        writePngStoredBlocks(false);
+    } else {
+        quantizeRows(rows, false, false);
+        m_file.write(reinterpret_cast<const char*>(m_buffer.data()), static_cast<std::streamsize>(m_buffer.size()));
+    }
+
+    if (!m_file) {
+        std::cerr << "Failed to write noise image rows" << std::endl;
+        throw std::exception();
+    }
+}
+
+void NoiseFileWriter::finish()
+{
+    assert(m_rowsWritten == m_height);
+    if (m_format == NoiseFileFormat::Png) {
+        writePngStoredBlocks(true);
+        writePngChunk("IEND", {});
+    } else if (m_format == NoiseFileFormat::Tiff) {
+        writeTiffDirectory();
+    }
+    m_file.flush();
+    if (!m_file) {
+        std::cerr << "Failed to finish writing the noise image" << std::endl;
+        throw std::exception();
+    }
+}
+
+void NoiseFileWriter::quantizeRows(std::span<const float> rows, bool bigEndian, bool pngFilterByte)
+{
+    const size_t bytesPerSample = static_cast<size_t>(m_bitsPerSample / 8);
+    const size_t width = static_cast<size_t>(m_width);
+    const size_t numRows = rows.size() / width;
+    m_buffer.resize(numRows * ((pngFilterByte ? 1 : 0) + width * bytesPerSample));
+
+    uint8_t* pOut = m_buffer.data();
+    const float maxValue = m_bitsPerSample == 8 ? 255.0f : 65535.0f;
+    for (size_t y = 0; y < numRows; y++) {
+        if (pngFilterByte)
+            *pOut++ = 0; // Filter type None.
+        for (const float value : rows.subspan(y * width, width)) {
+            const auto sample = static_cast<uint16_t>(std::clamp(value, 0.0f, 1.0f) * maxValue + 0.5f);
+            if (bytesPerSample == 1) {
+                *pOut++ = static_cast<uint8_t>(sample);
+            } else if (bigEndian) {
+                *pOut++ = static_cast<uint8_t>(sample >> 8);
+                *pOut++ = static_cast<uint8_t>(sample);
+            } else {
+                *pOut++ = static_cast<uint8_t>(sample);
+                *pOut++ = static_cast<uint8_t>(sample >> 8);
+            }
+        }
+    }
+}
+
+void NoiseFileWriter::writePngChunk(const char* type, std::span<const uint8_t> data)
+{
+    std::vector<uint8_t> header;
+    appendBigEndian(header, data.size(), 4);
+    header.insert(std::end(header), type, type + 4);
+    uint32_t crc = crc32(std::span(header).subspan(4));
+    crc = crc32(data, crc);
+
+    std::vector<uint8_t> footer;
+    appendBigEndian(footer, crc, 4);
+    m_file.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(header.size()));
+    m_file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    m_file.write(reinterpret_cast<const char*>(footer.data()), static_cast<std::streamsize>(footer.size()));
+}
+
+// Emits the pending scanlines as stored deflate blocks in a single IDAT chunk. Blocks hold at most
+// 64KB, so anything short of a full block is kept for the next call unless this is the final block.
+void NoiseFileWriter::writePngStoredBlocks(bool final)
+{
+    std::vector<uint8_t> chunk;
+    size_t offset = 0;
+    const auto emitBlock = [&](size_t size, bool last) {
+        chunk.push_back(last ? 1 : 0);
+        appendLittleEndian(chunk, size, 2);
+        appendLittleEndian(chunk, ~size & 0xFFFF, 2);
+        chunk.insert(std::end(chunk), std::begin(m_pendingDeflate) + static_cast<ptrdiff_t>(offset), std::begin(m_pendingDeflate) + static_cast<ptrdiff_t>(offset + size));
+        offset += size;
+    };
+
+    while (m_pendingDeflate.size() - offset > maxStoredBlockSize || (!final && m_pendingDeflate.size() - offset == maxStoredBlockSize))
+        emitBlock(maxStoredBlockSize, false);
+    if (final) {
+        emitBlock(m_pendingDeflate.size() - offset, true);
+        appendBigEndian(chunk, (m_adlerB << 16) | m_adlerA, 4);
+    }
+    m_pendingDeflate.erase(std::begin(m_pendingDeflate), std::begin(m_pendingDeflate) + static_cast<ptrdiff_t>(offset));
+
+    if (!chunk.empty())
+        writePngChunk("IDAT", chunk);
+}
+
+// The directory goes after the image data because the strip offsets are only final at the end.
+void NoiseFileWriter::writeTiffDirectory()
+{
+    const uint64_t rowBytes = static_cast<uint64_t>(m_width) * static_cast<uint64_t>(m_bitsPerSample / 8);
+    const uint16_t offsetType = m_bigTiff ? TiffLong8 : TiffLong;
+    std::vector<uint64_t> stripOffsets, stripByteCounts;
+    for (int y = 0; y < m_height; y += m_rowsPerStrip) {
+        stripOffsets.push_back((m_bigTiff ? bigTiffHeaderSize : classicTiffHeaderSize) + static_cast<uint64_t>(y) * rowBytes);
+        stripByteCounts.push_back(static_cast<uint64_t>(std::min(m_rowsPerStrip, m_height - y)) * rowBytes);
+    }
+
+    // Sorted by tag, as required by the specification.
+    const std::vector<TiffEntry> entries {
+        { 256, TiffLong, { static_cast<uint64_t>(m_width) } }, // ImageWidth
+        { 257, TiffLong, { static_cast<uint64_t>(m_height) } }, // ImageLength
+        { 258, TiffShort, { static_cast<uint64_t>(m_bitsPerSample) } }, // BitsPerSample
+        { 259, TiffShort, { 1 } }, // Compression: none
+        { 262, TiffShort, { 1 } }, // PhotometricInterpretation: black is zero
+        { 273, offsetType, stripOffsets }, // StripOffsets
+        { 277, TiffShort, { 1 } }, // SamplesPerPixel
+        { 278, TiffLong, { static_cast<uint64_t>(m_rowsPerStrip) } }, // RowsPerStrip
+        { 279, offsetType, stripByteCounts } // StripByteCounts
+    };
+
+    const int countSize = m_bigTiff ? 8 : 2;
+    const int entrySize = m_bigTiff ? 20 : 12;
+    const int valueSize = m_bigTiff ? 8 : 4;
+
+    // Align the directory to 8 bytes.
+    const uint64_t dataEnd = static_cast<uint64_t>(m_file.tellp());
+    const std::vector<char> padding((8 - dataEnd % 8) % 8, 0);
+    m_file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    const uint64_t directoryOffset = dataEnd + padding.size();
+
+    // Values that do not fit in the entry itself are stored right after the directory.
+    std::vector<uint8_t> directory, overflow;
+    uint64_t overflowOffset = directoryOffset + static_cast<uint64_t>(countSize + static_cast<int>(entries.size()) * entrySize + valueSize);
+    appendLittleEndian(directory, entries.size(), countSize);
+    for (const TiffEntry& entry : entries) {
+        const int typeSize = tiffTypeSize(entry.type);
+        appendLittleEndian(directory, entry.tag, 2);
+        appendLittleEndian(directory, entry.type, 2);
+        appendLittleEndian(directory, entry.values.size(), valueSize);
+
+        std::vector<uint8_t>& target = static_cast<int>(entry.values.size()) * typeSize <= valueSize ? directory : overflow;
+        if (&target == &overflow)
+            appendLittleEndian(directory, overflowOffset + overflow.size(), valueSize);
+        const size_t valuesBegin = target.size();
+        for (uint64_t value : entry.values)
+            appendLittleEndian(target, value, typeSize);
+        if (&target == &directory)
+            directory.resize(valuesBegin + static_cast<size_t>(valueSize), 0);
+    }
+    appendLittleEndian(directory, 0, valueSize); // No next directory.
+    m_file.write(reinterpret_cast<const char*>(directory.data()), static_cast<std::streamsize>(directory.size()));
+    m_file.write(reinterpret_cast<const char*>(overflow.data()), static_cast<std::streamsize>(overflow.size()));
+
+    std::vector<uint8_t> offset;
+    appendLittleEndian(offset, directoryOffset, valueSize);
+    m_file.seekp(m_bigTiff ? 8 : 4);
+    m_file.write(reinterpret_cast<const char*>(offset.data()), static_cast<std::streamsize>(offset.size()));
+    m_file.seekp(0, std::ios::end);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <vector>
+
+enum class NoiseFileFormat {
+    Raw, // Headerless samples (little endian when 16 bit).
+    Tiff, // Uncompressed baseline TIFF, BigTIFF when the file would exceed 4GB.
+    Png // Stored (uncompressed) deflate blocks, so the image can be written without buffering it.
+};
+
+// Picks the format from the extension (.png, .tif/.tiff, anything else is raw).
+[[nodiscard]] NoiseFileFormat noiseFileFormatFromPath(const std::filesystem::path& filePath);
+
+// Writes a single channel image from top to bottom, a few rows at a time. Only the rows passed to
+// writeRows() are in memory, so the image size is only limited by the disk.
+class NoiseFileWriter {
+public:
+    NoiseFileWriter(const std::filesystem::path& filePath, NoiseFileFormat format, int width, int height, int bitsPerSample = 8);
+    NoiseFileWriter(const NoiseFileWriter&) = delete;
+
+    // Appends whole rows of values in [0, 1] (rows.size() must be a multiple of the width).
+    void writeRows(std::span<const float> rows);
+    // Writes the trailing data (PNG end of stream, TIFF directory). All rows must have been written.
+    void finish();
+
+    [[nodiscard]] int rowsWritten() const;
+
+private:
+    void quantizeRows(std::span<const float> rows, bool bigEndian, bool pngFilterByte);
+    void writePngChunk(const char* type, std::span<const uint8_t> data);
+    void writePngStoredBlocks(bool final);
+    void writeTiffDirectory();
+
+private:
+    std::ofstream m_file;
+    NoiseFileFormat m_format;
+    int m_width, m_height, m_bitsPerSample;
+    int m_rowsWritten { 0 };
+    std::vector<uint8_t> m_buffer;
+
+    // PNG: filtered scanlines not yet emitted as a stored block and the adler32 checksum of all of them.
+    std::vector<uint8_t> m_pendingDeflate;
+    uint32_t m_adlerA { 1 }, m_adlerB { 0 };
+
+    // TIFF
+    bool m_bigTiff { false };
+    int m_rowsPerStrip { 1 };
+};
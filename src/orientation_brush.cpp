@@ -0,0 +1,68 @@
+#include "orientation_brush.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+bool TexelRect::empty() const
+{
+    return begin.x >= end.x || begin.y >= end.y;
+}
+
+TexelRect TexelRect::united(const TexelRect& other) const
+{
+    if (empty())
+        return other;
+    if (other.empty())
+        return *this;
+    return { glm::min(begin, other.begin), glm::max(end, other.end) };
+}
+
+// Orientation in [0, period) turns.
+static float wrapOrientation(float turns, float period)
+{
+    return turns - period * std::floor(turns / period);
+}
+
+TexelRect paintOrientation(PhaseField& field, const glm::vec2& from, const glm::vec2& to, const OrientationBrushSettings& settings)
+{
+    const glm::vec2 stroke = to - from;
+    const float length = glm::length(stroke);
+    if (length <= 0.0f || settings.radius <= 0.0f)
+        return {};
+    const float period = field.period;
+    const float orientation = wrapOrientation(std::atan2(stroke.y, stroke.x) / (2.0f * std::numbers::pi_v<float>), period);
+
+    // Dabs overlap by three quarters, so the stroke has no visible steps.
+    const float spacing = std::max(0.25f * settings.radius, 0.5f);
+    const int numDabs = std::max(static_cast<int>(std::ceil(length / spacing)), 1);
+    const float radius2 = settings.radius * settings.radius;
+    TexelRect changed;
+    for (int dab = 1; dab <= numDabs; dab++) {
+        const glm::vec2 centre = from + stroke * (static_cast<float>(dab) / static_cast<float>(numDabs));
+        const glm::ivec2 begin = glm::max(glm::ivec2(glm::floor(centre - settings.radius)), glm::ivec2(0));
+        const glm::ivec2 end = glm::min(glm::ivec2(glm::ceil(centre + settings.radius)), glm::ivec2(field.width, field.height));
+        if (glm::any(glm::greaterThanEqual(begin, end)))
+            continue;
+
+        for (int y = begin.y; y < end.y; y++) {
+            for (int x = begin.x; x < end.x; x++) {
+                const glm::vec2 offset = glm::vec2(x, y) + 0.5f - centre;
+                const float falloff = 1.0f - glm::dot(offset, offset) / radius2;
+                if (falloff <= 0.0f)
+                    continue;
+                // Takes the shorter way around the period (like PhaseField::sampleBicubic() unwraps).
+                float& value = field.values[static_cast<size_t>(y) * static_cast<size_t>(field.width) + static_cast<size_t>(x)];
+                float delta = orientation - value;
+                delta -= period * std::round(delta / period);
+                value = wrapOrientation(value + settings.strength * falloff * falloff * delta, period);
+            }
+        }
+        changed = changed.united({ begin, end });
+    }
+    return changed;
+}
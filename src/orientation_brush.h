@@ -0,0 +1,29 @@
+#pragma once
+#include "phase_field.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+
+// Texels [begin, end) of a phase field.
+struct TexelRect {
+    glm::ivec2 begin { 0 };
+    glm::ivec2 end { 0 };
+
+    [[nodiscard]] bool empty() const;
+    // Smallest rectangle that contains both.
+    [[nodiscard]] TexelRect united(const TexelRect& other) const;
+};
+
+struct OrientationBrushSettings {
+    float radius { 12.0f }; // In texels.
+    // Fraction of the way to the orientation of the stroke that a dab at the centre of the brush goes.
+    float strength { 0.35f };
+};
+
+// Paints the orientation of a stroke from `from` to `to` (positions in texels) into the field: dabs along
+// the segment pull the texels under the brush towards the direction of the stroke. Orientations are taken
+// modulo the period of the field and stored in [0, period), the same way that the samplers unwrap them. For
+// the axial edge tangents of structureTensorOrientation() (a period of 0.5 turns), going back and forth
+// paints the same orientation. Returns the texels that changed.
+TexelRect paintOrientation(PhaseField& field, const glm::vec2& from, const glm::vec2& to, const OrientationBrushSettings& settings);
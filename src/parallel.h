@@ -0,0 +1,10 @@
+#pragma once
+#include <framework/job_system.h>
+
+// Splits [begin, end) into chunks and calls body(chunkBegin, chunkEnd) for each chunk on the threads of the
+// shared job system. The calling thread helps with the chunks and the call returns once all of them are done.
+template <typename F>
+void parallelForChunks(int begin, int end, F&& body)
+{
+    jobSystem().parallelFor(begin, end, std::forward<F>(body));
+}
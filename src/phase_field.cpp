@@ -0,0 +1,158 @@
+#include "phase_field.h"
+#include <framework/gl_state.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/vec4.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+
+static glm::vec4 bsplineWeights(float t)
+{
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+    const float s = 1.0f - t;
+    return glm::vec4(s * s * s, 3.0f * t3 - 6.0f * t2 + 4.0f, -3.0f * t3 + 3.0f * t2 + 3.0f * t + 1.0f, t3) / 6.0f;
+}
+
+static GLenum toGLFormat(PhaseFieldFormat format)
+{
+    switch (format) {
+    case PhaseFieldFormat::R16F:
+        return GL_R16F;
+    case PhaseFieldFormat::R32F:
+        return GL_R32F;
+    };
+    return GL_R16F;
+}
+
+float kernelRadius(float b)
+{
+    return std::sqrt(-std::log(0.05f) / std::numbers::pi_v<float>) / b;
+}
+
+int phaseFieldResolution(float b, float domainExtent, const PhaseFieldSettings& settings, int maxResolution)
+{
+    const float texelsPerUnit = settings.samplesPerKernelRadius / kernelRadius(std::max(b, 1.0f));
+    const int resolution = static_cast<int>(std::ceil(domainExtent * texelsPerUnit));
+    return std::clamp(resolution, std::min(16, maxResolution), maxResolution);
+}
+
+PhaseField::PhaseField(int width_, int height_)
+    : width(width_)
+    , height(height_)
+    , values(static_cast<size_t>(width_) * static_cast<size_t>(height_), 0.0f)
+{
+}
+
+float PhaseField::texel(int x, int y, PhaseFieldWrap wrap) const
+{
+    if (wrap == PhaseFieldWrap::Repeat) {
+        x = ((x % width) + width) % width;
+        y = ((y % height) + height) % height;
+    } else {
+        x = std::clamp(x, 0, width - 1);
+        y = std::clamp(y, 0, height - 1);
+    }
+    return values[static_cast<size_t>(y) * static_cast<size_t>(width) + static_cast<size_t>(x)];
+}
+
+float PhaseField::sampleBicubic(const glm::vec2& textureCoordinates, PhaseFieldWrap wrap) const
+{
+    assert(width > 0 && height > 0);
+    const glm::vec2 st = textureCoordinates * glm::vec2(width, height) - 0.5f;
+    const glm::vec2 floorSt = glm::floor(st);
+    const glm::ivec2 base = glm::ivec2(floorSt);
+    const glm::vec2 t = st - floorSt;
+    const glm::vec4 wx = bsplineWeights(t.x);
+    const glm::vec4 wy = bsplineWeights(t.y);
+
+    const float reference = texel(base.x + (t.x < 0.5f ? 0 : 1), base.y + (t.y < 0.5f ? 0 : 1), wrap);
+    float result = 0.0f;
+    for (int j = 0; j < 4; j++) {
+        for (int i = 0; i < 4; i++) {
+            float value = texel(base.x + i - 1, base.y + j - 1, wrap);
+            value -= period * std::round((value - reference) / period);
+            result += wx[i] * wy[j] * value;
+        }
+    }
+    return result;
+}
+
+PhaseField PhaseField::upsampleBicubic(int newWidth, int newHeight) const
+{
+    PhaseField out { newWidth, newHeight };
+    out.period = period;
+    for (int y = 0; y < newHeight; y++) {
+        for (int x = 0; x < newWidth; x++) {
+            const glm::vec2 uv = (glm::vec2(x, y) + 0.5f) / glm::vec2(newWidth, newHeight);
+            out.values[static_cast<size_t>(y) * static_cast<size_t>(newWidth) + static_cast<size_t>(x)] = sampleBicubic(uv);
+        }
+    }
+    return out;
+}
+
+PhaseFieldTarget::~PhaseFieldTarget()
+{
+    freeResources();
+}
+
+bool PhaseFieldTarget::resize(int resolution, PhaseFieldFormat format)
+{
+    if (resolution == m_resolution && format == m_format && m_texture != 0)
+        return false;
+
+    // Immutable texture storage cannot be resized so the texture is recreated.
+    freeResources();
+    m_resolution = resolution;
+    m_format = format;
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &m_texture);
+    glTextureStorage2D(m_texture, 1, toGLFormat(format), resolution, resolution);
+    glTextureParameteri(m_texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(m_texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(m_texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(m_texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glCreateFramebuffers(1, &m_framebuffer);
+    glNamedFramebufferTexture(m_framebuffer, GL_COLOR_ATTACHMENT0, m_texture, 0);
+    return true;
+}
+
+GLuint PhaseFieldTarget::framebuffer() const
+{
+    return m_framebuffer;
+}
+
+GLuint PhaseFieldTarget::texture() const
+{
+    return m_texture;
+}
+
+int PhaseFieldTarget::resolution() const
+{
+    return m_resolution;
+}
+
+PhaseField PhaseFieldTarget::download() const
+{
+    PhaseField out { m_resolution, m_resolution };
+    glGetTextureImage(m_texture, 0, GL_RED, GL_FLOAT, static_cast<GLsizei>(out.values.size() * sizeof(float)), out.values.data());
+    return out;
+}
+
+void PhaseFieldTarget::freeResources()
+{
+    if (m_framebuffer != 0) {
+        glState().framebufferDeleted(m_framebuffer);
+        glDeleteFramebuffers(1, &m_framebuffer);
+    }
+    if (m_texture != 0) {
+        glState().textureDeleted(m_texture);
+        glDeleteTextures(1, &m_texture);
+    }
+    m_framebuffer = 0;
+    m_texture = 0;
+}
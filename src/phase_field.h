@@ -0,0 +1,78 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+#include <framework/opengl_includes.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include <vector>
+
+// Storage format of the single channel phase field target.
+enum class PhaseFieldFormat {
+    R16F,
+    R32F
+};
+
+enum class PhaseFieldWrap {
+    ClampToEdge,
+    Repeat
+};
+
+struct PhaseFieldSettings {
+    PhaseFieldFormat format { PhaseFieldFormat::R16F };
+    // The phase field is a sum of gaussians with a width of roughly 1/b, so a few texels per
+    // kernel radius are sufficient when the field is upsampled with a bicubic filter.
+    float samplesPerKernelRadius { 4.0f };
+    bool bicubic { true };
+};
+
+// Distance at which the gaussian kernel of bandwidth b falls below 5% (same as _kr in the shaders).
+[[nodiscard]] float kernelRadius(float b);
+// Resolution of a square phase field that covers domainExtent world units for bandwidth b.
+[[nodiscard]] int phaseFieldResolution(float b, float domainExtent, const PhaseFieldSettings& settings, int maxResolution);
+
+// Phase field on the CPU. Stores orientations in turns (angle / 2pi) in row major order.
+// Orientations repeat every `period` turns: 1 for the directions of the phase field pass, 0.5 for
+// axial orientations such as the edge tangents of structureTensorOrientation().
+struct PhaseField {
+public:
+    PhaseField() = default;
+    PhaseField(int width, int height);
+
+    [[nodiscard]] float texel(int x, int y, PhaseFieldWrap wrap = PhaseFieldWrap::ClampToEdge) const;
+    // Cubic B-spline reconstruction. Neighbouring texels are unwrapped by the period relative to the
+    // nearest texel so that interpolation does not cut through the discontinuity of the orientations.
+    [[nodiscard]] float sampleBicubic(const glm::vec2& textureCoordinates, PhaseFieldWrap wrap = PhaseFieldWrap::ClampToEdge) const;
+    [[nodiscard]] PhaseField upsampleBicubic(int newWidth, int newHeight) const;
+
+public:
+    int width { 0 }, height { 0 };
+    float period { 1.0f };
+    std::vector<float> values;
+};
+
+// Single channel floating point render target of the phase field pass.
+class PhaseFieldTarget {
+public:
+    PhaseFieldTarget() = default;
+    PhaseFieldTarget(const PhaseFieldTarget&) = delete;
+    ~PhaseFieldTarget();
+
+    // (Re)allocates the texture when the resolution or format changed. Returns true if it did.
+    bool resize(int resolution, PhaseFieldFormat format);
+
+    [[nodiscard]] GLuint framebuffer() const;
+    [[nodiscard]] GLuint texture() const;
+    [[nodiscard]] int resolution() const;
+
+    // Read the phase field back to the CPU (e.g. for the CPU bicubic path).
+    [[nodiscard]] PhaseField download() const;
+
+private:
+    void freeResources();
+
+private:
+    GLuint m_texture { 0 };
+    GLuint m_framebuffer { 0 };
+    int m_resolution { 0 };
+    PhaseFieldFormat m_format { PhaseFieldFormat::R16F };
+};
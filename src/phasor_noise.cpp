@@ -0,0 +1,505 @@
+#include "phasor_noise.h"
+#include "parallel.h"
+#include <framework/trace.h>
+#include <framework/variant_helper.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <utility>
+
+static constexpr float pi = std::numbers::pi_v<float>;
+// The PRNG returns values in (-1, 1) (the modulo of a negative number is negative), so impulses lie
+// up to one cell outside of their own cell. Kernels further than one cell (twice the kernel radius)
+// away contribute less than 0.05^4 and are skipped, which leaves the 5x5 cells around a point.
+static constexpr int neighbourhood = cellNeighbourhood;
+
+// PRNG of the shaders, including the 32 bit wrap around of the multiplication.
+class ShaderRandom {
+public:
+    explicit ShaderRandom(int32_t seed)
+        : m_state(seed)
+    {
+    }
+
+    float uniform01()
+    {
+        m_state = static_cast<int32_t>(static_cast<uint32_t>(m_state) * 3039177861u) % N;
+        return static_cast<float>(m_state) / static_cast<float>(N);
+    }
+    float uniform(float min, float max) { return min + uniform01() * (max - min); }
+
+private:
+    static constexpr int32_t N = 15487469;
+    int32_t m_state;
+};
+
+// The shaders loop over 128 bits but everything above bit 15 of x and y is shifted out of the 32 bit result.
+static int32_t morton(int32_t x, int32_t y)
+{
+    const uint32_t ux = static_cast<uint32_t>(x);
+    const uint32_t uy = static_cast<uint32_t>(y);
+    uint32_t z = 0;
+    for (uint32_t i = 0; i < 16; i++)
+        z |= ((ux & (1u << i)) << i) | ((uy & (1u << i)) << (i + 1));
+    return static_cast<int32_t>(z);
+}
+
+static glm::ivec2 wrapCell(const glm::ivec2& ij, int period)
+{
+    if (period <= 0)
+        return ij;
+    return ((ij % period) + period) % period;
+}
+
+static int32_t cellSeed(const glm::ivec2& ij, int32_t seed)
+{
+    const uint32_t h = static_cast<uint32_t>(morton(ij.x, ij.y)) + 333u;
+    return h == 0 ? 1 : static_cast<int32_t>(h + static_cast<uint32_t>(seed));
+}
+
+static glm::ivec2 cellOf(const glm::vec2& p, float cellsz)
+{
+    return glm::ivec2(glm::floor(p / cellsz));
+}
+
+static size_t cellIndex(const glm::ivec2& ij, const glm::ivec2& cellMin, int numCellsX)
+{
+    const glm::ivec2 local = ij - cellMin;
+    return static_cast<size_t>(local.y) * static_cast<size_t>(numCellsX) + static_cast<size_t>(local.x);
+}
+
+float cellSize(float b)
+{
+    return 2.0f * kernelRadius(b);
+}
+
+int periodInCells(float tileSize, float b)
+{
+    return std::max(1, static_cast<int>(std::round(tileSize / cellSize(b))));
+}
+
+void cellRangeForRegion(float b, const glm::vec2& regionMin, const glm::vec2& regionMax, glm::ivec2& cellMin, glm::ivec2& cellMax)
+{
+    const float cellsz = cellSize(b);
+    cellMin = cellOf(regionMin, cellsz) - neighbourhood;
+    cellMax = cellOf(regionMax, cellsz) + neighbourhood;
+}
+
+// Impulses of the procedural phase field (phase_field.glsl) in a range of cells.
+struct FieldImpulses {
+    glm::ivec2 cellMin, cellMax;
+    int impulsesPerCell;
+    std::vector<glm::vec2> positions;
+    std::vector<glm::vec2> directions;
+};
+
+static FieldImpulses generateFieldImpulses(const PhasorNoiseParams& params, int seed, const glm::ivec2& cellMin, const glm::ivec2& cellMax)
+{
+    const float cellsz = cellSize(params.b);
+    const glm::ivec2 numCells = cellMax - cellMin + 1;
+    FieldImpulses out { cellMin, cellMax, std::max(params.impulsesPerKernel + 1, 0), {}, {} };
+    const size_t count = static_cast<size_t>(numCells.x) * static_cast<size_t>(numCells.y) * static_cast<size_t>(out.impulsesPerCell);
+    out.positions.resize(count);
+    out.directions.resize(count);
+
+    parallelForChunks(cellMin.y, cellMax.y + 1, [&](int jBegin, int jEnd) {
+        for (int j = jBegin; j < jEnd; j++) {
+            for (int i = cellMin.x; i <= cellMax.x; i++) {
+                const glm::ivec2 ij { i, j };
+                ShaderRandom rng { cellSeed(wrapCell(ij, params.period), seed) };
+                size_t k = cellIndex(ij, cellMin, numCells.x) * static_cast<size_t>(out.impulsesPerCell);
+                for (int impulse = 0; impulse < out.impulsesPerCell; impulse++, k++) {
+                    const float cx = rng.uniform01();
+                    const float cy = rng.uniform01();
+                    const float omega = rng.uniform(-2.4f, 2.4f);
+                    out.positions[k] = (glm::vec2(ij) + glm::vec2(cx, cy)) * cellsz;
+                    out.directions[k] = glm::vec2(std::cos(omega), std::sin(omega));
+                }
+            }
+        }
+    });
+    return out;
+}
+
+static float proceduralOrientation(const FieldImpulses& field, float b, const glm::vec2& q)
+{
+    const glm::ivec2 ij = cellOf(q, cellSize(b));
+    const float a = pi * b * b;
+    const glm::ivec2 numCells = field.cellMax - field.cellMin + 1;
+    glm::vec2 sum { 0.0f };
+    for (int dj = -neighbourhood; dj <= neighbourhood; dj++) {
+        for (int di = -neighbourhood; di <= neighbourhood; di++) {
+            const size_t first = cellIndex(ij + glm::ivec2(di, dj), field.cellMin, numCells.x) * static_cast<size_t>(field.impulsesPerCell);
+            for (size_t k = first; k < first + static_cast<size_t>(field.impulsesPerCell); k++) {
+                const glm::vec2 d = q - field.positions[k];
+                sum += std::exp(-a * glm::dot(d, d)) * field.directions[k];
+            }
+        }
+    }
+    return std::atan2(sum.y, sum.x);
+}
+
+// The procedural phase field at an impulse centre needs the field impulses of the surrounding cells.
+// Impulses lie up to one cell outside of their cell, hence the extra cell of margin.
+static FieldImpulses fieldImpulsesForCells(const PhasorNoiseParams& params, const OrientationSource& orientation, const glm::ivec2& cellMin, const glm::ivec2& cellMax)
+{
+    if (const auto* pProcedural = std::get_if<ProceduralOrientation>(&orientation))
+        return generateFieldImpulses(params, pProcedural->seed, cellMin - (neighbourhood + 1), cellMax + (neighbourhood + 1));
+    return {};
+}
+
+// Orientation in radians at q. The field impulses are only read by the procedural orientation.
+static float orientationAt(const PhasorNoiseParams& params, const OrientationSource& orientation, const FieldImpulses& field, const glm::vec2& q)
+{
+    return std::visit(make_visitor(
+                          [&](const ProceduralOrientation&) {
+                              return proceduralOrientation(field, params.b, q);
+                          },
+                          [&](const SampledOrientation& sampled) {
+                              const glm::vec2 uv = (q - sampled.origin) / sampled.extent;
+                              const PhaseFieldWrap wrap = params.period > 0 ? PhaseFieldWrap::Repeat : PhaseFieldWrap::ClampToEdge;
+                              return sampled.pPhaseField->sampleBicubic(uv, wrap) * 2.0f * pi;
+                          }),
+        orientation);
+}
+
+// Writes the impulsesPerCell impulses of cell ij to pImpulse.
+static void generateCellImpulses(const PhasorNoiseParams& params, const OrientationSource& orientation, const FieldImpulses& field, const glm::ivec2& ij, Impulse* pImpulse)
+{
+    const float cellsz = cellSize(params.b);
+    const int impulsesPerCell = std::max(params.impulsesPerKernel + 1, 0);
+    ShaderRandom rng { cellSeed(wrapCell(ij, params.period), params.seed) };
+    for (int impulse = 0; impulse < impulsesPerCell; impulse++, pImpulse++) {
+        const float cx = rng.uniform01();
+        const float cy = rng.uniform01();
+        pImpulse->phase = rng.uniform(0.0f, 2.0f * pi);
+        pImpulse->position = (glm::vec2(ij) + glm::vec2(cx, cy)) * cellsz;
+        const float o = orientationAt(params, orientation, field, pImpulse->position);
+        pImpulse->frequency = 2.0f * pi * params.f * glm::vec2(std::cos(o), std::sin(o));
+    }
+}
+
+ImpulseGrid::ImpulseGrid(const PhasorNoiseParams& params, const OrientationSource& orientation, const glm::ivec2& cellMin_, const glm::ivec2& cellMax_)
+    : ImpulseGrid(params, orientation, cellMin_, cellMax_, ImpulseGrid {})
+{
+}
+
+ImpulseGrid::ImpulseGrid(const PhasorNoiseParams& params, const OrientationSource& orientation, const glm::ivec2& cellMin_, const glm::ivec2& cellMax_, const ImpulseGrid& previous)
+    : cellMin(cellMin_)
+    , cellMax(cellMax_)
+    , impulsesPerCell(std::max(params.impulsesPerKernel + 1, 0))
+{
+    TRACE_ZONE("ImpulseGrid");
+    const glm::ivec2 numCells = cellMax - cellMin + 1;
+    const size_t rowSize = static_cast<size_t>(numCells.x) * static_cast<size_t>(impulsesPerCell);
+    impulses.resize(static_cast<size_t>(numCells.y) * rowSize);
+
+    // Rows [sharedBegin, sharedEnd) are copied from the previous grid. Only whole rows are shared.
+    int sharedBegin = cellMax.y + 1, sharedEnd = cellMax.y + 1;
+    if (previous.cellMin.x == cellMin.x && previous.cellMax.x == cellMax.x && previous.impulsesPerCell == impulsesPerCell) {
+        const int overlapBegin = std::max(cellMin.y, previous.cellMin.y);
+        const int overlapEnd = std::min(cellMax.y, previous.cellMax.y) + 1;
+        if (overlapBegin < overlapEnd) {
+            sharedBegin = overlapBegin;
+            sharedEnd = overlapEnd;
+            std::copy_n(std::begin(previous.impulses) + static_cast<ptrdiff_t>(cellIndex({ cellMin.x, sharedBegin }, previous.cellMin, numCells.x) * static_cast<size_t>(impulsesPerCell)),
+                static_cast<size_t>(sharedEnd - sharedBegin) * rowSize,
+                std::begin(impulses) + static_cast<ptrdiff_t>(cellIndex({ cellMin.x, sharedBegin }, cellMin, numCells.x) * static_cast<size_t>(impulsesPerCell)));
+        }
+    }
+    const int generateBegin = sharedBegin == cellMin.y ? sharedEnd : cellMin.y;
+    const int generateEnd = sharedEnd == cellMax.y + 1 ? sharedBegin : cellMax.y + 1;
+    if (generateBegin >= generateEnd)
+        return;
+
+    const FieldImpulses field = fieldImpulsesForCells(params, orientation, { cellMin.x, generateBegin }, { cellMax.x, generateEnd - 1 });
+    parallelForChunks(generateBegin, generateEnd, [&](int jBegin, int jEnd) {
+        for (int j = jBegin; j < jEnd; j++) {
+            if (j >= sharedBegin && j < sharedEnd)
+                continue;
+            for (int i = cellMin.x; i <= cellMax.x; i++)
+                generateCellImpulses(params, orientation, field, { i, j }, &impulses[cellIndex({ i, j }, cellMin, numCells.x) * static_cast<size_t>(impulsesPerCell)]);
+        }
+    });
+}
+
+void ImpulseGrid::regenerate(const PhasorNoiseParams& params, const OrientationSource& orientation, const glm::ivec2& regenerateMin, const glm::ivec2& regenerateMax)
+{
+    assert(impulsesPerCell == std::max(params.impulsesPerKernel + 1, 0));
+    const glm::ivec2 rangeMin = glm::max(regenerateMin, cellMin);
+    const glm::ivec2 rangeMax = glm::min(regenerateMax, cellMax);
+    if (glm::any(glm::greaterThan(rangeMin, rangeMax)))
+        return;
+
+    TRACE_ZONE("ImpulseGrid::regenerate");
+    const int numCellsX = cellMax.x - cellMin.x + 1;
+    const FieldImpulses field = fieldImpulsesForCells(params, orientation, rangeMin, rangeMax);
+    parallelForChunks(rangeMin.y, rangeMax.y + 1, [&](int jBegin, int jEnd) {
+        for (int j = jBegin; j < jEnd; j++) {
+            for (int i = rangeMin.x; i <= rangeMax.x; i++)
+                generateCellImpulses(params, orientation, field, { i, j }, &impulses[cellIndex({ i, j }, cellMin, numCellsX) * static_cast<size_t>(impulsesPerCell)]);
+        }
+    });
+}
+
+bool ImpulseGrid::contains(const glm::ivec2& ij) const
+{
+    return glm::all(glm::greaterThanEqual(ij, cellMin)) && glm::all(glm::lessThanEqual(ij, cellMax));
+}
+
+std::span<const Impulse> ImpulseGrid::cell(const glm::ivec2& ij) const
+{
+    assert(contains(ij));
+    const size_t first = cellIndex(ij, cellMin, cellMax.x - cellMin.x + 1) * static_cast<size_t>(impulsesPerCell);
+    return std::span(impulses).subspan(first, static_cast<size_t>(impulsesPerCell));
+}
+
+// The derivative of a kernel exp(-a r^2) e^(i (d . frequency + phase)) with respect to x is the kernel times
+// (-2 a d.x + i frequency.x), and likewise for y.
+template <bool Derivatives>
+static PhasorNoiseSample sumKernels(const ImpulseGrid& grid, float b, const glm::vec2& p)
+{
+    const float cellsz = cellSize(b);
+    const float cutoff2 = cellsz * cellsz;
+    const float a = pi * b * b;
+    const glm::ivec2 ij = cellOf(p, cellsz);
+
+    PhasorNoiseSample out;
+    for (int dj = -neighbourhood; dj <= neighbourhood; dj++) {
+        for (int di = -neighbourhood; di <= neighbourhood; di++) {
+            for (const Impulse& impulse : grid.cell(ij + glm::ivec2(di, dj))) {
+                const glm::vec2 d = p - impulse.position;
+                const float r2 = glm::dot(d, d);
+                if (r2 > cutoff2)
+                    continue;
+                const float amplitude = std::exp(-a * r2);
+                const float argument = glm::dot(d, impulse.frequency) + impulse.phase;
+                const glm::vec2 kernel = amplitude * glm::vec2(std::cos(argument), std::sin(argument));
+                out.noise += kernel;
+                if constexpr (Derivatives) {
+                    const glm::vec2 gaussian = -2.0f * a * d;
+                    const glm::vec2 iKernel { -kernel.y, kernel.x };
+                    out.ddx += gaussian.x * kernel + impulse.frequency.x * iKernel;
+                    out.ddy += gaussian.y * kernel + impulse.frequency.y * iKernel;
+                }
+            }
+        }
+    }
+    return out;
+}
+
+void evaluateOrientation(const PhasorNoiseParams& params, const OrientationSource& orientation, std::span<const float> xs, std::span<const float> ys, std::span<float> out)
+{
+    assert(xs.size() == ys.size() && out.size() == xs.size() && xs.size() <= static_cast<size_t>(std::numeric_limits<int>::max()));
+    TRACE_ZONE("evaluateOrientation");
+    const int numPoints = static_cast<int>(xs.size());
+    if (std::holds_alternative<SampledOrientation>(orientation)) {
+        parallelForChunks(0, numPoints, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const size_t index = static_cast<size_t>(i);
+                const glm::vec2 q { xs[index], ys[index] };
+                out[index] = std::isfinite(q.x) && std::isfinite(q.y) ? orientationAt(params, orientation, {}, q) : std::numeric_limits<float>::quiet_NaN();
+            }
+        });
+        return;
+    }
+
+    // The procedural field needs the field impulses around every point. The points are grouped by blocks of
+    // cells, so the impulses of a block are generated once for all of its points.
+    constexpr int blockShift = 4;
+    constexpr float maxCellIndex = static_cast<float>(1 << 29);
+    const float cellsz = cellSize(params.b);
+    std::vector<std::pair<glm::ivec2, int>> points;
+    points.reserve(xs.size());
+    for (int i = 0; i < numPoints; i++) {
+        const size_t index = static_cast<size_t>(i);
+        const glm::vec2 cell = glm::floor(glm::vec2(xs[index], ys[index]) / cellsz);
+        // Also false for NaN.
+        if (std::abs(cell.x) <= maxCellIndex && std::abs(cell.y) <= maxCellIndex)
+            points.emplace_back(glm::ivec2(cell) >> blockShift, i);
+        else
+            out[index] = std::numeric_limits<float>::quiet_NaN();
+    }
+    std::sort(std::begin(points), std::end(points), [](const auto& lhs, const auto& rhs) {
+        return lhs.first.y != rhs.first.y ? lhs.first.y < rhs.first.y : (lhs.first.x != rhs.first.x ? lhs.first.x < rhs.first.x : lhs.second < rhs.second);
+    });
+    std::vector<size_t> runStarts;
+    for (size_t i = 0; i < points.size(); i++) {
+        if (i == 0 || points[i].first != points[i - 1].first)
+            runStarts.push_back(i);
+    }
+    runStarts.push_back(points.size());
+
+    parallelForChunks(0, static_cast<int>(runStarts.size()) - 1, [&](int begin, int end) {
+        for (int run = begin; run < end; run++) {
+            const size_t first = runStarts[static_cast<size_t>(run)];
+            const size_t last = runStarts[static_cast<size_t>(run) + 1];
+            const glm::ivec2 cellMin = points[first].first << blockShift;
+            const FieldImpulses field = fieldImpulsesForCells(params, orientation, cellMin, cellMin + ((1 << blockShift) - 1));
+            for (size_t i = first; i < last; i++) {
+                const size_t index = static_cast<size_t>(points[i].second);
+                out[index] = orientationAt(params, orientation, field, { xs[index], ys[index] });
+            }
+        }
+    });
+}
+
+glm::vec2 evaluatePhasorNoise(const ImpulseGrid& grid, float b, const glm::vec2& p)
+{
+    return sumKernels<false>(grid, b, p).noise;
+}
+
+PhasorNoiseSample evaluatePhasorNoiseDerivatives(const ImpulseGrid& grid, float b, const glm::vec2& p)
+{
+    return sumKernels<true>(grid, b, p);
+}
+
+glm::vec2 phaseGradient(const PhasorNoiseSample& sample)
+{
+    // d atan2(im, re) = (re dim - im dre) / |noise|^2.
+    const glm::vec2 noise = sample.noise;
+    const float norm2 = glm::dot(noise, noise);
+    if (norm2 <= 0.0f)
+        return glm::vec2(0.0f);
+    return glm::vec2(noise.x * sample.ddx.y - noise.y * sample.ddx.x, noise.x * sample.ddy.y - noise.y * sample.ddy.x) / norm2;
+}
+
+glm::vec3 bumpNormal(const PhasorNoiseSample& sample, float f, float slope)
+{
+    const float phi = std::atan2(sample.noise.y, sample.noise.x);
+    const glm::vec2 heightGradient = slope / (2.0f * pi * f) * std::cos(phi) * phaseGradient(sample);
+    return glm::normalize(glm::vec3(-heightGradient, 1.0f));
+}
+
+// GLSL mod(): x - y * floor(x / y).
+static float glslMod(float x, float y)
+{
+    return x - y * std::floor(x / y);
+}
+
+float applyProfiles(const std::array<bool, 4>& profiles, const glm::vec2& noise, float x)
+{
+    const float phi = std::atan2(noise.y, noise.x);
+    if (std::none_of(std::begin(profiles), std::end(profiles), [](bool enabled) { return enabled; }))
+        return std::sin(phi) * 0.3f + 0.5f;
+
+    const auto pwm = [](float v, float r) { return glslMod(v, 2.0f * pi) > 2.0f * pi * r ? 1.0f : 0.0f; };
+    const auto sawTooth = [](float v) { return glslMod(v, 2.0f * pi) / (2.0f * pi); };
+    const auto blend = [&](float centre) { return std::exp(-(x - centre) * (x - centre) * 20.0f); };
+
+    float profile = 0.0f, sumGaus = 0.0f;
+    if (profiles[0]) {
+        profile += pwm(phi, x + 0.2f * 0.5f) * blend(0.2f);
+        sumGaus += blend(0.2f);
+    }
+    if (profiles[1]) {
+        profile += sawTooth(phi) * blend(0.4f);
+        sumGaus += blend(0.4f);
+    }
+    if (profiles[2]) {
+        profile += (std::sin(phi + pi) + 0.5f * 0.5f) * blend(0.8f);
+        sumGaus += blend(0.8f);
+    }
+    if (profiles[3]) {
+        profile += sawTooth(phi + pi / 2.0f) * blend(0.1f);
+        sumGaus += blend(0.1f);
+    }
+    return profile / sumGaus;
+}
+
+// Renders rows [firstRow, firstRow + out.height) of the region into out (until the cancellation token is cancelled).
+static void renderRows(const ImpulseGrid& grid, const PhasorNoiseParams& params, const PhasorNoiseRegion& region, int firstRow, NoiseImage& out, const CancellationToken& cancellation = {})
+{
+    const glm::vec2 pixelSize = region.size / glm::vec2(region.width, region.height);
+    parallelForChunks(0, out.height, [&](int yBegin, int yEnd) {
+        TRACE_ZONE("noise rows");
+        for (int y = yBegin; y < yEnd && !cancellation.isCancelled(); y++) {
+            for (int x = 0; x < region.width; x++) {
+                const glm::vec2 p = region.origin + (glm::vec2(x, firstRow + y) + 0.5f) * pixelSize;
+                const glm::vec2 noise = evaluatePhasorNoise(grid, params.b, p);
+                out.pixels[static_cast<size_t>(y) * static_cast<size_t>(region.width) + static_cast<size_t>(x)] = applyProfiles(params.profiles, noise, p.x);
+            }
+        }
+    });
+}
+
+NoiseImage renderPhasorNoise(const PhasorNoiseParams& params, const OrientationSource& orientation, const PhasorNoiseRegion& region, const CancellationToken& cancellation)
+{
+    glm::ivec2 cellMin, cellMax;
+    cellRangeForRegion(params.b, region.origin, region.origin + region.size, cellMin, cellMax);
+    const ImpulseGrid grid { params, orientation, cellMin, cellMax };
+
+    NoiseImage out { region.width, region.height, std::vector<float>(static_cast<size_t>(region.width) * static_cast<size_t>(region.height)) };
+    renderRows(grid, params, region, 0, out, cancellation);
+    return out;
+}
+
+NormalImage renderPhasorNoiseNormals(const PhasorNoiseParams& params, const OrientationSource& orientation, const PhasorNoiseRegion& region, float slope, NoiseImage* pNoise)
+{
+    glm::ivec2 cellMin, cellMax;
+    cellRangeForRegion(params.b, region.origin, region.origin + region.size, cellMin, cellMax);
+    const ImpulseGrid grid { params, orientation, cellMin, cellMax };
+
+    const size_t numPixels = static_cast<size_t>(region.width) * static_cast<size_t>(region.height);
+    NormalImage out { region.width, region.height, std::vector<glm::vec3>(numPixels) };
+    if (pNoise)
+        *pNoise = NoiseImage { region.width, region.height, std::vector<float>(numPixels) };
+    const glm::vec2 pixelSize = region.size / glm::vec2(region.width, region.height);
+    parallelForChunks(0, region.height, [&](int yBegin, int yEnd) {
+        TRACE_ZONE("normal rows");
+        for (int y = yBegin; y < yEnd; y++) {
+            for (int x = 0; x < region.width; x++) {
+                const glm::vec2 p = region.origin + (glm::vec2(x, y) + 0.5f) * pixelSize;
+                const size_t index = static_cast<size_t>(y) * static_cast<size_t>(region.width) + static_cast<size_t>(x);
+                const PhasorNoiseSample sample = evaluatePhasorNoiseDerivatives(grid, params.b, p);
+                out.normals[index] = bumpNormal(sample, params.f, slope);
+                if (pNoise)
+                    pNoise->pixels[index] = applyProfiles(params.profiles, sample.noise, p.x);
+            }
+        }
+    });
+    return out;
+}
+
+void renderPhasorNoiseStrips(const PhasorNoiseParams& params, const OrientationSource& orientation, const PhasorNoiseRegion& region, int stripHeight,
+    const std::function<void(const NoiseImage& strip)>& consumeStrip)
+{
+    assert(stripHeight > 0);
+    const float pixelHeight = region.size.y / static_cast<float>(region.height);
+
+    // Double buffered: strip i + 1 is rendered while strip i is consumed.
+    std::array<NoiseImage, 2> strips;
+    JobHandle consumed;
+    ImpulseGrid grid;
+    for (int firstRow = 0, current = 0; firstRow < region.height; firstRow += stripHeight, current ^= 1) {
+        const int numRows = std::min(stripHeight, region.height - firstRow);
+        const float yBegin = region.origin.y + static_cast<float>(firstRow) * pixelHeight;
+        const float yEnd = region.origin.y + static_cast<float>(firstRow + numRows) * pixelHeight;
+
+        glm::ivec2 cellMin, cellMax;
+        cellRangeForRegion(params.b, glm::vec2(region.origin.x, std::min(yBegin, yEnd)), glm::vec2(region.origin.x + region.size.x, std::max(yBegin, yEnd)), cellMin, cellMax);
+        grid = ImpulseGrid { params, orientation, cellMin, cellMax, grid };
+
+        NoiseImage& strip = strips[static_cast<size_t>(current)];
+        strip.width = region.width;
+        strip.height = numRows;
+        strip.pixels.resize(static_cast<size_t>(region.width) * static_cast<size_t>(numRows));
+        renderRows(grid, params, region, firstRow, strip);
+
+        if (consumed.valid())
+            consumed.wait();
+        consumed = jobSystem().submit([&consumeStrip, &strip]() {
+            TRACE_ZONE("consume strip");
+            consumeStrip(strip);
+        });
+    }
+    if (consumed.valid())
+        consumed.wait();
+}
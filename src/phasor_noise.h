@@ -0,0 +1,139 @@
+#pragma once
+#include "phase_field.h"
+#include <framework/disable_all_warnings.h>
+#include <framework/job_system.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <array>
+#include <functional>
+#include <span>
+#include <variant>
+#include <vector>
+
+// CPU implementation of phasor_noise.glsl. It reproduces the PRNG and cell hashing of the shaders, so
+// the impulses (positions and phases) are the same as on the GPU. The orientations, and thus the noise,
+// only agree approximately: see ProceduralOrientation and SampledOrientation.
+
+// Orientation of the impulses from the procedural phase field of phase_field.glsl, evaluated at every
+// impulse centre. The shader samples the field from the texture of the phase field pass instead, which
+// is filtered and has a limited resolution, or in the fused mode evaluates it once per cell centre.
+struct ProceduralOrientation {
+    int seed { 6 };
+};
+// Orientation sampled (bicubic) from a phase field that covers [origin, origin + extent] of the noise domain,
+// like the bicubic path of the shader. With a period the field repeats, so it should cover one period.
+struct SampledOrientation {
+    const PhaseField* pPhaseField;
+    glm::vec2 origin { 0.0f };
+    glm::vec2 extent { 1.0f };
+};
+using OrientationSource = std::variant<ProceduralOrientation, SampledOrientation>;
+
+struct PhasorNoiseParams {
+    float f { 50.0f };
+    float b { 30.0f };
+    int impulsesPerKernel { 16 };
+    int seed { 1 };
+    // The four functions of phasor_noise.glsl, each blended in with a gaussian along x.
+    std::array<bool, 4> profiles { false, false, false, false };
+    // When > 0 the cell indices (and thus the noise and the procedural phase field) repeat every
+    // period cells, making a square of period * cellSize(b) world units tile seamlessly. The
+    // profile blend varies along x and is only periodic when at most one profile is enabled.
+    int period { 0 };
+
+    [[nodiscard]] bool operator==(const PhasorNoiseParams&) const = default;
+};
+
+// Rectangle [origin, origin + size] of the noise domain rendered at width x height pixels.
+// Row 0 of the output corresponds to origin.y.
+struct PhasorNoiseRegion {
+    glm::vec2 origin { 0.0f };
+    glm::vec2 size { 1.0f };
+    int width { 512 };
+    int height { 512 };
+};
+
+// Grayscale output in [0, 1], row major.
+struct NoiseImage {
+    int width { 0 }, height { 0 };
+    std::vector<float> pixels;
+};
+
+// Normals of the noise (see bumpNormal()), row major like NoiseImage.
+struct NormalImage {
+    int width { 0 }, height { 0 };
+    std::vector<glm::vec3> normals;
+};
+
+struct Impulse {
+    glm::vec2 position; // World space.
+    glm::vec2 frequency; // 2 pi f (cos o, sin o).
+    float phase;
+};
+
+[[nodiscard]] float cellSize(float b);
+// The noise at a point sums the impulses of the cells up to this many cells away from its own cell.
+inline constexpr int cellNeighbourhood = 2;
+// Number of cells closest to tileSize world units (at least 1).
+[[nodiscard]] int periodInCells(float tileSize, float b);
+
+// Impulses of a rectangular range of cells, generated once and shared by all pixels that need them.
+class ImpulseGrid {
+public:
+    ImpulseGrid() = default;
+    ImpulseGrid(const PhasorNoiseParams& params, const OrientationSource& orientation, const glm::ivec2& cellMin, const glm::ivec2& cellMax);
+    // Copies the rows of cells that overlap with previous (the halo between consecutive strips) instead
+    // of generating them again. previous must have been created with the same params and orientation.
+    ImpulseGrid(const PhasorNoiseParams& params, const OrientationSource& orientation, const glm::ivec2& cellMin, const glm::ivec2& cellMax, const ImpulseGrid& previous);
+
+    // Generates the impulses of the cells in [regenerateMin, regenerateMax] (clipped to the grid) again, e.g.
+    // after the orientation changed there. params must be the ones that the grid was created with.
+    void regenerate(const PhasorNoiseParams& params, const OrientationSource& orientation, const glm::ivec2& regenerateMin, const glm::ivec2& regenerateMax);
+
+    [[nodiscard]] std::span<const Impulse> cell(const glm::ivec2& ij) const;
+    [[nodiscard]] bool contains(const glm::ivec2& ij) const;
+
+public:
+    glm::ivec2 cellMin { 0 }, cellMax { -1 }; // Inclusive.
+    int impulsesPerCell { 0 };
+    std::vector<Impulse> impulses;
+};
+
+// Cells that have to be present in an ImpulseGrid to evaluate the noise in [regionMin, regionMax].
+void cellRangeForRegion(float b, const glm::vec2& regionMin, const glm::vec2& regionMax, glm::ivec2& cellMin, glm::ivec2& cellMax);
+
+// Orientation (in radians) that an impulse at the point (xs[i], ys[i]) gets, i.e. the phase field of the noise
+// at arbitrary points: the procedural field or a bicubic sample of the phase field. out needs one entry per
+// point. Points that are not finite (or too far from the origin to index cells) give NaN.
+void evaluateOrientation(const PhasorNoiseParams& params, const OrientationSource& orientation, std::span<const float> xs, std::span<const float> ys, std::span<float> out);
+
+// Complex sum of the phasor kernels at world position p (noise before the profile is applied).
+[[nodiscard]] glm::vec2 evaluatePhasorNoise(const ImpulseGrid& grid, float b, const glm::vec2& p);
+// Complex noise and its derivatives with respect to x and y.
+struct PhasorNoiseSample {
+    glm::vec2 noise { 0.0f };
+    glm::vec2 ddx { 0.0f }, ddy { 0.0f };
+};
+// evaluatePhasorNoise() together with the analytic derivatives of the complex sum, which cost a fraction of
+// the two extra evaluations of finite differences (and do not alias).
+[[nodiscard]] PhasorNoiseSample evaluatePhasorNoiseDerivatives(const ImpulseGrid& grid, float b, const glm::vec2& p);
+// Gradient of the phase atan2(noise.y, noise.x), 0 at the zeros of the noise where the phase is undefined.
+[[nodiscard]] glm::vec2 phaseGradient(const PhasorNoiseSample& sample);
+// Normal of the bump sin(phi) * slope / (2 pi f) of the sine profile, same as the normal map of phasor_noise.glsl.
+// The gradient of the phase is close to 2 pi f, so the steepest slope of the bump is close to slope.
+[[nodiscard]] glm::vec3 bumpNormal(const PhasorNoiseSample& sample, float f, float slope);
+// Profile blend of phasor_noise.glsl. Falls back to sin(phi) * 0.3 + 0.5 when no profile is enabled.
+[[nodiscard]] float applyProfiles(const std::array<bool, 4>& profiles, const glm::vec2& noise, float x);
+
+// Stops after the rows in flight once the cancellation token is cancelled, leaving the other rows at 0.
+[[nodiscard]] NoiseImage renderPhasorNoise(const PhasorNoiseParams& params, const OrientationSource& orientation, const PhasorNoiseRegion& region, const CancellationToken& cancellation = {});
+// Normal map of the region (see bumpNormal()) in the coordinates of the noise domain. The derivatives come with
+// the noise, so pNoise (if not null) receives the image of renderPhasorNoise() from the same evaluations.
+[[nodiscard]] NormalImage renderPhasorNoiseNormals(const PhasorNoiseParams& params, const OrientationSource& orientation, const PhasorNoiseRegion& region, float slope, NoiseImage* pNoise = nullptr);
+// Renders the region in horizontal strips of stripHeight rows (the last one may be shorter) and passes
+// them in order to consumeStrip, which runs on a separate thread while the next strip is rendered.
+// Memory use only depends on the width and stripHeight, never on the height of the region.
+void renderPhasorNoiseStrips(const PhasorNoiseParams& params, const OrientationSource& orientation, const PhasorNoiseRegion& region, int stripHeight,
+    const std::function<void(const NoiseImage& strip)>& consumeStrip);
@@ -0,0 +1,129 @@
+#include "progressive_refinement.h"
+#include <framework/gl_state.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+
+// Level 0 is rendered at 1/4 resolution, every following level doubles the resolution.
+static int levelDivisor(int level)
+{
+    return 1 << (ProgressiveRefinement::numLevels - 1 - level);
+}
+
+ProgressiveRefinement::~ProgressiveRefinement()
+{
+    freeResources();
+}
+
+void ProgressiveRefinement::restartIfChanged(uint64_t signature, const glm::ivec2& windowSize, int impulsesPerCell)
+{
+    if (windowSize != m_windowSize)
+        allocate(windowSize);
+    else if (signature == m_signature && impulsesPerCell == m_impulsesPerCell)
+        return;
+
+    m_signature = signature;
+    m_impulsesPerCell = impulsesPerCell;
+    m_level = 0;
+    m_impulsesDone = 0;
+    m_completedLevel = -1;
+}
+
+int ProgressiveRefinement::batchSize(int level) const
+{
+    // Number of impulses such that the pass costs stepBudget of a full frame (cost ~ pixels * impulses).
+    const float pixelFraction = 1.0f / static_cast<float>(levelDivisor(level) * levelDivisor(level));
+    return std::max(1, static_cast<int>(stepBudget * static_cast<float>(m_impulsesPerCell) / pixelFraction));
+}
+
+std::optional<ProgressiveStep> ProgressiveRefinement::currentStep() const
+{
+    if (converged() || m_impulsesPerCell <= 0)
+        return {};
+
+    // The very first step after a change uses a quarter of the impulses to respond as fast as possible.
+    const bool firstStep = m_level == 0 && m_impulsesDone == 0;
+    const int batch = firstStep ? std::max(1, (m_impulsesPerCell + 3) / 4) : batchSize(m_level);
+    return ProgressiveStep {
+        m_level,
+        m_resolutions[static_cast<size_t>(m_level)],
+        m_impulsesDone,
+        std::min(m_impulsesDone + batch, m_impulsesPerCell),
+        m_impulsesDone == 0
+    };
+}
+
+void ProgressiveRefinement::advance()
+{
+    const std::optional<ProgressiveStep> step = currentStep();
+    if (!step)
+        return;
+
+    m_impulsesDone = step->impulseEnd;
+    if (m_impulsesDone == m_impulsesPerCell) {
+        m_completedLevel = m_level;
+        m_level = std::min(m_level + 1, numLevels - 1);
+        m_impulsesDone = 0;
+    }
+}
+
+GLuint ProgressiveRefinement::texture(int level) const
+{
+    return m_textures[static_cast<size_t>(level)];
+}
+
+GLuint ProgressiveRefinement::depthTexture(int level) const
+{
+    return m_depthTextures[static_cast<size_t>(level)];
+}
+
+glm::ivec2 ProgressiveRefinement::resolution(int level) const
+{
+    return m_resolutions[static_cast<size_t>(level)];
+}
+
+int ProgressiveRefinement::displayLevel() const
+{
+    return std::max(m_completedLevel, 0);
+}
+
+bool ProgressiveRefinement::converged() const
+{
+    return m_completedLevel == numLevels - 1;
+}
+
+void ProgressiveRefinement::allocate(const glm::ivec2& windowSize)
+{
+    freeResources();
+    m_windowSize = windowSize;
+
+    for (int level = 0; level < numLevels; level++) {
+        const size_t i = static_cast<size_t>(level);
+        m_resolutions[i] = glm::max(windowSize / levelDivisor(level), glm::ivec2(1));
+
+        // The complex noise can be far outside of [0, 1], so it is accumulated in a 32 bit float target.
+        glCreateTextures(GL_TEXTURE_2D, 1, &m_textures[i]);
+        glTextureStorage2D(m_textures[i], 1, GL_RG32F, m_resolutions[i].x, m_resolutions[i].y);
+        glTextureParameteri(m_textures[i], GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(m_textures[i], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(m_textures[i], GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(m_textures[i], GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glCreateTextures(GL_TEXTURE_2D, 1, &m_depthTextures[i]);
+        glTextureStorage2D(m_depthTextures[i], 1, GL_DEPTH_COMPONENT32F, m_resolutions[i].x, m_resolutions[i].y);
+    }
+}
+
+void ProgressiveRefinement::freeResources()
+{
+    for (auto* pTextures : { &m_textures, &m_depthTextures }) {
+        for (GLuint& texture : *pTextures) {
+            if (texture != 0) {
+                glState().textureDeleted(texture);
+                glDeleteTextures(1, &texture);
+            }
+            texture = 0;
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+#include <framework/opengl_includes.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include <array>
+#include <cstdint>
+#include <optional>
+
+// One accumulation pass: adds impulses [impulseBegin, impulseEnd) of every cell to the complex noise
+// of a refinement level. The level has to be cleared (and its depth prepass rendered) first if clear is set.
+struct ProgressiveStep {
+    int level;
+    glm::ivec2 resolution;
+    int impulseBegin, impulseEnd;
+    bool clear;
+};
+
+// Progressive rendering of the phasor noise. The complex noise (before the profile is applied) is a
+// plain sum over impulses, so it can be accumulated over several frames in a float render target.
+// After a change the noise is first shown at 1/4 resolution with a quarter of the impulses, which is
+// then refined by accumulating the remaining impulses and by moving on to 1/2 and full resolution.
+// Every step costs at most stepBudget of a full resolution, all impulse frame.
+class ProgressiveRefinement {
+public:
+    static constexpr int numLevels = 3; // 1/4, 1/2 and full resolution.
+
+    ProgressiveRefinement() = default;
+    ProgressiveRefinement(const ProgressiveRefinement&) = delete;
+    ~ProgressiveRefinement();
+
+    // Restarts the refinement when the signature (hash of everything that changes the complex noise),
+    // the window size or the number of impulses per cell changed.
+    void restartIfChanged(uint64_t signature, const glm::ivec2& windowSize, int impulsesPerCell);
+
+    // The accumulation pass to render this frame, or nothing once the noise has converged.
+    [[nodiscard]] std::optional<ProgressiveStep> currentStep() const;
+    // Call after the current step has been rendered.
+    void advance();
+
+    [[nodiscard]] GLuint texture(int level) const;
+    [[nodiscard]] GLuint depthTexture(int level) const;
+    [[nodiscard]] glm::ivec2 resolution(int level) const;
+    // Finest level that accumulated all impulses (or the first level while that is still in progress).
+    [[nodiscard]] int displayLevel() const;
+    [[nodiscard]] bool converged() const;
+
+public:
+    float stepBudget { 1.0f / 16.0f };
+
+private:
+    [[nodiscard]] int batchSize(int level) const;
+    void allocate(const glm::ivec2& windowSize);
+    void freeResources();
+
+private:
+    std::array<GLuint, numLevels> m_textures {};
+    std::array<GLuint, numLevels> m_depthTextures {};
+    std::array<glm::ivec2, numLevels> m_resolutions {};
+    glm::ivec2 m_windowSize { 0 };
+
+    uint64_t m_signature { 0 };
+    int m_impulsesPerCell { 0 };
+    int m_level { 0 };
+    int m_impulsesDone { 0 };
+    int m_completedLevel { -1 };
+};
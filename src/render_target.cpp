@@ -0,0 +1,72 @@
+#include "render_target.h"
+#include <framework/gl_state.h>
+#include <cassert>
+
+RenderTarget::~RenderTarget()
+{
+    freeResources();
+}
+
+bool RenderTarget::resize(const glm::ivec2& size, GLenum colorFormat)
+{
+    if (size == m_size && colorFormat == m_colorFormat && m_framebuffer != 0)
+        return false;
+
+    // Immutable texture storage cannot be resized so the textures are recreated.
+    freeResources();
+    m_size = size;
+    m_colorFormat = colorFormat;
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &m_colorTexture);
+    glTextureStorage2D(m_colorTexture, 1, colorFormat, size.x, size.y);
+    glTextureParameteri(m_colorTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(m_colorTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(m_colorTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(m_colorTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &m_depthTexture);
+    glTextureStorage2D(m_depthTexture, 1, GL_DEPTH_COMPONENT32F, size.x, size.y);
+
+    glCreateFramebuffers(1, &m_framebuffer);
+    glNamedFramebufferTexture(m_framebuffer, GL_COLOR_ATTACHMENT0, m_colorTexture, 0);
+    glNamedFramebufferTexture(m_framebuffer, GL_DEPTH_ATTACHMENT, m_depthTexture, 0);
+    assert(glCheckNamedFramebufferStatus(m_framebuffer, GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    return true;
+}
+
+GLuint RenderTarget::framebuffer() const
+{
+    return m_framebuffer;
+}
+
+GLuint RenderTarget::colorTexture() const
+{
+    return m_colorTexture;
+}
+
+GLuint RenderTarget::depthTexture() const
+{
+    return m_depthTexture;
+}
+
+glm::ivec2 RenderTarget::size() const
+{
+    return m_size;
+}
+
+void RenderTarget::freeResources()
+{
+    if (m_framebuffer != 0) {
+        glState().framebufferDeleted(m_framebuffer);
+        glDeleteFramebuffers(1, &m_framebuffer);
+    }
+    for (GLuint* pTexture : { &m_colorTexture, &m_depthTexture }) {
+        if (*pTexture != 0) {
+            glState().textureDeleted(*pTexture);
+            glDeleteTextures(1, pTexture);
+        }
+    }
+    m_framebuffer = 0;
+    m_colorTexture = 0;
+    m_depthTexture = 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <framework/disable_all_warnings.h>
+#include <framework/opengl_includes.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+
+// Colour + depth render target that the scene is drawn into before it is upscaled to the window.
+class RenderTarget {
+public:
+    RenderTarget() = default;
+    RenderTarget(const RenderTarget&) = delete;
+    ~RenderTarget();
+
+    // (Re)allocates the textures when the size or colour format changed. Returns true if it did.
+    bool resize(const glm::ivec2& size, GLenum colorFormat = GL_RGBA8);
+
+    [[nodiscard]] GLuint framebuffer() const;
+    [[nodiscard]] GLuint colorTexture() const;
+    [[nodiscard]] GLuint depthTexture() const;
+    [[nodiscard]] glm::ivec2 size() const;
+
+private:
+    void freeResources();
+
+private:
+    GLuint m_colorTexture { 0 };
+    GLuint m_depthTexture { 0 };
+    GLuint m_framebuffer { 0 };
+    glm::ivec2 m_size { 0 };
+    GLenum m_colorFormat { GL_RGBA8 };
+};
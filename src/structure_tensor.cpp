@@ -0,0 +1,172 @@
+#include "structure_tensor.h"
+#include "parallel.h"
+#include <framework/trace.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64) || defined(__AVX__)
+#include <immintrin.h>
+#define STRUCTURE_TENSOR_SSE 1
+#endif
+
+// Normalized half kernel: weights[0] is the centre tap, weights[k] is used for offsets +k and -k.
+static std::vector<float> gaussianHalfKernel(float sigma)
+{
+    const int radius = std::max(1, static_cast<int>(std::ceil(3.0f * sigma)));
+    std::vector<float> weights(static_cast<size_t>(radius) + 1);
+    float sum = 0.0f;
+    for (int k = 0; k <= radius; k++) {
+        weights[static_cast<size_t>(k)] = std::exp(-0.5f * static_cast<float>(k * k) / (sigma * sigma));
+        sum += (k == 0 ? 1.0f : 2.0f) * weights[static_cast<size_t>(k)];
+    }
+    for (float& weight : weights)
+        weight /= sum;
+    return weights;
+}
+
+// out[x] = w * in[x]
+static void scaleRow(float* out, const float* in, float w, int n)
+{
+    int x = 0;
+#ifdef __AVX__
+    const __m256 w8 = _mm256_set1_ps(w);
+    for (; x + 8 <= n; x += 8)
+        _mm256_storeu_ps(out + x, _mm256_mul_ps(w8, _mm256_loadu_ps(in + x)));
+#endif
+#ifdef STRUCTURE_TENSOR_SSE
+    const __m128 w4 = _mm_set1_ps(w);
+    for (; x + 4 <= n; x += 4)
+        _mm_storeu_ps(out + x, _mm_mul_ps(w4, _mm_loadu_ps(in + x)));
+#endif
+    for (; x < n; x++)
+        out[x] = w * in[x];
+}
+
+// out[x] += w * (a[x] + b[x]), exploiting the symmetry of the gaussian kernel.
+static void accumulateSymmetricRow(float* out, const float* a, const float* b, float w, int n)
+{
+    int x = 0;
+#ifdef __AVX__
+    const __m256 w8 = _mm256_set1_ps(w);
+    for (; x + 8 <= n; x += 8) {
+        const __m256 sum = _mm256_add_ps(_mm256_loadu_ps(a + x), _mm256_loadu_ps(b + x));
+        _mm256_storeu_ps(out + x, _mm256_add_ps(_mm256_loadu_ps(out + x), _mm256_mul_ps(w8, sum)));
+    }
+#endif
+#ifdef STRUCTURE_TENSOR_SSE
+    const __m128 w4 = _mm_set1_ps(w);
+    for (; x + 4 <= n; x += 4) {
+        const __m128 sum = _mm_add_ps(_mm_loadu_ps(a + x), _mm_loadu_ps(b + x));
+        _mm_storeu_ps(out + x, _mm_add_ps(_mm_loadu_ps(out + x), _mm_mul_ps(w4, sum)));
+    }
+#endif
+    for (; x < n; x++)
+        out[x] += w * (a[x] + b[x]);
+}
+
+void gaussianBlur(std::span<float> pixels, int width, int height, float sigma)
+{
+    assert(pixels.size() == static_cast<size_t>(width) * static_cast<size_t>(height));
+    if (sigma <= 0.0f)
+        return;
+
+    const std::vector<float> weights = gaussianHalfKernel(sigma);
+    const int radius = static_cast<int>(weights.size()) - 1;
+    const auto row = [&](std::span<float> image, int y) { return image.data() + static_cast<size_t>(y) * static_cast<size_t>(width); };
+
+    // Horizontal pass (in place). Each row is copied into a buffer padded with clamped borders so
+    // that every tap is a contiguous, branch free loop over the row.
+    parallelForChunks(0, height, [&](int yBegin, int yEnd) {
+        std::vector<float> padded(static_cast<size_t>(width + 2 * radius));
+        for (int y = yBegin; y < yEnd; y++) {
+            float* pRow = row(pixels, y);
+            std::fill_n(padded.begin(), radius, pRow[0]);
+            std::copy_n(pRow, width, padded.begin() + radius);
+            std::fill_n(padded.begin() + radius + width, radius, pRow[width - 1]);
+
+            const float* pCentre = padded.data() + radius;
+            scaleRow(pRow, pCentre, weights[0], width);
+            for (int k = 1; k <= radius; k++)
+                accumulateSymmetricRow(pRow, pCentre + k, pCentre - k, weights[static_cast<size_t>(k)], width);
+        }
+    });
+
+    // Vertical pass. Every output row is a weighted sum of whole input rows, which keeps the memory
+    // accesses sequential (as opposed to walking down the columns).
+    std::vector<float> result(pixels.size());
+    parallelForChunks(0, height, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; y++) {
+            float* pOut = row(result, y);
+            scaleRow(pOut, row(pixels, y), weights[0], width);
+            for (int k = 1; k <= radius; k++) {
+                const float* pUp = row(pixels, std::min(y + k, height - 1));
+                const float* pDown = row(pixels, std::max(y - k, 0));
+                accumulateSymmetricRow(pOut, pUp, pDown, weights[static_cast<size_t>(k)], width);
+            }
+        }
+    });
+    std::copy(result.begin(), result.end(), pixels.begin());
+}
+
+PhaseField structureTensorOrientation(const Image& image, const StructureTensorSettings& settings)
+{
+    TRACE_ZONE("structureTensorOrientation");
+    const int width = image.width;
+    const int height = image.height;
+    const size_t numPixels = static_cast<size_t>(width) * static_cast<size_t>(height);
+    const auto index = [&](int x, int y) { return static_cast<size_t>(y) * static_cast<size_t>(width) + static_cast<size_t>(x); };
+
+    // Luminance with the rows flipped, such that row 0 is the bottom of the image.
+    std::vector<float> luminance(numPixels);
+    parallelForChunks(0, height, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; y++) {
+            for (int x = 0; x < width; x++) {
+                const glm::vec3 rgb = image.pixels[index(x, height - 1 - y)];
+                luminance[index(x, y)] = 0.2126f * rgb.r + 0.7152f * rgb.g + 0.0722f * rgb.b;
+            }
+        }
+    });
+    gaussianBlur(luminance, width, height, settings.gradientSigma);
+
+    // Structure tensor J = g g^T from central differences.
+    std::vector<float> jxx(numPixels), jxy(numPixels), jyy(numPixels);
+    parallelForChunks(0, height, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; y++) {
+            const int yUp = std::min(y + 1, height - 1);
+            const int yDown = std::max(y - 1, 0);
+            for (int x = 0; x < width; x++) {
+                const int xRight = std::min(x + 1, width - 1);
+                const int xLeft = std::max(x - 1, 0);
+                const float gx = 0.5f * (luminance[index(xRight, y)] - luminance[index(xLeft, y)]);
+                const float gy = 0.5f * (luminance[index(x, yUp)] - luminance[index(x, yDown)]);
+                jxx[index(x, y)] = gx * gx;
+                jxy[index(x, y)] = gx * gy;
+                jyy[index(x, y)] = gy * gy;
+            }
+        }
+    });
+    gaussianBlur(jxx, width, height, settings.tensorSigma);
+    gaussianBlur(jxy, width, height, settings.tensorSigma);
+    gaussianBlur(jyy, width, height, settings.tensorSigma);
+
+    // The major eigenvector of J points along the gradient; the edge tangent is perpendicular to it.
+    // The smoothed tensor is band limited so it is point sampled when decimating.
+    const float scale = std::max(1.0f, static_cast<float>(std::max(width, height)) / static_cast<float>(settings.maxResolution));
+    PhaseField out { std::max(1, static_cast<int>(static_cast<float>(width) / scale)), std::max(1, static_cast<int>(static_cast<float>(height) / scale)) };
+    out.period = 0.5f; // The tangent has no direction, only an axis.
+    parallelForChunks(0, out.height, [&](int yBegin, int yEnd) {
+        for (int y = yBegin; y < yEnd; y++) {
+            const int sy = std::min(static_cast<int>((static_cast<float>(y) + 0.5f) * scale), height - 1);
+            for (int x = 0; x < out.width; x++) {
+                const int sx = std::min(static_cast<int>((static_cast<float>(x) + 0.5f) * scale), width - 1);
+                const size_t i = index(sx, sy);
+                const float gradientAngle = 0.5f * std::atan2(2.0f * jxy[i], jxx[i] - jyy[i]);
+                const float turns = (gradientAngle + 0.5f * std::numbers::pi_v<float>) / (2.0f * std::numbers::pi_v<float>);
+                out.values[static_cast<size_t>(y) * static_cast<size_t>(out.width) + static_cast<size_t>(x)] = turns - std::round(turns);
+            }
+        }
+    });
+    return out;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "phase_field.h"
+#include <framework/image.h>
+#include <span>
+
+struct StructureTensorSettings {
+    float gradientSigma { 1.0f }; // Smoothing before differentiation (in pixels).
+    float tensorSigma { 4.0f }; // Integration scale of the structure tensor (in pixels).
+    int maxResolution { 1024 }; // The orientation field is decimated to at most this size.
+};
+
+// Separable gaussian blur of a single channel, row major image. Rows are distributed over all
+// hardware threads and the inner loops are vectorized with SSE/AVX when available.
+void gaussianBlur(std::span<float> pixels, int width, int height, float sigma);
+
+// Orientation of the image structure (edge tangent direction) in turns, computed from the smoothed
+// structure tensor. The tangent is axial, so the field has a period of 0.5 turns. Row 0 of the result is the bottom row of the image (OpenGL convention).
+[[nodiscard]] PhaseField structureTensorOrientation(const Image& image, const StructureTensorSettings& settings);
@@ -0,0 +1,291 @@
+#include "tile_cache.h"
+#include "hash.h"
+#include <framework/job_system.h>
+#include <framework/trace.h>
+#include <framework/variant_helper.h>
+DISABLE_WARNINGS_PUSH()
+#include <stb/stb_image.h>
+#include <stb/stb_image_write.h>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Bump when the output of the CPU engine changes, which invalidates all existing tiles.
+static constexpr uint64_t cacheVersion = 2;
+static constexpr const char* tileExtension = ".png";
+static constexpr const char* temporaryExtension = ".tmp";
+
+PhasorNoiseRegion tileRegion(const TileGrid& grid, const glm::ivec2& tile)
+{
+    return PhasorNoiseRegion { grid.origin + glm::vec2(tile * grid.tileSize) * grid.pixelSize, glm::vec2(static_cast<float>(grid.tileSize)) * grid.pixelSize, grid.tileSize, grid.tileSize };
+}
+
+uint64_t hashOrientation(const OrientationSource& orientation)
+{
+    Hasher hasher;
+    hasher.add(orientation.index());
+    std::visit(make_visitor(
+                   [&](const ProceduralOrientation& procedural) {
+                       hasher.add(procedural.seed);
+                   },
+                   [&](const SampledOrientation& sampled) {
+                       hasher.add(sampled.origin);
+                       hasher.add(sampled.extent);
+                       hasher.add(sampled.pPhaseField->width);
+                       hasher.add(sampled.pPhaseField->height);
+                       hasher.add(sampled.pPhaseField->period);
+                       hasher.addBytes(sampled.pPhaseField->values.data(), sampled.pPhaseField->values.size() * sizeof(float));
+                   }),
+        orientation);
+    return hasher.hash();
+}
+
+uint64_t tileCacheKey(const PhasorNoiseParams& params, uint64_t orientationHash, const TileGrid& grid, const glm::ivec2& tile)
+{
+    Hasher hasher;
+    hasher.add(cacheVersion);
+    hasher.add(params.f);
+    hasher.add(params.b);
+    hasher.add(params.impulsesPerKernel);
+    hasher.add(params.seed);
+    hasher.add(params.profiles);
+    hasher.add(params.period);
+    hasher.add(orientationHash);
+    hasher.add(grid.origin);
+    hasher.add(grid.pixelSize);
+    hasher.add(grid.tileSize);
+    hasher.add(tile);
+    return hasher.hash();
+}
+
+TileCache::TileCache(const std::filesystem::path& directory, uint64_t maxSizeInBytes)
+    : m_directory(directory)
+    , m_maxSize(maxSizeInBytes)
+{
+    std::filesystem::create_directories(directory);
+    evict();
+}
+
+std::filesystem::path TileCache::pathOf(uint64_t key) const
+{
+    std::array<char, 17> hex;
+    std::snprintf(hex.data(), hex.size(), "%016llx", static_cast<unsigned long long>(key));
+    return m_directory / std::string(hex.data(), 2) / (std::string(hex.data()) + tileExtension);
+}
+
+// Tiles are stored as 8 bit grayscale PNGs with the four bytes of every float in four separate planes
+// (most significant byte first) stacked vertically. The PNG filters then predict every byte plane on
+// its own, so the smooth high bytes compress well. The low mantissa bytes are essentially random.
+static std::vector<unsigned char> splitBytePlanes(const NoiseImage& tile)
+{
+    const size_t numPixels = tile.pixels.size();
+    std::vector<unsigned char> planes(4 * numPixels);
+    for (size_t i = 0; i < numPixels; i++) {
+        uint32_t bits;
+        std::memcpy(&bits, &tile.pixels[i], sizeof(bits));
+        for (size_t plane = 0; plane < 4; plane++)
+            planes[plane * numPixels + i] = static_cast<unsigned char>(bits >> (24 - 8 * plane));
+    }
+    return planes;
+}
+
+static void mergeBytePlanes(const unsigned char* pPlanes, NoiseImage& tile)
+{
+    const size_t numPixels = tile.pixels.size();
+    for (size_t i = 0; i < numPixels; i++) {
+        uint32_t bits = 0;
+        for (size_t plane = 0; plane < 4; plane++)
+            bits |= static_cast<uint32_t>(pPlanes[plane * numPixels + i]) << (24 - 8 * plane);
+        std::memcpy(&tile.pixels[i], &bits, sizeof(bits));
+    }
+}
+
+std::optional<NoiseImage> TileCache::load(uint64_t key)
+{
+    TRACE_ZONE("TileCache::load");
+    const std::filesystem::path filePath = pathOf(key);
+    std::ifstream file { filePath, std::ios::binary };
+    if (!file) {
+        m_misses++;
+        return {};
+    }
+    const std::vector<char> encoded { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+    int width, height, channels;
+    stbi_uc* pPlanes = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(encoded.data()), static_cast<int>(encoded.size()), &width, &height, &channels, 1);
+    if (!pPlanes || height % 4 != 0) {
+        // Only possible when the file was damaged outside of the cache, since writes are atomic.
+        stbi_image_free(pPlanes);
+        m_misses++;
+        return {};
+    }
+    NoiseImage out { width, height / 4, std::vector<float>(static_cast<size_t>(width) * static_cast<size_t>(height / 4)) };
+    mergeBytePlanes(pPlanes, out);
+    stbi_image_free(pPlanes);
+
+    // Refresh the modification time, which serves as the last use for the LRU eviction.
+    std::error_code error;
+    std::filesystem::last_write_time(filePath, std::filesystem::file_time_type::clock::now(), error);
+    m_hits++;
+    return out;
+}
+
+void TileCache::store(uint64_t key, const NoiseImage& tile)
+{
+    TRACE_ZONE("TileCache::store");
+    const std::vector<unsigned char> planes = splitBytePlanes(tile);
+    std::vector<unsigned char> encoded;
+    stbi_write_png_to_func(
+        [](void* pContext, void* pData, int size) {
+            auto* pEncoded = static_cast<std::vector<unsigned char>*>(pContext);
+            pEncoded->insert(std::end(*pEncoded), static_cast<unsigned char*>(pData), static_cast<unsigned char*>(pData) + size);
+        },
+        &encoded, tile.width, 4 * tile.height, 1, planes.data(), tile.width);
+
+    // Write to a unique temporary file and rename it, which atomically replaces any existing tile.
+    thread_local std::mt19937_64 random { std::random_device {}() ^ std::hash<std::thread::id> {}(std::this_thread::get_id()) };
+    const std::filesystem::path filePath = pathOf(key);
+    std::filesystem::path temporaryPath = filePath;
+    temporaryPath += "." + std::to_string(random()) + temporaryExtension;
+
+    std::error_code error;
+    std::filesystem::create_directories(filePath.parent_path(), error);
+    {
+        std::ofstream file { temporaryPath, std::ios::binary };
+        file.write(reinterpret_cast<const char*>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+        if (!file) {
+            file.close();
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporaryPath, filePath, error);
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+        return;
+    }
+
+    if (m_size.fetch_add(encoded.size()) + encoded.size() > m_maxSize)
+        evict();
+}
+
+void TileCache::evict()
+{
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type lastUse;
+        uint64_t size;
+    };
+    std::vector<Entry> entries;
+    uint64_t totalSize = 0;
+
+    // Other processes may add and remove files concurrently, so every error is treated as "file is gone".
+    std::error_code error;
+    const auto now = std::filesystem::file_time_type::clock::now();
+    for (auto it = std::filesystem::recursive_directory_iterator(m_directory, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+        std::error_code fileError;
+        if (!it->is_regular_file(fileError))
+            continue;
+        const auto lastUse = it->last_write_time(fileError);
+        const uint64_t size = it->file_size(fileError);
+        if (fileError)
+            continue;
+        // Left behind by a process that died while writing.
+        if (it->path().extension() == temporaryExtension && now - lastUse > std::chrono::hours(1)) {
+            std::filesystem::remove(it->path(), fileError);
+            continue;
+        }
+        if (it->path().extension() != tileExtension)
+            continue;
+        entries.push_back({ it->path(), lastUse, size });
+        totalSize += size;
+    }
+
+    // Evict down to 90% of the budget, so that the next few stores do not immediately trigger another scan.
+    if (totalSize > m_maxSize) {
+        std::sort(std::begin(entries), std::end(entries), [](const Entry& lhs, const Entry& rhs) { return lhs.lastUse < rhs.lastUse; });
+        const uint64_t target = m_maxSize - m_maxSize / 10;
+        for (const Entry& entry : entries) {
+            if (totalSize <= target)
+                break;
+            if (std::filesystem::remove(entry.path, error) || !error)
+                totalSize -= entry.size;
+        }
+    }
+    m_size = totalSize;
+}
+
+uint64_t TileCache::hits() const
+{
+    return m_hits;
+}
+
+uint64_t TileCache::misses() const
+{
+    return m_misses;
+}
+
+void renderPhasorNoiseTiles(const PhasorNoiseParams& params, const OrientationSource& orientation, const TileGrid& grid, const glm::ivec2& resolution,
+    TileCache* pCache, const std::function<void(const NoiseImage& strip)>& consumeStrip)
+{
+    const int tileSize = grid.tileSize;
+    const uint64_t orientationHash = pCache ? hashOrientation(orientation) : 0;
+    const glm::ivec2 numTiles = (resolution + tileSize - 1) / tileSize;
+
+    struct PendingTile {
+        uint64_t key;
+        NoiseImage tile;
+    };
+    // Double buffered: row of tiles i + 1 is rendered while row i is consumed and stored in the cache.
+    std::array<NoiseImage, 2> strips;
+    std::array<std::vector<PendingTile>, 2> newTiles;
+    JobHandle consumed;
+    for (int ty = 0, current = 0; ty < numTiles.y; ty++, current ^= 1) {
+        NoiseImage& strip = strips[static_cast<size_t>(current)];
+        std::vector<PendingTile>& pending = newTiles[static_cast<size_t>(current)];
+        strip.width = resolution.x;
+        strip.height = std::min(tileSize, resolution.y - ty * tileSize);
+        strip.pixels.resize(static_cast<size_t>(strip.width) * static_cast<size_t>(strip.height));
+        pending.clear();
+
+        for (int tx = 0; tx < numTiles.x; tx++) {
+            // Tiles are always rendered (and cached) whole; the tiles at the border are cropped.
+            const glm::ivec2 tile { tx, ty };
+            const uint64_t key = pCache ? tileCacheKey(params, orientationHash, grid, tile) : 0;
+            std::optional<NoiseImage> cached = pCache ? pCache->load(key) : std::nullopt;
+            if (cached && (cached->width != tileSize || cached->height != tileSize))
+                cached.reset();
+            if (!cached) {
+                TRACE_ZONE("render tile");
+                cached = renderPhasorNoise(params, orientation, tileRegion(grid, tile));
+                if (pCache)
+                    pending.push_back({ key, *cached });
+            }
+
+            const int columns = std::min(tileSize, resolution.x - tx * tileSize);
+            for (int y = 0; y < strip.height; y++) {
+                std::copy_n(std::begin(cached->pixels) + static_cast<ptrdiff_t>(y) * tileSize, columns,
+                    std::begin(strip.pixels) + static_cast<ptrdiff_t>(y) * strip.width + tx * tileSize);
+            }
+        }
+
+        if (consumed.valid())
+            consumed.wait();
+        consumed = jobSystem().submit([&consumeStrip, &strip, &pending, pCache]() {
+            TRACE_ZONE("consume strip");
+            consumeStrip(strip);
+            for (const PendingTile& newTile : pending)
+                pCache->store(newTile.key, newTile.tile);
+        });
+    }
+    if (consumed.valid())
+        consumed.wait();
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "phasor_noise.h"
+#include <framework/disable_all_warnings.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <optional>
+
+// Square tiles on the pixel lattice origin + (pixel + 0.5) * pixelSize. Tiles are addressed by their
+// integer coordinates, so renders of overlapping regions on the same lattice share their tiles.
+struct TileGrid {
+    glm::vec2 origin { 0.0f };
+    glm::vec2 pixelSize { 1.0f / 1024.0f };
+    int tileSize { 256 };
+};
+
+// Region of the noise domain that the tile covers (always the whole tile, also at the border of a render).
+[[nodiscard]] PhasorNoiseRegion tileRegion(const TileGrid& grid, const glm::ivec2& tile);
+
+// Hash of the orientation source (including the contents of a sampled phase field). Computed once
+// per render since hashing a large phase field for every tile would be wasteful.
+[[nodiscard]] uint64_t hashOrientation(const OrientationSource& orientation);
+// Hash of everything that determines the pixels of a tile.
+[[nodiscard]] uint64_t tileCacheKey(const PhasorNoiseParams& params, uint64_t orientationHash, const TileGrid& grid, const glm::ivec2& tile);
+
+// Persistent cache of rendered tiles that is shared between runs and processes. Tiles are stored
+// losslessly compressed in directories sharded by the first byte of their key. Files are written
+// under a temporary name and renamed, so other processes never see partially written tiles. When
+// the cache grows beyond its budget the least recently used tiles (by modification time, which is
+// refreshed on every hit) are removed.
+class TileCache {
+public:
+    TileCache(const std::filesystem::path& directory, uint64_t maxSizeInBytes);
+
+    [[nodiscard]] std::optional<NoiseImage> load(uint64_t key);
+    void store(uint64_t key, const NoiseImage& tile);
+    // Removes the least recently used tiles until the cache fits in its budget.
+    void evict();
+
+    [[nodiscard]] uint64_t hits() const;
+    [[nodiscard]] uint64_t misses() const;
+
+private:
+    [[nodiscard]] std::filesystem::path pathOf(uint64_t key) const;
+
+private:
+    std::filesystem::path m_directory;
+    uint64_t m_maxSize;
+    std::atomic<uint64_t> m_size { 0 }; // Estimate, corrected by every evict().
+    std::atomic<uint64_t> m_hits { 0 }, m_misses { 0 };
+};
+
+// Renders the pixels [0, resolution) of the tile grid one row of tiles at a time. Tiles are taken
+// from pCache when present and newly rendered tiles are added to it (pCache may be null). Strips are
+// passed to consumeStrip in order, with the same contract as renderPhasorNoiseStrips().
+void renderPhasorNoiseTiles(const PhasorNoiseParams& params, const OrientationSource& orientation, const TileGrid& grid, const glm::ivec2& resolution,
+    TileCache* pCache, const std::function<void(const NoiseImage& strip)>& consumeStrip);
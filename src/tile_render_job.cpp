@@ -0,0 +1,138 @@
+#include "tile_render_job.h"
+#include <framework/trace.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vector_relational.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <atomic>
+#include <optional>
+
+struct TileRenderJob::State {
+    PhasorNoiseParams params;
+    OrientationSource orientation;
+    TileGrid grid;
+    glm::ivec2 resolution;
+    std::function<void(const RenderedTile&)> publishTile;
+    TileCache* pCache;
+    uint64_t orientationHash;
+
+    std::vector<glm::ivec2> tiles; // In the order in which they are rendered.
+    std::atomic<size_t> nextTile { 0 };
+    std::atomic<int> numPublished { 0 };
+    CancellationToken cancellation { CancellationToken::create() };
+
+    void renderTile(const glm::ivec2& tile);
+};
+
+TileRenderJob::TileRenderJob(const PhasorNoiseParams& params, const OrientationSource& orientation, const TileGrid& grid, const glm::ivec2& resolution,
+    const TileOrder& order, JobPriority priority, std::function<void(const RenderedTile&)> publishTile, TileCache* pCache)
+    : m_pState(std::make_shared<State>())
+{
+    State& state = *m_pState;
+    state.params = params;
+    state.orientation = orientation;
+    state.grid = grid;
+    state.resolution = resolution;
+    state.publishTile = std::move(publishTile);
+    state.pCache = pCache;
+    state.orientationHash = pCache ? hashOrientation(orientation) : 0;
+
+    const int tileSize = grid.tileSize;
+    const glm::ivec2 numTiles = (resolution + tileSize - 1) / tileSize;
+    for (int y = 0; y < numTiles.y; y++) {
+        for (int x = 0; x < numTiles.x; x++)
+            state.tiles.emplace_back(x, y);
+    }
+    auto isVisible = [&](const glm::ivec2& tile) {
+        const glm::ivec2 tileBegin = tile * tileSize;
+        return glm::all(glm::lessThan(tileBegin, order.visibleEnd)) && glm::all(glm::greaterThan(tileBegin + tileSize, order.visibleBegin));
+    };
+    auto distanceToFocus = [&](const glm::ivec2& tile) {
+        return glm::distance(glm::vec2(tile * tileSize) + 0.5f * static_cast<float>(tileSize), order.focus);
+    };
+    std::stable_sort(std::begin(state.tiles), std::end(state.tiles), [&](const glm::ivec2& lhs, const glm::ivec2& rhs) {
+        const bool lhsVisible = isVisible(lhs), rhsVisible = isVisible(rhs);
+        if (lhsVisible != rhsVisible)
+            return lhsVisible;
+        return distanceToFocus(lhs) < distanceToFocus(rhs);
+    });
+
+    // The workers share the tiles, so they finish at about the same time however uneven the tiles are.
+    const int numWorkers = std::min(jobSystem().numThreads(), static_cast<int>(state.tiles.size()));
+    for (int i = 0; i < numWorkers; i++) {
+        m_workers.push_back(jobSystem().submit([pState = m_pState]() {
+            for (size_t index = pState->nextTile++; index < pState->tiles.size() && !pState->cancellation.isCancelled(); index = pState->nextTile++)
+                pState->renderTile(pState->tiles[index]);
+        },
+            {}, JobAffinity::Any, priority));
+    }
+}
+
+TileRenderJob::~TileRenderJob()
+{
+    cancel();
+    // Only wait() reports the exceptions of the workers.
+    for (const JobHandle& worker : m_workers) {
+        try {
+            worker.wait();
+        } catch (...) {
+        }
+    }
+}
+
+void TileRenderJob::cancel()
+{
+    m_pState->cancellation.cancel();
+}
+
+void TileRenderJob::wait()
+{
+    jobSystem().waitAll(m_workers);
+}
+
+bool TileRenderJob::isDone() const
+{
+    return std::all_of(std::begin(m_workers), std::end(m_workers), [](const JobHandle& worker) { return worker.isDone(); });
+}
+
+int TileRenderJob::numTiles() const
+{
+    return static_cast<int>(m_pState->tiles.size());
+}
+
+int TileRenderJob::numPublished() const
+{
+    return m_pState->numPublished.load();
+}
+
+void TileRenderJob::State::renderTile(const glm::ivec2& tile)
+{
+    const int tileSize = grid.tileSize;
+    const uint64_t key = pCache ? tileCacheKey(params, orientationHash, grid, tile) : 0;
+    std::optional<NoiseImage> image = pCache ? pCache->load(key) : std::nullopt;
+    if (image && (image->width != tileSize || image->height != tileSize))
+        image.reset();
+    if (!image) {
+        TRACE_ZONE("render tile");
+        image = renderPhasorNoise(params, orientation, tileRegion(grid, tile), cancellation);
+        // The rows after the cancellation are missing.
+        if (cancellation.isCancelled())
+            return;
+        if (pCache)
+            pCache->store(key, *image);
+    }
+
+    RenderedTile out;
+    out.tile = tile;
+    out.pixelBegin = tile * tileSize;
+    const glm::ivec2 size = glm::min(resolution - out.pixelBegin, glm::ivec2(tileSize));
+    out.image = NoiseImage { size.x, size.y, std::vector<float>(static_cast<size_t>(size.x) * static_cast<size_t>(size.y)) };
+    for (int y = 0; y < size.y; y++) {
+        std::copy_n(std::begin(image->pixels) + static_cast<ptrdiff_t>(y) * tileSize, size.x,
+            std::begin(out.image.pixels) + static_cast<ptrdiff_t>(y) * size.x);
+    }
+    publishTile(out);
+    numPublished++;
+}
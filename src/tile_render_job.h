@@ -0,0 +1,56 @@
+#pragma once
+#include "phasor_noise.h"
+#include "tile_cache.h"
+#include <framework/disable_all_warnings.h>
+#include <framework/job_system.h>
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// Finished tile of a TileRenderJob, cropped at the border of the render.
+struct RenderedTile {
+    glm::ivec2 tile;
+    glm::ivec2 pixelBegin; // Position of the first pixel in the render.
+    NoiseImage image;
+};
+
+// Order of the tiles of a TileRenderJob: the tiles that overlap the visible pixels [visibleBegin, visibleEnd)
+// come first, and within both groups the tiles closest to the focus pixel.
+struct TileOrder {
+    glm::vec2 focus { 0.0f };
+    glm::ivec2 visibleBegin { 0 };
+    glm::ivec2 visibleEnd { std::numeric_limits<int>::max() };
+};
+
+// Renders the pixels [0, resolution) of a tile grid in the background on the shared job system, with
+// one worker job per thread that takes the next tile in order. Every finished tile is passed to
+// publishTile (on the thread that rendered it) right away, so a preview can show the tiles before the
+// whole render is done. Cached tiles are taken from pCache and new ones are added to it (pCache may be null).
+//
+// cancel() stops a stale render: tiles that did not start are skipped and the tiles in flight stop after
+// their current rows, without being published. The orientation and the cache have to outlive the job.
+class TileRenderJob {
+public:
+    TileRenderJob(const PhasorNoiseParams& params, const OrientationSource& orientation, const TileGrid& grid, const glm::ivec2& resolution,
+        const TileOrder& order, JobPriority priority, std::function<void(const RenderedTile&)> publishTile, TileCache* pCache = nullptr);
+    TileRenderJob(const TileRenderJob&) = delete;
+    // Cancels the render and waits for the tiles in flight.
+    ~TileRenderJob();
+
+    void cancel();
+    // Waits until every tile was published (or skipped after cancel()).
+    void wait();
+    [[nodiscard]] bool isDone() const;
+
+    [[nodiscard]] int numTiles() const;
+    [[nodiscard]] int numPublished() const;
+
+private:
+    struct State;
+    std::shared_ptr<State> m_pState;
+    std::vector<JobHandle> m_workers;
+};